@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -80,6 +81,10 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* Identifies disk D in trace events as 2 * channel + device, so
+   that hd1:0 is 2. */
+#define disk_id(D) (((D)->channel - channels) * 2 + (D)->dev_no)
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
@@ -216,6 +221,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
+	TRACE (TRACE_DISK_READ, sec_no, disk_id (d));
 	select_sector (d, sec_no);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
 	sema_down (&c->completion_wait);
@@ -223,6 +229,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
 	input_sector (c, buffer);
 	d->read_cnt++;
+	TRACE (TRACE_DISK_READ_DONE, sec_no, disk_id (d));
 	lock_release (&c->lock);
 }
 
@@ -240,6 +247,7 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
+	TRACE (TRACE_DISK_WRITE, sec_no, disk_id (d));
 	select_sector (d, sec_no);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
 	if (!wait_while_busy (d))
@@ -247,6 +255,7 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 	output_sector (c, buffer);
 	sema_down (&c->completion_wait);
 	d->write_cnt++;
+	TRACE (TRACE_DISK_WRITE_DONE, sec_no, disk_id (d));
 	lock_release (&c->lock);
 }
 
@@ -17,9 +17,11 @@ input_init (void) {
 void
 input_putc (uint8_t key) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT (!intq_full (&buffer));
 
+	spinlock_acquire (&buffer.spin);
+	ASSERT (!intq_full (&buffer));
 	intq_putc (&buffer, key);
+	spinlock_release (&buffer.spin);
 	serial_notify ();
 }
 
@@ -31,18 +33,44 @@ input_getc (void) {
 	uint8_t key;
 
 	old_level = intr_disable ();
+	spinlock_acquire (&buffer.spin);
 	key = intq_getc (&buffer);
+	spinlock_release (&buffer.spin);
 	serial_notify ();
 	intr_set_level (old_level);
 
 	return key;
 }
 
+/* Like input_getc(), but gives up, returning false, if the
+   running thread is interrupted by thread_interrupt() while it
+   waits.  Otherwise stores the key in *KEY and returns true. */
+bool
+input_getc_interruptible (uint8_t *key) {
+	enum intr_level old_level;
+	bool success;
+
+	old_level = intr_disable ();
+	spinlock_acquire (&buffer.spin);
+	success = intq_getc_interruptible (&buffer, key);
+	spinlock_release (&buffer.spin);
+	if (success)
+		serial_notify ();
+	intr_set_level (old_level);
+
+	return success;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
 bool
 input_full (void) {
+	bool full;
+
 	ASSERT (intr_get_level () == INTR_OFF);
-	return intq_full (&buffer);
+	spinlock_acquire (&buffer.spin);
+	full = intq_full (&buffer);
+	spinlock_release (&buffer.spin);
+	return full;
 }
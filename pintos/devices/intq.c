@@ -3,12 +3,13 @@
 #include "threads/thread.h"
 
 static int next (int pos);
-static void wait (struct intq *q, struct thread **waiter);
+static void wait (struct intq *q, struct thread **waiter, bool interruptible);
 static void signal (struct intq *q, struct thread **waiter);
 
 /* Initializes interrupt queue Q. */
 void
 intq_init (struct intq *q) {
+	spinlock_init (&q->spin);
 	lock_init (&q->lock);
 	q->not_full = q->not_empty = NULL;
 	q->head = q->tail = 0;
@@ -17,14 +18,14 @@ intq_init (struct intq *q) {
 /* Returns true if Q is empty, false otherwise. */
 bool
 intq_empty (const struct intq *q) {
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	return q->head == q->tail;
 }
 
 /* Returns true if Q is full, false otherwise. */
 bool
 intq_full (const struct intq *q) {
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	return next (q->head) == q->tail;
 }
 
@@ -36,12 +37,10 @@ uint8_t
 intq_getc (struct intq *q) {
 	uint8_t byte;
 
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	while (intq_empty (q)) {
 		ASSERT (!intr_context ());
-		lock_acquire (&q->lock);
-		wait (q, &q->not_empty);
-		lock_release (&q->lock);
+		wait (q, &q->not_empty, false);
 	}
 
 	byte = q->buf[q->tail];
@@ -50,18 +49,36 @@ intq_getc (struct intq *q) {
 	return byte;
 }
 
+/* Like intq_getc(), but gives up, returning false, if the
+   running thread is interrupted by thread_interrupt() before or
+   while it waits.  Otherwise stores the byte in *BYTE and returns
+   true. */
+bool
+intq_getc_interruptible (struct intq *q, uint8_t *byte) {
+	struct thread *cur = thread_current ();
+
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
+	while (intq_empty (q)) {
+		ASSERT (!intr_context ());
+		if (__atomic_load_n (&cur->interrupted, __ATOMIC_SEQ_CST))
+			return false;
+		wait (q, &q->not_empty, true);
+	}
+
+	*byte = intq_getc (q);
+	return true;
+}
+
 /* Adds BYTE to the end of Q.
    Q must not be full if called from an interrupt handler.
    Otherwise, if Q is full, first sleeps until a byte is
    removed. */
 void
 intq_putc (struct intq *q, uint8_t byte) {
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	while (intq_full (q)) {
 		ASSERT (!intr_context ());
-		lock_acquire (&q->lock);
-		wait (q, &q->not_full);
-		lock_release (&q->lock);
+		wait (q, &q->not_full, false);
 	}
 
 	q->buf[q->head] = byte;
@@ -76,16 +93,42 @@ next (int pos) {
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member.  Waits until the given condition is true, or, if
+   INTERRUPTIBLE, until the running thread is interrupted.  Q's
+   spin lock is given up while we wait for Q's lock, which only
+   one waiter may hold, and while we sleep, so the condition must
+   be checked again on return. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) {
+wait (struct intq *q, struct thread **waiter, bool interruptible) {
+	struct thread *cur = thread_current ();
+
 	ASSERT (!intr_context ());
-	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT ((waiter == &q->not_empty && intq_empty (q))
-			|| (waiter == &q->not_full && intq_full (q)));
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
+	ASSERT (waiter == &q->not_empty || waiter == &q->not_full);
+
+	spinlock_release (&q->spin);
+	lock_acquire (&q->lock);
+	spinlock_acquire (&q->spin);
+
+	if (waiter == &q->not_empty ? intq_empty (q) : intq_full (q)) {
+		if (interruptible)
+			thread_set_interruptible (true);
+		*waiter = cur;
+		while (*waiter == cur
+				&& !(interruptible
+					&& __atomic_load_n (&cur->interrupted, __ATOMIC_SEQ_CST)))
+			thread_block_locked (&q->spin);
+		if (interruptible)
+			thread_set_interruptible (false);
+
+		/* Woken by thread_interrupt(), not by signal(). */
+		if (*waiter == cur)
+			*waiter = NULL;
+	}
 
-	*waiter = thread_current ();
-	thread_block ();
+	spinlock_release (&q->spin);
+	lock_release (&q->lock);
+	spinlock_acquire (&q->spin);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -94,7 +137,7 @@ wait (struct intq *q UNUSED, struct thread **waiter) {
    the waiting thread. */
 static void
 signal (struct intq *q UNUSED, struct thread **waiter) {
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	ASSERT ((waiter == &q->not_empty && !intq_empty (q))
 			|| (waiter == &q->not_full && !intq_full (q)));
 
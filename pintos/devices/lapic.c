@@ -0,0 +1,191 @@
+#include "devices/lapic.h"
+
+#include <debug.h>
+#include <stddef.h>
+
+#include "devices/timer.h"
+#include "intrinsic.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/mp.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC driver.  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)" for details.
+
+   Each CPU has its own local APIC at the same physical address,
+   so every CPU reaches its own one through the same mapping. */
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID 0x020    /* ID. */
+#define LAPIC_TPR 0x080   /* Task priority. */
+#define LAPIC_EOI 0x0b0   /* End of interrupt. */
+#define LAPIC_SVR 0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR 0x280   /* Error status. */
+#define LAPIC_ICRLO 0x300 /* Interrupt command, low half. */
+#define LAPIC_ICRHI 0x310 /* Interrupt command, high half. */
+#define LAPIC_LINT0 0x350 /* Local vector table: LINT0. */
+#define LAPIC_LINT1 0x360 /* Local vector table: LINT1. */
+#define LAPIC_LVT_TIMER 0x320 /* Local vector table: timer. */
+#define LAPIC_TICR 0x380  /* Timer initial count. */
+#define LAPIC_TCCR 0x390  /* Timer current count. */
+#define LAPIC_TDCR 0x3e0  /* Timer divide configuration. */
+
+/* SVR bits. */
+#define SVR_ENABLE 0x100 /* APIC software enable. */
+
+/* ICR bits. */
+#define ICR_INIT 0x00000500     /* INIT delivery mode. */
+#define ICR_STARTUP 0x00000600  /* Start-up delivery mode. */
+#define ICR_DELIVS 0x00001000   /* Delivery pending. */
+#define ICR_ASSERT 0x00004000   /* Level assert. */
+#define ICR_LEVEL 0x00008000    /* Level triggered. */
+#define ICR_OTHERS 0x000c0000   /* All excluding self. */
+
+/* LVT bits. */
+#define LVT_MASKED 0x00010000   /* Interrupt masked. */
+
+/* TDCR values. */
+#define TDCR_DIV16 0x3 /* Count at 1/16 of the bus clock. */
+
+/* Mapped local APIC registers, or NULL if there is no APIC. */
+static volatile uint32_t* lapic;
+
+/* Local APIC timer counts per timer tick. */
+static uint32_t lapic_timer_count;
+
+static uint32_t lapic_read(int reg) { return lapic[reg / 4]; }
+
+static void lapic_write(int reg, uint32_t value) {
+    lapic[reg / 4] = value;
+    (void)lapic[LAPIC_ID / 4]; /* Wait for the write to finish. */
+}
+
+/* Maps the local APIC registers at physical address PADDR into
+   the kernel's address space, uncached. */
+void lapic_map(uint64_t paddr) {
+    void* va = ptov(paddr);
+    uint64_t* pte = pml4e_walk(base_pml4, (uint64_t)va, 1);
+
+    ASSERT(pte != NULL);
+    *pte = paddr | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+    invlpg((uint64_t)va);
+    lapic = va;
+}
+
+/* Returns true if lapic_map() has been called. */
+bool lapic_present(void) { return lapic != NULL; }
+
+/* Enables the running CPU's local APIC.  The BSP keeps the
+   LINT0/LINT1 setup the BIOS left for the 8259A PICs; the other
+   CPUs mask them, so device interrupts only reach the BSP. */
+void lapic_init(void) {
+    ASSERT(lapic != NULL);
+
+    lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS);
+    if (this_cpu()->id != 0) {
+        lapic_write(LAPIC_LINT0, LVT_MASKED);
+        lapic_write(LAPIC_LINT1, LVT_MASKED);
+    }
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_EOI, 0);
+    lapic_write(LAPIC_TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t lapic_id(void) { return lapic != NULL ? lapic_read(LAPIC_ID) >> 24 : 0; }
+
+/* Acknowledges the interrupt being serviced. */
+void lapic_eoi(void) {
+    if (lapic != NULL) lapic_write(LAPIC_EOI, 0);
+}
+
+/* Waits for the previous interrupt command to be delivered. */
+static void wait_icr_idle(void) {
+    while (lapic_read(LAPIC_ICRLO) & ICR_DELIVS) asm volatile("pause");
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is APIC_ID. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec) {
+    wait_icr_idle();
+    lapic_write(LAPIC_ICRHI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICRLO, vec);
+}
+
+/* Sends interrupt VEC to every CPU but the running one. */
+void lapic_broadcast_ipi(uint8_t vec) {
+    wait_icr_idle();
+    lapic_write(LAPIC_ICRLO, ICR_OTHERS | vec);
+}
+
+/* Starts the CPU whose local APIC ID is APIC_ID running real-
+   mode code at ENTRY_PADDR, which must be page-aligned and below
+   1 MB, using the INIT-SIPI-SIPI sequence of [MP] B.4. */
+void lapic_start_ap(uint8_t apic_id, uint64_t entry_paddr) {
+    ASSERT(entry_paddr % PGSIZE == 0 && entry_paddr < 0x100000);
+
+    wait_icr_idle();
+    lapic_write(LAPIC_ICRHI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICRLO, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    timer_usleep(200);
+    lapic_write(LAPIC_ICRLO, ICR_INIT | ICR_LEVEL);
+    timer_msleep(10);
+
+    for (int i = 0; i < 2; i++) {
+        wait_icr_idle();
+        lapic_write(LAPIC_ICRHI, (uint32_t)apic_id << 24);
+        lapic_write(LAPIC_ICRLO, ICR_STARTUP | (entry_paddr >> 12));
+        timer_usleep(200);
+    }
+}
+
+/* Measures how many local APIC timer counts make up one timer
+   tick, by timing one tick of the PIT.  All local APIC timers
+   run off the same bus clock, so one measurement on the BSP
+   serves every CPU.  Leaves the BSP's timer as lapic_timer_init()
+   does.  Interrupts must be on. */
+void lapic_timer_calibrate(void) {
+    int64_t start;
+
+    ASSERT(lapic != NULL);
+    ASSERT(intr_get_level() == INTR_ON);
+
+    lapic_write(LAPIC_TDCR, TDCR_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER);
+
+    /* Wait for a tick boundary, then count through one tick. */
+    start = timer_ticks();
+    while (timer_ticks() == start) continue;
+    lapic_write(LAPIC_TICR, UINT32_MAX);
+    start = timer_ticks();
+    while (timer_ticks() == start) continue;
+    lapic_timer_count = UINT32_MAX - lapic_read(LAPIC_TCCR);
+    lapic_timer_init();
+}
+
+/* Puts the running CPU's local APIC timer in one-shot mode,
+   stopped.  lapic_timer_oneshot() arms it. */
+void lapic_timer_init(void) {
+    lapic_write(LAPIC_TICR, 0);
+    lapic_write(LAPIC_TDCR, TDCR_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER);
+}
+
+/* Arms the running CPU's local APIC timer to interrupt once, NS
+   nanoseconds from now, replacing any earlier deadline.  Stops
+   the timer if NS is 0.  lapic_timer_calibrate() must have been
+   called. */
+void lapic_timer_oneshot(uint64_t ns) {
+    uint64_t count;
+
+    ASSERT(lapic_timer_count != 0);
+
+    if (ns > NSEC_PER_SEC) ns = NSEC_PER_SEC;
+    count = ns * lapic_timer_count / (NSEC_PER_SEC / TIMER_FREQ);
+    if (count == 0 && ns != 0) count = 1;
+    if (count > UINT32_MAX) count = UINT32_MAX;
+    lapic_write(LAPIC_TICR, count);
+}
@@ -51,9 +51,12 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
+/* Data to be transmitted.  Its spin lock also serializes access
+   to the UART's registers. */
 static struct intq txq;
 
+static bool serial_lock (void);
+static void serial_unlock (bool locked);
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -88,7 +91,9 @@ serial_init_queue (void) {
 	intr_register_ext (0x20 + 4, serial_interrupt, "serial");
 	mode = QUEUE;
 	old_level = intr_disable ();
+	spinlock_acquire (&txq.spin);
 	write_ier ();
+	spinlock_release (&txq.spin);
 	intr_set_level (old_level);
 }
 
@@ -96,12 +101,14 @@ serial_init_queue (void) {
 void
 serial_putc (uint8_t byte) {
 	enum intr_level old_level = intr_disable ();
+	bool locked;
 
+	if (mode == UNINIT)
+		init_poll ();
+	locked = serial_lock ();
 	if (mode != QUEUE) {
 		/* If we're not set up for interrupt-driven I/O yet,
 		   use dumb polling to transmit a byte. */
-		if (mode == UNINIT)
-			init_poll ();
 		putc_poll (byte);
 	} else {
 		/* Otherwise, queue a byte and update the interrupt enable
@@ -118,6 +125,7 @@ serial_putc (uint8_t byte) {
 		intq_putc (&txq, byte);
 		write_ier ();
 	}
+	serial_unlock (locked);
 
 	intr_set_level (old_level);
 }
@@ -127,8 +135,11 @@ serial_putc (uint8_t byte) {
 void
 serial_flush (void) {
 	enum intr_level old_level = intr_disable ();
+	bool locked = serial_lock ();
+
 	while (!intq_empty (&txq))
 		putc_poll (intq_getc (&txq));
+	serial_unlock (locked);
 	intr_set_level (old_level);
 }
 
@@ -138,9 +149,33 @@ serial_flush (void) {
    to or removed from the buffer. */
 void
 serial_notify (void) {
+	bool locked;
+
 	ASSERT (intr_get_level () == INTR_OFF);
-	if (mode == QUEUE)
+	if (mode == QUEUE) {
+		locked = serial_lock ();
 		write_ier ();
+		serial_unlock (locked);
+	}
+}
+
+/* Acquires txq's spin lock, unless this CPU holds it already, as
+   it does when the serial interrupt handler passes input on, or
+   when a panic strikes inside this driver.  Returns true if the
+   lock was acquired, to be passed to serial_unlock(). */
+static bool
+serial_lock (void) {
+	if (spinlock_held_by_current_cpu (&txq.spin))
+		return false;
+	spinlock_acquire (&txq.spin);
+	return true;
+}
+
+/* Releases txq's spin lock if serial_lock() returned LOCKED. */
+static void
+serial_unlock (bool locked) {
+	if (locked)
+		spinlock_release (&txq.spin);
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -167,7 +202,7 @@ static void
 write_ier (void) {
 	uint8_t ier = 0;
 
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&txq.spin));
 
 	/* Enable transmit interrupt if we have any characters to
 	   transmit. */
@@ -196,6 +231,8 @@ putc_poll (uint8_t byte) {
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) {
+	spinlock_acquire (&txq.spin);
+
 	/* Inquire about interrupt in UART.  Without this, we can
 	   occasionally miss an interrupt running under QEMU. */
 	inb (IIR_REG);
@@ -212,4 +249,5 @@ serial_interrupt (struct intr_frame *f UNUSED) {
 
 	/* Update interrupt enable register based on queue status. */
 	write_ier ();
+	spinlock_release (&txq.spin);
 }
@@ -2,13 +2,18 @@
 
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 
+#include "devices/lapic.h"
+#include "intrinsic.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/mp.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -19,31 +24,113 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency and the PIT count for one timer tick,
+   rounded to nearest. */
+#define PIT_FREQ 1193180
+#define PIT_TICK_COUNT ((PIT_FREQ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Tickless idle state.  While armed, counter 0 runs in one-shot
+   mode for tickless_count PIT cycles, of which the first
+   tickless_first end the tick that was in progress on entry. */
+static bool tickless_armed;
+static int64_t tickless_ticks;   /* Whole ticks the one-shot spans. */
+static uint16_t tickless_count;  /* PIT count programmed. */
+static uint16_t tickless_first;  /* Count left in the current tick. */
+static long long tickless_entries; /* # of tickless idle periods. */
+static long long tickless_skipped; /* # of ticks without an interrupt. */
+
+/* Wakes the sleepers the timer interrupt leaves behind: those
+   due across a wrap of the timing wheel, whose cascade may move
+   any number of sleepers, and so is done by a worker thread
+   rather than with interrupts off in the handler. */
+static struct work wakeup_work;
+static void wake_sleepers(void* aux);
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* # of timer ticks over which the TSC is calibrated. */
+#define TSC_CALIBRATE_TICKS 5
+
+/* Sleeps shorter than this spin on the TSC, since blocking and
+   being woken would take about as long. */
+#define HR_SPIN_NS 2000
+
+/* TSC frequency in cycles per second, or 0 before
+   timer_calibrate().  The TSC is read as a nanosecond clock
+   starting at tsc_boot, scaled by ns_mult / 2**32. */
+static uint64_t tsc_freq;
+static uint64_t tsc_boot;
+static uint64_t ns_mult;
+static uint64_t tsc_per_tick;
+static bool tsc_invariant;
+
+/* A thread sleeping for less than one tick.  Sub-tick sleeps
+   block until a one-shot local APIC timer interrupt, rather than
+   spin. */
+struct hr_sleeper {
+    uint64_t deadline;     /* TSC value to wake up at. */
+    struct thread* thread; /* Sleeping thread. */
+    struct list_elem elem; /* hr_sleepers[] element. */
+};
+
+/* Each CPU's sub-tick sleepers, in order of deadline.  A CPU's
+   local APIC timer is armed for the earlier of its first
+   sleeper's deadline and its tick_deadline[]. */
+static struct list hr_sleepers[CPU_MAX];
+
+/* TSC value of each CPU's next timer tick.  The APs take their
+   ticks from their local APIC timers; the BSP's come from the
+   PIT, so its entry is UINT64_MAX. */
+static uint64_t tick_deadline[CPU_MAX];
+
+static bool hr_ready;        /* Can sub-tick sleeps block? */
+static long long hr_sleeps;  /* # of sub-tick sleeps that blocked. */
+static long long hr_spins;   /* # of sub-tick sleeps that spun. */
+
 static intr_handler_func timer_interrupt;
+static intr_handler_func lapic_timer_interrupt;
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
+static void pit_set_periodic(void);
+static void tsc_calibrate(void);
+static uint64_t tsc_to_ns(uint64_t cycles);
+static void hr_sleep(int64_t ns);
+static void hr_arm(void);
+static bool hr_deadline_less(const struct list_elem*, const struct list_elem*, void* aux);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void timer_init(void) {
-    /* 8254 input frequency divided by TIMER_FREQ, rounded to
-       nearest. */
-    uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+    tsc_boot = rdtsc();
+    for (int cpu = 0; cpu < CPU_MAX; cpu++) {
+        list_init(&hr_sleepers[cpu]);
+        tick_deadline[cpu] = UINT64_MAX;
+    }
+
+    work_init(&wakeup_work, wake_sleepers, NULL);
+    pit_set_periodic();
+    intr_register_ext(0x20, timer_interrupt, "8254 Timer");
+    if (lapic_present()) intr_register_ext(LAPIC_TIMER, lapic_timer_interrupt, "Local APIC timer");
+}
+
+/* Programs counter 0 to interrupt TIMER_FREQ times per second. */
+static void pit_set_periodic(void) {
+    uint16_t count = PIT_TICK_COUNT;
 
     outb(0x43, 0x34); /* CW: counter 0, LSB then MSB, mode 2, binary. */
     outb(0x40, count & 0xff);
     outb(0x40, count >> 8);
-
-    intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -67,24 +154,81 @@ void timer_calibrate(void) {
         if (!too_many_loops(high_bit | test_bit)) loops_per_tick |= test_bit;
 
     printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+
+    tsc_calibrate();
+
+    /* With a calibrated local APIC timer, sub-tick sleeps can
+       block instead of spinning, and the APs can tick. */
+    if (lapic_present()) {
+        lapic_timer_calibrate();
+        hr_ready = true;
+    }
+}
+
+/* Starts timer ticks on a secondary CPU.  The PIT only
+   interrupts the BSP, so the other CPUs tick from their local
+   APIC timers, which are also used for sub-tick sleeps.  Called
+   by each AP with interrupts off, after timer_calibrate(). */
+void timer_start_ap(void) {
+    ASSERT(hr_ready);
+
+    lapic_timer_init();
+    tick_deadline[this_cpu()->id] = rdtsc() + tsc_per_tick;
+    hr_arm();
+}
+
+/* Measures the TSC frequency against the PIT and sets up the
+   nanosecond clock. */
+static void tsc_calibrate(void) {
+    uint32_t a, b, c, d;
+    uint64_t start_tsc;
+    int64_t start;
+
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    if (a >= 0x80000007) {
+        cpuid(0x80000007, 0, &a, &b, &c, &d);
+        tsc_invariant = (d & (1u << 8)) != 0;
+    }
+
+    /* Wait for a tick boundary, then time whole ticks. */
+    start = timer_ticks();
+    while (timer_ticks() == start) barrier();
+    start_tsc = rdtsc();
+    start = timer_ticks();
+    while (timer_ticks() < start + TSC_CALIBRATE_TICKS) barrier();
+
+    tsc_freq = (rdtsc() - start_tsc) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+    tsc_per_tick = tsc_freq / TIMER_FREQ;
+    ns_mult = ((uint64_t)NSEC_PER_SEC << 32) / tsc_freq;
+    printf("TSC: %'" PRIu64 " kHz%s.\n", tsc_freq / 1000,
+           tsc_invariant ? "" : " (not invariant, may drift)");
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks(void) {
-    enum intr_level old_level = intr_disable();
-    int64_t t = ticks;
-    intr_set_level(old_level);
-    barrier();
-    return t;
+    /* Only the BSP's timer interrupt advances it. */
+    return __atomic_load_n(&ticks, __ATOMIC_RELAXED);
 }
 
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
+/* Returns the number of nanoseconds since the OS booted, read
+   from the TSC.  Until timer_calibrate() runs, only whole timer
+   ticks are counted. */
+int64_t timer_ns(void) {
+    if (tsc_freq == 0) return timer_ticks() * (NSEC_PER_SEC / TIMER_FREQ);
+    return tsc_to_ns(rdtsc() - tsc_boot);
+}
+
+/* Returns the TSC frequency in cycles per second, or 0 before
+   timer_calibrate(). */
+uint64_t timer_tsc_freq(void) { return tsc_freq; }
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void timer_sleep(int64_t sleep_tick) {
-    if (ticks <= 0) return;
+    if (sleep_tick <= 0) return;
     thread_sleep(timer_ticks() + sleep_tick);
 }
 
@@ -97,16 +241,127 @@ void timer_usleep(int64_t us) { real_time_sleep(us, 1000 * 1000); }
 /* Suspends execution for approximately NS nanoseconds. */
 void timer_nsleep(int64_t ns) { real_time_sleep(ns, 1000 * 1000 * 1000); }
 
+/* Stops the periodic tick until DEADLINE, the earliest tick at
+   which a sleeping thread is due.  The PIT is put in one-shot
+   mode, so the wait is capped at what its 16-bit counter can
+   hold (5 ticks at 100 Hz).  Called by the idle thread with
+   interrupts off; does nothing unless "-tickless" was given. */
+void timer_tickless_enter(int64_t deadline) {
+    uint16_t left;
+    int64_t n;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (!timer_tickless || tickless_armed) return;
+
+    /* If the next periodic tick is due anyway, keep it. */
+    n = deadline - ticks;
+    if (n < 2) return;
+
+    /* Latch counter 0 to learn how far into the tick we are. */
+    outb(0x43, 0x00);
+    left = inb(0x40);
+    left |= inb(0x40) << 8;
+    if (left == 0 || left > PIT_TICK_COUNT) left = PIT_TICK_COUNT;
+
+    if (n > 1 + (0xffff - left) / PIT_TICK_COUNT) n = 1 + (0xffff - left) / PIT_TICK_COUNT;
+    if (n < 2) return;
+
+    tickless_ticks = n;
+    tickless_first = left;
+    tickless_count = left + (n - 1) * PIT_TICK_COUNT;
+    tickless_armed = true;
+    tickless_entries++;
+
+    outb(0x43, 0x30); /* CW: counter 0, LSB then MSB, mode 0, binary. */
+    outb(0x40, tickless_count & 0xff);
+    outb(0x40, tickless_count >> 8);
+}
+
+/* Ends a tickless idle period, if one is in progress: credits
+   the ticks that passed without an interrupt, has any sleeper
+   that became due woken and restores the periodic tick.  Called
+   on entry to every external interrupt. */
+void timer_tickless_exit(void) {
+    uint8_t status;
+    uint16_t count;
+    int64_t elapsed;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    if (!tickless_armed) return;
+    tickless_armed = false;
+
+    /* Read back counter 0's status and count together. */
+    outb(0x43, 0xc2);
+    status = inb(0x40);
+    count = inb(0x40);
+    count |= inb(0x40) << 8;
+
+    if (status & 0x80) {
+        /* OUT is high: the one-shot expired.  Its IRQ 0, being
+           handled now or pending, accounts for the last tick. */
+        elapsed = tickless_ticks - 1;
+    } else {
+        /* Woken early by another device.  The partial tick in
+           progress is dropped when the period restarts. */
+        uint16_t used = tickless_count - count;
+        elapsed = used < tickless_first ? 0 : 1 + (used - tickless_first) / PIT_TICK_COUNT;
+    }
+    pit_set_periodic();
+
+    tickless_skipped += elapsed;
+    while (elapsed-- > 0) {
+        __atomic_store_n(&ticks, ticks + 1, __ATOMIC_RELAXED);
+        thread_tick();
+    }
+    if (thread_wakeup_tick(ticks)) schedule_work(&wakeup_work);
+}
+
 /* Prints timer statistics. */
-void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
+void timer_print_stats(void) {
+    printf("Timer: %" PRId64 " ticks\n", timer_ticks());
+    if (hr_sleeps + hr_spins > 0)
+        printf("Timer: %lld sub-tick sleeps blocked, %lld spun\n", hr_sleeps, hr_spins);
+    if (timer_tickless)
+        printf("Timer: %lld tickless idle periods, %lld ticks skipped\n", tickless_entries,
+               tickless_skipped);
+}
 
 /* Timer interrupt handler. */
 static void timer_interrupt(struct intr_frame* args UNUSED) {
-    ticks++;
-    wake_sleeping_threads(timer_ticks());
+    __atomic_store_n(&ticks, ticks + 1, __ATOMIC_RELAXED);
+    if (thread_wakeup_tick(ticks)) schedule_work(&wakeup_work);
+    workqueue_tick(ticks);
     thread_tick();
 }
 
+/* Cascades the timing wheel and wakes the sleepers due by now.
+   Runs in a worker thread. */
+static void wake_sleepers(void* aux UNUSED) { wake_sleeping_threads(timer_ticks()); }
+
+/* Local APIC timer interrupt handler.  Wakes the sub-tick
+   sleepers that are due and, on the APs, runs the timer tick. */
+static void lapic_timer_interrupt(struct intr_frame* args UNUSED) {
+    struct list* sleepers = &hr_sleepers[this_cpu()->id];
+    uint64_t* tick = &tick_deadline[this_cpu()->id];
+    uint64_t now = rdtsc();
+
+    while (!list_empty(sleepers)) {
+        struct hr_sleeper* s = list_entry(list_front(sleepers), struct hr_sleeper, elem);
+        if (s->deadline > now) break;
+        list_pop_front(sleepers);
+        thread_unblock(s->thread);
+    }
+
+    if (now >= *tick) {
+        /* Drop ticks we were too late for rather than run them
+           back to back. */
+        *tick += tsc_per_tick;
+        if (*tick <= now) *tick = now + tsc_per_tick;
+        thread_tick();
+    }
+    hr_arm();
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
@@ -151,10 +406,75 @@ static void real_time_sleep(int64_t num, int32_t denom) {
            processes. */
         timer_sleep(ticks);
     } else {
-        /* Otherwise, use a busy-wait loop for more accurate
-           sub-tick timing.  We scale the numerator and denominator
-           down by 1000 to avoid the possibility of overflow. */
+        /* Otherwise, wait on the TSC for more accurate sub-tick
+           timing.  We scale the numerator and denominator down by
+           1000 to avoid the possibility of overflow. */
         ASSERT(denom % 1000 == 0);
-        busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+        hr_sleep(num * (NSEC_PER_SEC / 1000) / (denom / 1000));
     }
 }
+
+/* Converts a TSC interval to nanoseconds. */
+static uint64_t tsc_to_ns(uint64_t cycles) {
+    return ((unsigned __int128)cycles * ns_mult) >> 32;
+}
+
+/* Sleeps for NS nanoseconds, less than one timer tick.  Blocks
+   until the local APIC timer says the deadline has passed, if it
+   can, or else spins. */
+static void hr_sleep(int64_t ns) {
+    struct hr_sleeper s;
+    enum intr_level old_level;
+
+    if (ns <= 0) return;
+    if (tsc_freq == 0) {
+        /* Not calibrated yet: fall back to the delay loop. */
+        busy_wait(loops_per_tick * ns / (NSEC_PER_SEC / TIMER_FREQ));
+        return;
+    }
+
+    s.deadline = rdtsc() + ns * tsc_freq / NSEC_PER_SEC;
+    if (!hr_ready || ns < HR_SPIN_NS) {
+        __atomic_fetch_add(&hr_spins, 1, __ATOMIC_RELAXED);
+        while (rdtsc() < s.deadline) asm volatile("pause");
+        return;
+    }
+
+    s.thread = thread_current();
+    old_level = intr_disable();
+    list_insert_ordered(&hr_sleepers[this_cpu()->id], &s.elem, hr_deadline_less, NULL);
+    __atomic_fetch_add(&hr_sleeps, 1, __ATOMIC_RELAXED);
+    hr_arm();
+    thread_block();
+    intr_set_level(old_level);
+}
+
+/* Arms the running CPU's local APIC timer for its next event:
+   its earliest sub-tick sleeper or its next tick, whichever
+   comes first.  Interrupts must be off. */
+static void hr_arm(void) {
+    struct list* sleepers = &hr_sleepers[this_cpu()->id];
+    uint64_t deadline = tick_deadline[this_cpu()->id];
+    uint64_t now;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (!list_empty(sleepers)) {
+        struct hr_sleeper* s = list_entry(list_front(sleepers), struct hr_sleeper, elem);
+        if (s->deadline < deadline) deadline = s->deadline;
+    }
+
+    if (deadline == UINT64_MAX) {
+        lapic_timer_oneshot(0);
+        return;
+    }
+    now = rdtsc();
+    lapic_timer_oneshot(deadline > now ? tsc_to_ns(deadline - now) + 1 : 1);
+}
+
+/* Orders hr_sleepers by deadline, earliest first. */
+static bool hr_deadline_less(const struct list_elem* a, const struct list_elem* b,
+                             void* aux UNUSED) {
+    return list_entry(a, struct hr_sleeper, elem)->deadline <
+           list_entry(b, struct hr_sleeper, elem)->deadline;
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* VGA text screen support.  See [FREEVGA] for more information. */
@@ -25,6 +26,9 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Serializes output to the display between CPUs. */
+static struct spinlock vga_lock;
+
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -48,9 +52,13 @@ init (void) {
 void
 vga_putc (int c) {
 	/* Disable interrupts to lock out interrupt handlers
-	   that might write to the console. */
+	   that might write to the console.  A panic in here may
+	   find the lock held by its own CPU already. */
 	enum intr_level old_level = intr_disable ();
+	bool locked = !spinlock_held_by_current_cpu (&vga_lock);
 
+	if (locked)
+		spinlock_acquire (&vga_lock);
 	init ();
 
 	switch (c) {
@@ -88,6 +96,8 @@ vga_putc (int c) {
 	/* Update cursor position. */
 	move_cursor ();
 
+	if (locked)
+		spinlock_release (&vga_lock);
 	intr_set_level (old_level);
 }
 
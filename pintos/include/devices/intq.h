@@ -8,8 +8,9 @@
    kernel threads and external interrupt handlers.
 
    Interrupt queue functions can be called from kernel threads or
-   from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
+   from external interrupt handlers.  Except for intq_init(), the
+   queue's spin lock must be held in either case, with interrupts
+   off.  A thread that has to wait gives it up while asleep.
 
    The interrupt queue has the structure of a "monitor".  Locks
    and condition variables from threads/synch.h cannot be used in
@@ -22,6 +23,8 @@
 
 /* A circular queue of bytes. */
 struct intq {
+	struct spinlock spin;       /* Protects the rest but LOCK. */
+
 	/* Waiting threads. */
 	struct lock lock;           /* Only one thread may wait at once. */
 	struct thread *not_full;    /* Thread waiting for not-full condition. */
@@ -37,6 +40,7 @@ void intq_init (struct intq *);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
+bool intq_getc_interruptible (struct intq *, uint8_t *);
 void intq_putc (struct intq *, uint8_t);
 
 #endif /* devices/intq.h */
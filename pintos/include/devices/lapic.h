@@ -0,0 +1,22 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Default physical address of the local APIC registers. */
+#define LAPIC_DEFAULT_PADDR 0xfee00000
+
+void lapic_map(uint64_t paddr);
+bool lapic_present(void);
+void lapic_init(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec);
+void lapic_broadcast_ipi(uint8_t vec);
+void lapic_start_ap(uint8_t apic_id, uint64_t entry_paddr);
+void lapic_timer_calibrate(void);
+void lapic_timer_init(void);
+void lapic_timer_oneshot(uint64_t ns);
+
+#endif /* devices/lapic.h */
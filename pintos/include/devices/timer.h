@@ -2,22 +2,37 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Nanoseconds per second. */
+#define NSEC_PER_SEC 1000000000LL
+
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_ns (void);
+uint64_t timer_tsc_freq (void);
 
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_start_ap (void);
+
+void timer_tickless_enter (int64_t deadline);
+void timer_tickless_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
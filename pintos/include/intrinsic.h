@@ -112,6 +112,30 @@ static __inline uint64_t rrsp(void) {
 	__asm __volatile("movq %%rsp,%0" : "=r" (val));
 	return val;
 }
+__attribute__((always_inline))
+static __inline uint64_t rcr0(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr0,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr0(uint64_t val) {
+	__asm __volatile("movq %0,%%cr0" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0,%%cr4" : : "r" (val));
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rcr2(void) {
 	uint64_t val;
@@ -128,4 +152,19 @@ static __inline void write_msr(uint32_t ecx, uint64_t val) {
 			:: "c" (ecx), "d" (edx), "a" (eax) );
 }
 
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a,
+		uint32_t *b, uint32_t *c, uint32_t *d) {
+	__asm __volatile("cpuid"
+			: "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+			: "a" (leaf), "c" (subleaf));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rdtsc(void) {
+	uint32_t lo, hi;
+	__asm __volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
 #endif /* intrinsic.h */
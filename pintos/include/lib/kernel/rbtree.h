@@ -0,0 +1,62 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree: insertion and removal take
+ * O(log n) time, and the smallest element is always at hand.
+ * Elements that compare equal are kept in insertion order, so
+ * the tree can also serve as a priority queue that is FIFO among
+ * equals.
+ *
+ * Like the linked list and hash table, the tree does no dynamic
+ * allocation.  Each structure that can be in a tree embeds a
+ * struct rb_node member, and rb_entry() converts a pointer to
+ * that member back into a pointer to the enclosing structure.
+ * Refer to lib/kernel/list.h for a detailed explanation. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree node. */
+struct rb_node {
+	struct rb_node *parent;     /* Parent, or NULL for the root. */
+	struct rb_node *left;       /* Left child, or NULL. */
+	struct rb_node *right;      /* Right child, or NULL. */
+	bool red;                   /* Red or black? */
+};
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+ * structure that RB_NODE is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)                       \
+	((STRUCT *) ((uint8_t *) (RB_NODE)                      \
+		- offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+ * data AUX.  Returns true if A is less than B, or false if A is
+ * greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+		const struct rb_node *b, void *aux);
+
+/* Red-black tree. */
+struct rb_tree {
+	struct rb_node *root;       /* Root node, or NULL if empty. */
+	struct rb_node *min;        /* Leftmost node, or NULL if empty. */
+	size_t size;                /* Number of nodes. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_insert (struct rb_tree *, struct rb_node *);
+void rb_remove (struct rb_tree *, struct rb_node *);
+
+struct rb_node *rb_min (const struct rb_tree *);
+struct rb_node *rb_next (const struct rb_node *);
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
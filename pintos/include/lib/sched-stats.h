@@ -0,0 +1,21 @@
+#ifndef __LIB_SCHED_STATS_H
+#define __LIB_SCHED_STATS_H
+
+#include <stdint.h>
+
+/* Number of buckets in a wakeup latency histogram.  Bucket N
+   counts wakeups that waited [2**N, 2**(N+1)) TSC cycles between
+   thread_unblock() and getting the CPU; the last bucket also
+   counts everything longer. */
+#define SCHED_HIST_BUCKETS 32
+
+/* Scheduler statistics of one thread.  Times are in TSC cycles. */
+struct sched_stats {
+	uint64_t run_cycles;            /* Time spent RUNNING. */
+	uint64_t ready_cycles;          /* Time spent READY, waiting for a CPU. */
+	uint64_t voluntary_switches;    /* Gave up the CPU: blocked, yielded, exited. */
+	uint64_t involuntary_switches;  /* Preempted while still runnable. */
+	uint32_t wakeup_latency[SCHED_HIST_BUCKETS];
+};
+
+#endif /* lib/sched-stats.h */
@@ -36,6 +36,18 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Diagnostics. */
+	SYS_SCHEDSTAT,              /* Get the caller's scheduler statistics. */
+
+	/* User-space synchronization. */
+	SYS_FUTEX_WAIT,             /* Sleep if an int still has a value. */
+	SYS_FUTEX_WAKE,             /* Wake threads sleeping on an int. */
+
+	/* User threads. */
+	SYS_THREAD_CREATE,          /* Start a thread in this process. */
+	SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+	SYS_THREAD_EXIT,            /* Exit the calling thread only. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <sched-stats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -50,6 +51,20 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Diagnostics. */
+void schedstat (struct sched_stats *);
+
+/* User-space synchronization. */
+int futex_wait (int *uaddr, int expected);
+int futex_wake (int *uaddr, int count);
+
+/* User threads.  The names keep clear of the kernel's own
+   thread_create() and thread_exit(). */
+typedef void uthread_func (void *aux);
+int uthread_create (uthread_func *, void *aux);
+int uthread_join (int tid);
+void uthread_exit (void) NO_RETURN;
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
@@ -0,0 +1,25 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+/* Lazy switching of the x87/SSE/AVX register state.
+ *
+ * The kernel itself never touches these registers (it is built
+ * with -msoft-float -mno-sse), so only user code needs them
+ * preserved.  A thread gets a save area the first time it uses
+ * them, trapping with #NM because CR0.TS is set.  After that,
+ * each CPU leaves the state of the last thread that used them
+ * in its registers and only swaps it out when another thread
+ * traps. */
+
+struct thread;
+
+void fpu_init(void);
+void fpu_init_ap(void);
+void fpu_switch(struct thread* prev, struct thread* next);
+bool fpu_copy(struct thread* dst, struct thread* src);
+void fpu_release(struct thread*);
+void fpu_print_stats(void);
+
+#endif /* threads/fpu.h */
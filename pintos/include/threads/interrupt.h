@@ -66,13 +66,17 @@ struct intr_frame {
 typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
+void intr_init_ap (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
+void intr_set_ist (uint8_t vec, int ist);
 bool intr_context (void);
 void intr_yield_on_return (void);
+void intr_idle (void);
 
 void intr_dump_frame (const struct intr_frame *);
+void intr_print_stats (void);
 const char *intr_name (uint8_t vec);
 
 #endif /* threads/interrupt.h */
@@ -0,0 +1,48 @@
+#ifndef THREADS_KSTACK_H
+#define THREADS_KSTACK_H
+
+#include <stdint.h>
+
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/mp.h"
+
+/* Kernel stacks.
+ *
+ * Every thread but the initial one runs on a kernel stack of
+ * kstack_pages pages, mapped into a slot of its own in a region
+ * of kernel virtual memory set aside for stacks.  The part of
+ * each slot below the stack is never mapped, so a thread that
+ * overflows its stack faults at once, on its first access past
+ * the end, instead of quietly corrupting whatever lies below.
+ *
+ * The fault cannot be handled on the stack that overflowed, so
+ * each CPU has a task-state segment whose interrupt stack table
+ * gives the double fault handler a stack of its own. */
+
+/* Start of the kernel stack region.  It shares the kernel's
+   top-level page table entry, so every address space sees it. */
+#define KSTACK_BASE 0xc000000000ULL
+
+#define KSTACK_SLOT_PAGES 16  /* Pages of address space per stack. */
+#define KSTACK_SLOT_CNT 4096  /* Number of stack slots. */
+#define KSTACK_PAGES_MAX (KSTACK_SLOT_PAGES - 1)
+
+/* Selector of CPU ID's TSS.  64-bit TSS descriptors take two GDT
+   entries each; the BSP's is at SEL_TSS, as before. */
+#define SEL_CPU_TSS(ID) (SEL_TSS + 0x10 * (ID))
+
+/* Number of entries a GDT needs to hold every CPU's TSS. */
+#define GDT_ENTRY_CNT (SEL_CPU_TSS(CPU_MAX) / 8)
+
+/* Pages in each thread's kernel stack.  Controlled by kernel
+   command-line option "-kstack=PAGES". */
+extern int kstack_pages;
+
+void kstack_init(void);
+void kstack_cpu_init(void);
+uintptr_t kstack_alloc(void);
+void kstack_free(uintptr_t top);
+void kstack_check_fault(struct intr_frame*, uint64_t addr);
+
+#endif /* threads/kstack.h */
@@ -4,7 +4,20 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Maximum number of block sizes. */
+#define MALLOC_CLASS_MAX 16
+
+/* A thread's magazines for one block size: blocks it freed,
+   which it can allocate again without taking a lock. */
+struct magazine;
+struct malloc_mags {
+	struct magazine *loaded;    /* Magazine in use, or null. */
+	struct magazine *prev;      /* Magazine used before, or null. */
+};
+
 void malloc_init (void);
+void malloc_drain (void);
+void malloc_print_stats (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
@@ -0,0 +1,83 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Multiprocessor support.
+ *
+ * CPUs are discovered from the Intel MultiProcessor tables that
+ * the BIOS leaves in low memory.  Each CPU has a `struct cpu'
+ * whose address is kept in the CPU's %gs base, so this_cpu() is
+ * a single load.  The kernel's %gs base is swapped in with
+ * `swapgs' on every entry from user mode and swapped out again
+ * on the way back. */
+
+/* Maximum number of CPUs supported. */
+#define CPU_MAX 16
+
+/* Interrupt vectors raised by local APICs. */
+#define IPI_RESCHEDULE 0xf0 /* Ask a CPU to reschedule. */
+#define IPI_TLB_SHOOTDOWN 0xf1 /* Ask a CPU to flush its TLB. */
+#define LAPIC_TIMER 0xf2 /* Local APIC timer. */
+#define LAPIC_SPURIOUS 0xff /* Local APIC spurious interrupt. */
+
+/* Per-CPU data. */
+struct task_state;
+
+struct cpu {
+    struct cpu* self;      /* Points to itself: read as %gs:0. */
+
+    /* Used by syscall-entry.S, which finds them at fixed offsets
+       from %gs. */
+    struct task_state* tss;      /* %gs:8: this CPU's TSS. */
+    uint64_t syscall_scratch[2]; /* %gs:16, %gs:24: saved %rbx, %r12. */
+
+    int id;                /* Index into cpus[]. */
+    uint8_t apic_id;       /* Local APIC ID. */
+    volatile bool started; /* Has the CPU finished booting? */
+
+    struct thread* idle_thread; /* Runs when nothing else is ready. */
+
+    /* Owned by thread.c. */
+    struct thread* thread; /* Running thread. */
+    bool preempt_pending;  /* Preempt at the next intr_enable()? */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr; /* Processing an external interrupt? */
+    bool yield_on_return;  /* Yield on interrupt return? */
+
+    /* Owned by fpu.c. */
+    struct thread* fpu_owner; /* Whose state is in the FPU registers. */
+};
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;        /* # of CPUs found. */
+extern int cpu_online_cnt; /* # of CPUs running. */
+
+/* Returns the running CPU's `struct cpu'. */
+static inline struct cpu* this_cpu(void) {
+    struct cpu* c;
+    asm volatile("movq %%gs:0, %0" : "=r"(c));
+    return c;
+}
+
+/* Returns the thread running on this CPU.  Unlike
+   this_cpu()->thread, this is a single %gs-relative load, so it
+   is right even if the caller is preempted and moved to another
+   CPU around it. */
+static inline struct thread* this_cpu_thread(void) {
+    struct thread* t;
+    asm volatile("movq %%gs:%c1, %0" : "=r"(t) : "i"(offsetof(struct cpu, thread)));
+    return t;
+}
+
+void mp_bsp_init(void);
+void mp_init(void);
+void mp_start_aps(void);
+void mp_send_reschedule(struct cpu*);
+void mp_tlb_shootdown(void);
+void mp_print_stats(void);
+
+#endif /* threads/mp.h */
@@ -0,0 +1,35 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches.
+ *
+ * A cache hands out objects of a single size, packed into
+ * one-page slabs with only a small header and an index per
+ * object, so that objects malloc() would round up to the next
+ * power of two waste nothing but a slab's tail.  Each cache has
+ * its own lock.  Successive slabs start their objects at
+ * different offsets ("colours") within the page, so that the
+ * same field of objects in different slabs does not always land
+ * in the same CPU cache set.
+ *
+ * Objects must fit in a page with the slab header; larger ones
+ * belong in malloc(). */
+
+struct kmem_cache;
+
+/* Constructor, called on each object once, when its slab is
+   created.  Objects should be back in the constructed state
+   when freed. */
+typedef void kmem_ctor_func(void* obj);
+
+void kmem_init(void);
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align,
+                                     kmem_ctor_func*);
+void* kmem_cache_alloc(struct kmem_cache*);
+void* kmem_cache_zalloc(struct kmem_cache*);
+void kmem_cache_free(struct kmem_cache*, void* obj);
+void kmem_print_stats(void);
+
+#endif /* threads/slab.h */
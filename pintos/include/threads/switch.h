@@ -0,0 +1,33 @@
+#ifndef THREADS_SWITCH_H
+#define THREADS_SWITCH_H
+
+#include <stdint.h>
+
+/* Kernel-to-kernel context switch.
+ *
+ * A thread only ever gives up the CPU from inside schedule(), so
+ * all that has to survive the switch is what the calling
+ * convention says a callee preserves: %rbx, %rbp, %r12-%r15 and
+ * the stack pointer.  switch_threads() pushes those on the old
+ * thread's stack, saves %rsp, loads the new thread's saved %rsp,
+ * pops and returns into the new thread.  User-mode state needs no
+ * help: it was saved in an intr_frame on the kernel stack when the
+ * thread entered the kernel. */
+
+/* What switch_threads() leaves on a stack, lowest address first. */
+struct switch_frame {
+    uint64_t r15;
+    uint64_t r14;
+    uint64_t r13;
+    uint64_t r12;
+    uint64_t rbp;
+    uint64_t rbx;
+    void (*rip)(void); /* Return address. */
+};
+
+/* Saves the running thread's context on its stack and its stack
+   pointer in *PREV_SP, then resumes the thread whose context is
+   on the stack at NEXT_SP. */
+void switch_threads(uint64_t* prev_sp, uint64_t next_sp);
+
+#endif /* threads/switch.h */
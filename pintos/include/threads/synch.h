@@ -2,31 +2,102 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Spin lock, for data shared between CPUs.  The holder busy-waits
+   instead of blocking, so a spin lock may be taken in an interrupt
+   handler, but it must only be held with interrupts off and only
+   for a short time. */
+struct spinlock {
+	volatile int locked;        /* Nonzero while held. */
+	struct cpu *cpu;            /* CPU holding lock (for debugging). */
+};
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
 
 /* A counting semaphore. */
 struct semaphore {
+	struct spinlock lock;       /* Protects the rest, except in a lock's
+	                               semaphore, which synch.c's donation
+	                               lock protects. */
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct rb_tree waiters;     /* Waiting threads, highest priority first. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
+bool sema_down_interruptible (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* A thread's hold on a lock or reader-writer lock, through which
+   the threads waiting for it donate their priority. */
+struct lock_hold {
+	struct rb_node node;        /* Element of holder's held_locks. */
+	struct rb_tree *waiters[2]; /* Donating waiters; second may be null. */
+};
+
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct lock_hold hold;      /* Holder's hold. */
 };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_donation_init (struct thread *);
+void lock_donation_refresh (struct thread *);
+void lock_donation_set_priority (struct thread *, int priority);
+
+/* Maximum number of reader-writer locks a thread may hold for
+   reading at once. */
+#define RWLOCK_READ_MAX 4
+
+/* One thread's read hold on a reader-writer lock. */
+struct rwlock_reader {
+	struct rwlock *rwlock;      /* Lock held, or null if slot is free. */
+	struct thread *thread;      /* Holding thread. */
+	struct list_elem elem;      /* Element of rwlock's readers. */
+	struct lock_hold hold;      /* Reader's hold. */
+};
+
+/* Reader-writer lock.  Any number of readers or a single writer
+   may hold it.  Waiting writers go before new readers. */
+struct rwlock {
+	struct thread *writer;      /* Thread holding for writing, or null. */
+	struct lock_hold write_hold; /* Writer's hold. */
+	struct list readers;        /* Read holds, as struct rwlock_reader. */
+	struct rb_tree read_waiters;  /* Threads waiting to read. */
+	struct rb_tree write_waiters; /* Threads waiting to write. */
+	struct thread *upgrader;    /* Reader waiting to upgrade, or null. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+bool rwlock_write_held_by_current_thread (const struct rwlock *);
 
 /* Condition variable. */
 struct condition {
@@ -35,6 +106,7 @@ struct condition {
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
@@ -3,11 +3,14 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
+#include <sched-stats.h>
 #include <stdint.h>
 
 #include "synch.h"
 #include "threads/fixed-point.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -17,7 +20,8 @@ enum thread_status {
     THREAD_RUNNING, /* Running thread. */
     THREAD_READY,   /* Not running but ready to run. */
     THREAD_BLOCKED, /* Waiting for an event to trigger. */
-    THREAD_DYING    /* About to be destroyed. */
+    THREAD_DYING,   /* About to be destroyed. */
+    THREAD_WAKING   /* Being made ready by another CPU. */
 };
 
 /* Thread identifier type.
@@ -30,57 +34,41 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread niceness. */
+#define NICE_MIN -20 /* Least nice: largest CPU share. */
+#define NICE_MAX 20  /* Nicest: smallest CPU share. */
+
 /* A kernel thread or user process.
  *
  * Each thread structure is stored in its own 4 kB page.  The
- * thread structure itself sits at the very bottom of the page
- * (at offset 0).  The rest of the page is reserved for the
- * thread's kernel stack, which grows downward from the top of
- * the page (at offset 4 kB).  Here's an illustration:
- *
- *      4 kB +---------------------------------+
- *           |          kernel stack           |
- *           |                |                |
- *           |                |                |
- *           |                V                |
- *           |         grows downward          |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           |                                 |
- *           +---------------------------------+
- *           |              magic              |
- *           |            intr_frame           |
- *           |                :                |
- *           |                :                |
- *           |               name              |
- *           |              status             |
- *      0 kB +---------------------------------+
- *
- * The upshot of this is twofold:
+ * thread's kernel stack is separate: kstack_pages pages (see
+ * threads/kstack.h), mapped at the top of a slot of kernel
+ * virtual memory whose lower part is left unmapped.  Here's an
+ * illustration of a slot:
  *
- *    1. First, `struct thread' must not be allowed to grow too
- *       big.  If it does, then there will not be enough room for
- *       the kernel stack.  Our base `struct thread' is only a
- *       few bytes in size.  It probably should stay well under 1
- *       kB.
+ *   kstack_top +---------------------------------+
+ *              |          kernel stack           |
+ *              |                |                |
+ *              |                V                |
+ *              |         grows downward          |
+ *              |                                 |
+ *              +---------------------------------+
+ *              |                                 |
+ *              |      guard (never mapped)       |
+ *              |                                 |
+ *              +---------------------------------+
  *
- *    2. Second, kernel stacks must not be allowed to grow too
- *       large.  If a stack overflows, it will corrupt the thread
- *       state.  Thus, kernel functions should not allocate large
- *       structures or arrays as non-static local variables.  Use
- *       dynamic allocation with malloc() or palloc_get_page()
- *       instead.
+ * A thread that overflows its stack faults on the guard right
+ * away, and the kernel panics naming the thread.  Still, kernel
+ * stacks are small, so kernel functions should not allocate large
+ * structures or arrays as non-static local variables.  Use
+ * dynamic allocation with malloc() or palloc_get_page() instead.
  *
- * The first symptom of either of these problems will probably be
- * an assertion failure in thread_current(), which checks that
- * the `magic' member of the running thread's `struct thread' is
- * set to THREAD_MAGIC.  Stack overflow will normally change this
- * value, triggering the assertion. */
+ * The initial thread is the exception: it keeps running on the
+ * page loader.S set up, with its `struct thread' at the bottom,
+ * so an overflow there corrupts the thread and will probably
+ * show up as an assertion failure in thread_current(), which
+ * checks that the `magic' member is set to THREAD_MAGIC. */
 /* The `elem' member has a dual purpose.  It can be an element in
  * the run queue (thread.c), or it can be an element in a
  * semaphore wait list (synch.c).  It can be used these two ways
@@ -93,39 +81,104 @@ struct thread {
     enum thread_status status; /* Thread state. */
     char name[16];             /* Name (for debugging purposes). */
     int priority;              /* Priority. */
+    int cpu;                   /* CPU whose run queue holds it, or last ran on. */
+    bool on_cpu;               /* Still running, or not yet switched away from? */
+    int queued_priority;       /* Priority its run queue entry is keyed on. */
 
-    int base_priority;
-    struct lock* waiting_lock;
-    struct list donor_list;
-    struct list_elem donor_elem;
+    /* Priority donation, maintained by synch.c. */
+    int base_priority;                /* Priority before donation. */
+    struct lock* waiting_lock;        /* Lock being acquired, if any. */
+    struct rwlock* waiting_rwlock;    /* Reader-writer lock being acquired. */
+    struct rb_tree* waiting_in;       /* Waiters tree blocked in, if any. */
+    struct rb_node waiter_node;       /* Element of waiting_in. */
+    int waiter_priority;              /* Priority waiter_node is keyed on. */
+    struct spinlock* waiting_spin;    /* Spin lock protecting waiting_in. */
+    struct spinlock wait_lock;        /* Protects the three above. */
+    struct rb_tree held_locks;        /* Lock holds, by donated priority. */
+    struct rwlock_reader read_holds[RWLOCK_READ_MAX]; /* Read holds. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem; /* List element. */
     struct list_elem allelem;
+    struct list_elem sleep_elem; /* Sleep timing wheel element. */
     int64_t wakeup_tick;
+    bool timed_wait; /* On the wheel for a timed wait? */
+    bool timed_out;  /* Did the last timed wait time out? */
+    bool interruptible; /* In a wait thread_interrupt() ends?  See wait_lock. */
+    bool interrupted;   /* Has thread_interrupt() been called on it? */
 
     int nice;
     fixed_t recent_cpu;
+    int64_t recent_cpu_epoch; /* Last MLFQS decay applied to recent_cpu. */
+    struct list_elem mlfqs_elem; /* MLFQS: element of the refresh list. */
+
+    int64_t sum_exec;        /* Total run time, in ns. */
+    int64_t exec_start;      /* timer_ns() when last charged for it. */
+    int64_t slice_start;     /* sum_exec when last scheduled. */
+    int64_t vruntime;        /* CFS: weighted run time, in ns. */
+    struct rb_node cfs_node; /* CFS: run queue tree element. */
+
+    int64_t dl_runtime;      /* EDF: budget per period in ns, or 0 if not EDF. */
+    int64_t dl_deadline;     /* EDF: deadline, relative to period start. */
+    int64_t dl_period;       /* EDF: period. */
+    int64_t dl_abs_deadline; /* EDF: current job's deadline, as timer_ns(). */
+    int64_t dl_budget;       /* EDF: run time left before it. */
+    bool dl_throttled;       /* EDF: out of budget until its next period? */
+    int dl_saved_priority;   /* EDF: base_priority outside the class. */
+    struct rb_node dl_node;  /* EDF: run queue tree element. */
+
+    struct sched_stats stats; /* Run/wait accounting. */
+    uint64_t state_tsc;       /* TSC when it last became RUNNING or READY. */
+    uint64_t wakeup_tsc;      /* TSC of the pending wakeup, or 0. */
+    bool preempted;           /* Being switched out involuntarily. */
+    bool worker;              /* Kernel worker thread, ahead of all others. */
+
+    /* Owned by threads/fpu.c. */
+    void* fpu_state; /* Saved FPU/SSE/AVX state, or NULL if never used. */
+
+    /* Owned by threads/malloc.c. */
+    struct malloc_mags mags[MALLOC_CLASS_MAX]; /* Freed blocks of each size. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint64_t* pml4; /* Page map level 4 */
 
+    /* A process is its leader, the thread it started in.  The rest
+       of this block belongs to the process: only the leader's copy
+       is used, and the process's other threads reach it through
+       LEADER. */
+    struct thread* leader;   /* Thread owning the process; may be itself. */
+    struct uthread* uthread; /* Join record, or NULL for a leader. */
+    uintptr_t stack_top;     /* Top of this thread's user stack slot. */
+    bool exit_thread_only;   /* Leaving through SYS_THREAD_EXIT? */
+
+    struct spinlock process_lock; /* Protects child_list, thread_cnt,
+                                     uthreads, stack_slots, exiting,
+                                     and the children's wait flags. */
     struct list child_list;
     struct child_info* my_entry;
 
     struct list fdt_block_list;
 
     struct file* current_file;
+
+    int thread_cnt;                  /* Live threads, the leader included. */
+    struct list uthreads;            /* Other threads' join records. */
+    struct semaphore uthread_exited; /* Upped as each other thread exits. */
+    uint32_t stack_slots;            /* User stack slots in use. */
+    bool exiting;                    /* Exiting: kill every thread. */
 #endif
 #ifdef VM
-    /* Table for whole virtual memory owned by thread. */
+    /* Table for whole virtual memory owned by thread.  Only the
+       leader's is used. */
     struct supplemental_page_table spt;
     uintptr_t rsp;
 #endif
 
     /* Owned by thread.c. */
-    struct intr_frame tf; /* Information for switching */
+    struct intr_frame tf; /* Registers for the first launch. */
+    uint64_t ksp;         /* Saved stack pointer while switched out. */
+    uintptr_t kstack_top; /* Top of kernel stack. */
     unsigned magic;       /* Detects stack overflow. */
 };
 
@@ -137,21 +190,43 @@ struct child_info {
     struct semaphore wait_sema;
 };
 
+/* Cache of struct child_info, made by thread_start(). */
+extern struct kmem_cache* child_info_cache;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler, which runs the ready
+   thread with the least weighted virtual run time.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* Fair-share scheduler's minimum granularity in nanoseconds: the
+   shortest time a thread runs before a tick may preempt it.
+   Controlled by kernel command-line option "-cfs-gran=US". */
+extern int64_t thread_cfs_granularity;
+
+/* If true, switch threads by saving a full intr_frame and
+   returning through iretq, as Pintos originally did, instead of
+   through switch_threads().  Only useful for comparing the two.
+   Controlled by kernel command-line option "-iret-switch". */
+extern bool thread_iret_switch;
+
 void thread_init(void);
 void thread_start(void);
 
 void thread_tick(void);
 void thread_print_stats(void);
+void thread_print_sched_stats(void);
+void thread_get_sched_stats(struct thread*, struct sched_stats*);
 
 typedef void thread_func(void* aux);
 tid_t thread_create(const char* name, int priority, thread_func*, void*);
 
 void thread_block(void);
+void thread_block_locked(struct spinlock*);
 void thread_unblock(struct thread*);
 
 struct thread* thread_current(void);
@@ -160,12 +235,29 @@ const char* thread_name(void);
 
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_preempt(void);
+void thread_yield_to_higher(void);
+
+struct cpu;
+struct thread* thread_create_ap_idle(struct cpu*);
+void thread_ap_idle(void) NO_RETURN;
 
 void thread_sleep(int64_t wakeup_tick);
+bool thread_block_timeout(int64_t wakeup_tick, struct spinlock*);
+void thread_set_interruptible(bool);
+void thread_interrupt(struct thread*);
 void wake_sleeping_threads(int64_t tick);
+bool thread_wakeup_tick(int64_t tick);
+int64_t thread_next_wakeup(void);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_change_priority(struct thread*, int priority);
+
+bool thread_set_deadline(int64_t runtime, int64_t deadline, int64_t period);
+void thread_deadline_yield(void);
+int64_t thread_get_deadline(void);
+
 int thread_get_nice(void);
 void thread_set_nice(int);
 int thread_get_recent_cpu(void);
@@ -173,6 +265,4 @@ int thread_get_load_avg(void);
 
 void do_iret(struct intr_frame* tf);
 
-bool thread_priority_max(const struct list_elem* e1, const struct list_elem* e2, void* aux);
-
 #endif /* threads/thread.h */
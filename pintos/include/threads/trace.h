@@ -0,0 +1,66 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Event tracing.
+ *
+ * With "-trace", tracepoints throughout the kernel record
+ * compact binary events, stamped with the TSC, in a ring buffer
+ * per CPU.  Recording takes no locks and prints nothing, so it
+ * hardly disturbs the timing it measures.  The "tracedump" action
+ * prints the rings to the console and "tracesave FILE" writes
+ * them to a file, for utils/trace2json to turn into a timeline
+ * that chrome://tracing or Perfetto can show. */
+
+/* Event types.  The meaning of ARG0 and ARG1 is given for each. */
+enum trace_type {
+    TRACE_THREAD_NAME = 1, /* New thread: its name, 16 bytes. */
+    TRACE_SWITCH,          /* Context switch: next tid, old thread's status. */
+    TRACE_BLOCK,           /* Running thread blocks. */
+    TRACE_UNBLOCK,         /* Thread made ready: its tid. */
+    TRACE_LOCK_WAIT,       /* Blocking to acquire lock: lock address. */
+    TRACE_LOCK_ACQUIRE,    /* Acquired lock: lock address, 1 if it waited. */
+    TRACE_LOCK_RELEASE,    /* Released lock: lock address. */
+    TRACE_INTR_ENTER,      /* Interrupt handler entered: vector. */
+    TRACE_INTR_EXIT,       /* Interrupt handler done: vector. */
+    TRACE_PAGE_FAULT,      /* Page fault: address, error code. */
+    TRACE_PAGE_FAULT_DONE, /* Page fault handled: address, 1 if resolved. */
+    TRACE_DISK_READ,       /* Disk read started: sector, disk. */
+    TRACE_DISK_READ_DONE,  /* Disk read finished: sector, disk. */
+    TRACE_DISK_WRITE,      /* Disk write started: sector, disk. */
+    TRACE_DISK_WRITE_DONE, /* Disk write finished: sector, disk. */
+    TRACE_LOCK_TIMEOUT,    /* Gave up waiting for lock: lock address. */
+};
+
+/* One recorded event, 32 bytes.  The dump holds these as is. */
+struct trace_event {
+    uint64_t tsc;  /* Time stamp counter when recorded. */
+    uint64_t arg0; /* Type-specific. */
+    uint64_t arg1; /* Type-specific. */
+    int32_t tid;   /* Running thread. */
+    uint16_t type; /* An enum trace_type. */
+    uint16_t cpu;  /* Recording CPU. */
+};
+
+/* If true, record events.  Controlled by kernel command-line
+   option "-trace". */
+extern bool trace_enabled;
+
+/* Records an event of TYPE, if tracing. */
+#define TRACE(TYPE, ARG0, ARG1)                                                   \
+    do {                                                                          \
+        if (trace_enabled)                                                        \
+            trace_record((TYPE), (uint64_t)(ARG0), (uint64_t)(ARG1));             \
+    } while (0)
+
+void trace_init(void);
+void trace_record(enum trace_type, uint64_t arg0, uint64_t arg1);
+void trace_thread_name(int32_t tid, const char* name);
+void trace_dump(void);
+#ifdef FILESYS
+void trace_save(const char* file_name);
+#endif
+
+#endif /* threads/trace.h */
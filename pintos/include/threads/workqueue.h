@@ -0,0 +1,48 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Deferred work.
+ *
+ * An interrupt handler runs with interrupts off, so whatever it
+ * does holds up every other interrupt.  Work that need not be
+ * finished inside the handler can be queued instead, from
+ * interrupt context or not, and a kernel worker thread runs it
+ * soon after with interrupts on.  Worker threads run ahead of
+ * every other thread (see thread.c), so queued work starts as
+ * soon as the interrupt returns.  Delayed work is held back for
+ * a number of timer ticks first. */
+
+typedef void work_func(void* aux);
+
+/* A unit of deferred work, usually embedded in the structure it
+   works on.  It may be queued again as soon as it starts to run,
+   but queueing it while it is still queued does nothing. */
+struct work {
+    work_func* func;       /* Function to run. */
+    void* aux;             /* Its argument. */
+    struct list_elem elem; /* Pending or delayed list element. */
+    int64_t due;           /* Delayed: timer tick it is due at. */
+    uint64_t queued_tsc;   /* TSC when it became pending. */
+    bool queued;           /* Pending or delayed? */
+};
+
+void workqueue_init(void);
+void workqueue_start(void);
+
+void work_init(struct work*, work_func*, void* aux);
+bool schedule_work(struct work*);
+bool schedule_delayed_work(struct work*, int64_t ticks);
+bool cancel_work(struct work*);
+
+bool queue_work(work_func*, void* aux);
+bool queue_delayed_work(work_func*, void* aux, int64_t ticks);
+
+void workqueue_tick(int64_t now);
+int64_t workqueue_next_due(void);
+void workqueue_print_stats(void);
+
+#endif /* threads/workqueue.h */
@@ -5,6 +5,7 @@
 # include "filesys/file.h"
 # include "filesys/filesys.h"
 # include "threads/malloc.h"
+# include "threads/slab.h"
 # include "threads/thread.h"
 
 # define FD_BLOCK_MAX   128
@@ -36,7 +37,9 @@ void	            init_std_fds(void);
 /*  used in threads/thread.c -> thread_create()  */
 void                fdt_list_init(struct thread* t);
 
-/*  fdt_block interface functions  */
+/*  fdt_block interface functions
+    - t : 프로세스의 리더 쓰레드 (thread->leader)
+    - 한 프로세스의 쓰레드들이 공유하므로 file_lock을 잡은 채로 호출  */
 int                 fd_allocate(struct thread* t, struct file* f);
 struct fdt_block    *get_fd_block(struct thread *t, int *fd);
 struct file*        get_fd_entry(struct thread* t, int fd);
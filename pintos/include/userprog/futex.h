@@ -0,0 +1,11 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+struct thread;
+
+void futex_init(void);
+int futex_wait(int* uaddr, int expected);
+int futex_wake(int* uaddr, int count);
+void futex_wake_process(struct thread* leader);
+
+#endif /* userprog/futex.h */
@@ -3,11 +3,21 @@
 
 #include "threads/thread.h"
 
+/* User stacks sit in slots of this size below USER_STACK, the
+   process's first thread using slot 0 and each other thread its
+   own.  Under VM a stack grows to fill its slot, which is why this
+   equals USER_STACK_MAX_SIZE. */
+#define USER_STACK_SLOT_SIZE (1 << 20)
+#define USER_THREAD_MAX 32 /* Slots, so threads per process. */
+
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
+tid_t process_thread_create (void *entry, void *arg1, void *arg2);
+int process_thread_join (tid_t);
+void process_check_exiting (void);
 
 #endif /* userprog/process.h */
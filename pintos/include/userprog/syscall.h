@@ -6,5 +6,6 @@
 extern struct lock file_lock;
 
 void syscall_init(void);
+void syscall_cpu_init(void);
 
 #endif /* userprog/syscall.h */
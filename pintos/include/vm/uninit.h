@@ -2,6 +2,7 @@
 #define VM_UNINIT_H
 #include <stdbool.h>
 #include "filesys/off_t.h"
+#include "threads/slab.h"
 
 struct page;
 struct supplemental_page_table;
@@ -60,4 +61,7 @@ void uninit_new (struct page *page, void *va, vm_initializer *init,
 
 bool uninit_copy(struct supplemental_page_table *dst, struct page *src_page);
 
+/* Cache of struct uninit_aux, made by vm_init(). */
+extern struct kmem_cache *uninit_aux_cache;
+
 #endif
@@ -2,6 +2,7 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include <hash.h>
 
 enum vm_type {
@@ -92,6 +93,7 @@ struct page_operations {
 struct supplemental_page_table {
 	/* 해시 테이블 */
 	struct hash hs_table;
+	struct lock lock;	/* Serializes the process's threads. */
 };
 
 #include "threads/thread.h"
@@ -0,0 +1,311 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The balancing follows
+   [CLRS] chapter 13 "Red-Black Trees", with null pointers in
+   place of the sentinel leaf. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rb_tree *, struct rb_node *);
+static void rotate_right (struct rb_tree *, struct rb_node *);
+static void replace_child (struct rb_tree *, struct rb_node *parent,
+		struct rb_node *old, struct rb_node *new);
+static void insert_fixup (struct rb_tree *, struct rb_node *);
+static void remove_fixup (struct rb_tree *, struct rb_node *,
+		struct rb_node *parent);
+
+/* Returns true if node N is red.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_node *n) {
+	return n != NULL && n->red;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux) {
+	ASSERT (tree != NULL);
+	ASSERT (less != NULL);
+
+	tree->root = NULL;
+	tree->min = NULL;
+	tree->size = 0;
+	tree->less = less;
+	tree->aux = aux;
+}
+
+/* Inserts NODE into TREE.  NODE goes after any nodes that
+   compare equal to it. */
+void
+rb_insert (struct rb_tree *tree, struct rb_node *node) {
+	struct rb_node *parent = NULL;
+	struct rb_node **link = &tree->root;
+	bool leftmost = true;
+
+	ASSERT (tree != NULL);
+	ASSERT (node != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (tree->less (node, parent, tree->aux))
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = true;
+	*link = node;
+	if (leftmost)
+		tree->min = node;
+	tree->size++;
+
+	insert_fixup (tree, node);
+}
+
+/* Removes NODE, which must be in TREE, from TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_node *node) {
+	struct rb_node *child, *parent;
+	bool removed_red;
+
+	ASSERT (tree != NULL);
+	ASSERT (node != NULL);
+	ASSERT (tree->size > 0);
+
+	if (tree->min == node)
+		tree->min = rb_next (node);
+
+	if (node->left == NULL || node->right == NULL) {
+		/* At most one child: splice NODE out. */
+		child = node->left != NULL ? node->left : node->right;
+		parent = node->parent;
+		removed_red = node->red;
+		replace_child (tree, parent, node, child);
+		if (child != NULL)
+			child->parent = parent;
+	} else {
+		/* Two children: NODE's successor, which has no left child,
+		   takes NODE's place and color, and the successor's old
+		   position is what loses a node. */
+		struct rb_node *next = node->right;
+		while (next->left != NULL)
+			next = next->left;
+
+		child = next->right;
+		removed_red = next->red;
+		if (next->parent == node)
+			parent = next;
+		else {
+			parent = next->parent;
+			parent->left = child;
+			if (child != NULL)
+				child->parent = parent;
+			next->right = node->right;
+			next->right->parent = next;
+		}
+		next->left = node->left;
+		next->left->parent = next;
+		next->red = node->red;
+		replace_child (tree, node->parent, node, next);
+		next->parent = node->parent;
+	}
+	tree->size--;
+
+	if (!removed_red)
+		remove_fixup (tree, child, parent);
+}
+
+/* Returns TREE's smallest node, or a null pointer if TREE is
+   empty.  Takes constant time. */
+struct rb_node *
+rb_min (const struct rb_tree *tree) {
+	return tree->min;
+}
+
+/* Returns the node following NODE in its tree, or a null pointer
+   if NODE is the largest. */
+struct rb_node *
+rb_next (const struct rb_node *node) {
+	const struct rb_node *parent;
+
+	if (node->right != NULL) {
+		node = node->right;
+		while (node->left != NULL)
+			node = node->left;
+		return (struct rb_node *) node;
+	}
+
+	for (parent = node->parent; parent != NULL && node == parent->right;
+			parent = parent->parent)
+		node = parent;
+	return (struct rb_node *) parent;
+}
+
+/* Returns the number of nodes in TREE. */
+size_t
+rb_size (const struct rb_tree *tree) {
+	return tree->size;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree) {
+	return tree->root == NULL;
+}
+
+/* Makes NEW take OLD's place as PARENT's child, or as the root
+   of TREE if PARENT is a null pointer. */
+static void
+replace_child (struct rb_tree *tree, struct rb_node *parent,
+		struct rb_node *old, struct rb_node *new) {
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates left around N, whose right child takes its place. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_node *n) {
+	struct rb_node *r = n->right;
+
+	n->right = r->left;
+	if (r->left != NULL)
+		r->left->parent = n;
+	r->parent = n->parent;
+	replace_child (tree, n->parent, n, r);
+	r->left = n;
+	n->parent = r;
+}
+
+/* Rotates right around N, whose left child takes its place. */
+static void
+rotate_right (struct rb_tree *tree, struct rb_node *n) {
+	struct rb_node *l = n->left;
+
+	n->left = l->right;
+	if (l->right != NULL)
+		l->right->parent = n;
+	l->parent = n->parent;
+	replace_child (tree, n->parent, n, l);
+	l->right = n;
+	n->parent = l;
+}
+
+/* Restores the red-black properties after inserting red node
+   N. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_node *n) {
+	while (is_red (n->parent)) {
+		struct rb_node *parent = n->parent;
+		struct rb_node *grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			struct rb_node *uncle = grandparent->right;
+
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				n = grandparent;
+				continue;
+			}
+			if (n == parent->right) {
+				rotate_left (tree, parent);
+				n = parent;
+				parent = n->parent;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_right (tree, grandparent);
+		} else {
+			struct rb_node *uncle = grandparent->left;
+
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				n = grandparent;
+				continue;
+			}
+			if (n == parent->left) {
+				rotate_right (tree, parent);
+				n = parent;
+				parent = n->parent;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_left (tree, grandparent);
+		}
+	}
+	tree->root->red = false;
+}
+
+/* Restores the red-black properties after a black node was
+   removed from below PARENT, leaving N, which may be a null
+   pointer, one black node short. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_node *n,
+		struct rb_node *parent) {
+	while (n != tree->root && !is_red (n)) {
+		if (n == parent->left) {
+			struct rb_node *sibling = parent->right;
+
+			if (is_red (sibling)) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_left (tree, parent);
+				sibling = parent->right;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				sibling->red = true;
+				n = parent;
+				parent = n->parent;
+				continue;
+			}
+			if (!is_red (sibling->right)) {
+				sibling->left->red = false;
+				sibling->red = true;
+				rotate_right (tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->red = parent->red;
+			parent->red = false;
+			sibling->right->red = false;
+			rotate_left (tree, parent);
+		} else {
+			struct rb_node *sibling = parent->left;
+
+			if (is_red (sibling)) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_right (tree, parent);
+				sibling = parent->left;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				sibling->red = true;
+				n = parent;
+				parent = n->parent;
+				continue;
+			}
+			if (!is_red (sibling->left)) {
+				sibling->right->red = false;
+				sibling->red = true;
+				rotate_left (tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->red = parent->red;
+			parent->red = false;
+			sibling->left->red = false;
+			rotate_right (tree, parent);
+		}
+		n = tree->root;
+	}
+	if (n != NULL)
+		n->red = false;
+}
@@ -194,3 +194,42 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+void
+schedstat (struct sched_stats *stats) {
+	syscall1 (SYS_SCHEDSTAT, stats);
+}
+
+int
+futex_wait (int *uaddr, int expected) {
+	return syscall2 (SYS_FUTEX_WAIT, uaddr, expected);
+}
+
+int
+futex_wake (int *uaddr, int count) {
+	return syscall2 (SYS_FUTEX_WAKE, uaddr, count);
+}
+
+/* Where a new thread starts, with FUNC and AUX as passed to
+   uthread_create().  Returning from FUNC exits the thread. */
+static void
+uthread_start (uthread_func *func, void *aux) {
+	func (aux);
+	uthread_exit ();
+}
+
+int
+uthread_create (uthread_func *func, void *aux) {
+	return syscall3 (SYS_THREAD_CREATE, uthread_start, func, aux);
+}
+
+int
+uthread_join (int tid) {
+	return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+void
+uthread_exit (void) {
+	syscall0 (SYS_THREAD_EXIT);
+	NOT_REACHED ();
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cfs-fair-2) begin
+(cfs-fair-2) Starting 2 threads...
+(cfs-fair-2) Letting threads run for 10 seconds, please wait...
+(cfs-fair-2) Thread 0 got its fair share.
+(cfs-fair-2) Thread 1 got its fair share.
+(cfs-fair-2) end
+EOF
+pass;
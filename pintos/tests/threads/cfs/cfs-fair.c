@@ -0,0 +1,121 @@
+/* Checks that the fair-share scheduler divides the CPU among
+   busy threads in proportion to their weights.
+
+   The cfs-fair-2 test runs 2 threads, both with nice 0, which
+   should get the same CPU time.
+
+   The cfs-nice-3 test runs 3 threads with nice 0, 5 and 10,
+   whose weights of 1024, 335 and 110 entitle them to about 70%,
+   23% and 7% of the CPU, respectively.
+
+   CPU time is measured in TSC cycles with the scheduler's own
+   accounting, and each thread must come within 5% of the total
+   of its share. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static void test_cfs_fair (int thread_cnt, int nice_step);
+
+void
+test_cfs_fair_2 (void)
+{
+  test_cfs_fair (2, 0);
+}
+
+void
+test_cfs_nice_3 (void)
+{
+  test_cfs_fair (3, 5);
+}
+
+#define MAX_THREAD_CNT 3
+
+/* Fair-share weights of nice 0, 5 and 10. */
+static const int weights[] = {1024, 335, 110};
+
+struct thread_info
+  {
+    int64_t start_time;
+    int nice;
+    uint64_t run_cycles;
+    struct semaphore *done;
+  };
+
+static void load_thread (void *aux);
+
+static void
+test_cfs_fair (int thread_cnt, int nice_step)
+{
+  struct thread_info info[MAX_THREAD_CNT];
+  struct semaphore done;
+  uint64_t total = 0, weight_total = 0;
+  int64_t start_time;
+  int i;
+
+  ASSERT (thread_cfs);
+  ASSERT (thread_cnt <= MAX_THREAD_CNT);
+
+  sema_init (&done, 0);
+  start_time = timer_ticks ();
+  msg ("Starting %d threads...", thread_cnt);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      struct thread_info *ti = &info[i];
+      char name[16];
+
+      ti->start_time = start_time;
+      ti->nice = i * nice_step;
+      ti->run_cycles = 0;
+      ti->done = &done;
+
+      snprintf (name, sizeof name, "load %d", i);
+      thread_create (name, PRI_DEFAULT, load_thread, ti);
+    }
+
+  msg ("Letting threads run for 10 seconds, please wait...");
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+
+  for (i = 0; i < thread_cnt; i++)
+    {
+      total += info[i].run_cycles;
+      weight_total += weights[info[i].nice / 5];
+    }
+  for (i = 0; i < thread_cnt; i++)
+    {
+      uint64_t expected = total * weights[info[i].nice / 5] / weight_total;
+      uint64_t actual = info[i].run_cycles;
+      uint64_t diff = actual > expected ? actual - expected : expected - actual;
+
+      if (diff > total / 20)
+        fail ("thread %d (nice %d) got %"PRIu64"%% of the CPU, expected %"PRIu64"%%",
+              i, info[i].nice, actual * 100 / total, expected * 100 / total);
+      msg ("Thread %d got its fair share.", i);
+    }
+}
+
+static void
+load_thread (void *ti_)
+{
+  struct thread_info *ti = ti_;
+  int64_t sleep_time = 1 * TIMER_FREQ;
+  int64_t spin_time = sleep_time + 10 * TIMER_FREQ;
+  struct sched_stats before, after;
+
+  thread_set_nice (ti->nice);
+  timer_sleep (sleep_time - timer_elapsed (ti->start_time));
+
+  thread_get_sched_stats (thread_current (), &before);
+  while (timer_elapsed (ti->start_time) < spin_time)
+    continue;
+  thread_get_sched_stats (thread_current (), &after);
+
+  ti->run_cycles = after.run_cycles - before.run_cycles;
+  sema_up (ti->done);
+}
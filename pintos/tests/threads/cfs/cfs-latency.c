@@ -0,0 +1,94 @@
+/* Checks that the fair-share scheduler runs a thread that wakes
+   up promptly, even while the CPU is kept busy.
+
+   Four threads spin for 5 seconds.  Meanwhile a fifth thread
+   repeatedly sleeps for a single tick and notes how many ticks
+   late it gets to run.  Having slept, it is behind the spinning
+   threads in virtual run time, so it should preempt one of them
+   right away instead of waiting for all of them to use up their
+   time slices, as a round-robin scheduler would make it. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define LOAD_CNT 4
+#define SLEEP_CNT 100
+
+/* Ticks late the sleeper may run, allowing for a wakeup that
+   lands just before a tick. */
+#define MAX_LATENESS 1
+
+struct test_info
+  {
+    int64_t start_time;
+    int64_t max_lateness;
+    struct semaphore done;
+  };
+
+static void load_thread (void *aux);
+static void sleep_thread (void *aux);
+
+void
+test_cfs_latency (void)
+{
+  struct test_info info;
+  int i;
+
+  ASSERT (thread_cfs);
+
+  info.start_time = timer_ticks ();
+  info.max_lateness = 0;
+  sema_init (&info.done, 0);
+
+  msg ("Starting %d spinning threads and 1 sleeping thread...", LOAD_CNT);
+  for (i = 0; i < LOAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "load %d", i);
+      thread_create (name, PRI_DEFAULT, load_thread, &info);
+    }
+  thread_create ("sleeper", PRI_DEFAULT, sleep_thread, &info);
+
+  for (i = 0; i < LOAD_CNT + 1; i++)
+    sema_down (&info.done);
+
+  if (info.max_lateness > MAX_LATENESS)
+    fail ("sleeper ran up to %"PRId64" ticks late", info.max_lateness);
+  msg ("Sleeper always ran within %d tick of waking up.", MAX_LATENESS);
+}
+
+static void
+load_thread (void *info_)
+{
+  struct test_info *info = info_;
+
+  while (timer_elapsed (info->start_time) < 5 * TIMER_FREQ)
+    continue;
+  sema_up (&info->done);
+}
+
+static void
+sleep_thread (void *info_)
+{
+  struct test_info *info = info_;
+  int i;
+
+  /* Let the spinning threads get going first. */
+  timer_sleep (TIMER_FREQ / 2);
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      int64_t wakeup = timer_ticks () + 1;
+      int64_t lateness;
+
+      timer_sleep (1);
+      lateness = timer_ticks () - wakeup;
+      if (lateness > info->max_lateness)
+        info->max_lateness = lateness;
+    }
+  sema_up (&info->done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cfs-latency) begin
+(cfs-latency) Starting 4 spinning threads and 1 sleeping thread...
+(cfs-latency) Sleeper always ran within 1 tick of waking up.
+(cfs-latency) end
+EOF
+pass;
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cfs-nice-3) begin
+(cfs-nice-3) Starting 3 threads...
+(cfs-nice-3) Letting threads run for 10 seconds, please wait...
+(cfs-nice-3) Thread 0 got its fair share.
+(cfs-nice-3) Thread 1 got its fair share.
+(cfs-nice-3) Thread 2 got its fair share.
+(cfs-nice-3) end
+EOF
+pass;
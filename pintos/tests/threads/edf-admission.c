@@ -0,0 +1,57 @@
+/* Checks admission control for EDF threads: a thread is admitted
+   only while the bandwidth, runtime / period, of all EDF threads
+   on the CPU stays under 95%, and leaving the class gives the
+   bandwidth back. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MSEC (NSEC_PER_SEC / 1000)
+
+static void check (const char *what, bool expected, bool admitted);
+
+void
+test_edf_admission (void)
+{
+  int priority = thread_get_priority ();
+
+  check ("runtime greater than deadline", false,
+         thread_set_deadline (20 * MSEC, 10 * MSEC, 100 * MSEC));
+  check ("deadline greater than period", false,
+         thread_set_deadline (10 * MSEC, 200 * MSEC, 100 * MSEC));
+  check ("negative runtime", false,
+         thread_set_deadline (-10 * MSEC, 100 * MSEC, 100 * MSEC));
+  check ("period over a second", false,
+         thread_set_deadline (10 * MSEC, 100 * MSEC, 2 * NSEC_PER_SEC));
+
+  check ("60% bandwidth", true,
+         thread_set_deadline (60 * MSEC, 100 * MSEC, 100 * MSEC));
+  if (thread_get_priority () != PRI_MAX)
+    fail ("EDF thread has priority %d, not PRI_MAX", thread_get_priority ());
+
+  /* Changing our own parameters only counts the difference. */
+  check ("change to 90%", true,
+         thread_set_deadline (90 * MSEC, 100 * MSEC, 100 * MSEC));
+  check ("change to 100%", false,
+         thread_set_deadline (100 * MSEC, 100 * MSEC, 100 * MSEC));
+
+  check ("leaving the class", true, thread_set_deadline (0, 0, 0));
+  if (thread_get_priority () != priority)
+    fail ("priority %d not restored, still %d", priority, thread_get_priority ());
+
+  check ("95% bandwidth after leaving", true,
+         thread_set_deadline (95 * MSEC, 100 * MSEC, 100 * MSEC));
+  check ("leaving again", true, thread_set_deadline (0, 0, 0));
+}
+
+static void
+check (const char *what, bool expected, bool admitted)
+{
+  if (admitted != expected)
+    fail ("%s: %s, expected %s", what, admitted ? "admitted" : "rejected",
+          expected ? "admitted" : "rejected");
+  msg ("%s: %s.", what, admitted ? "admitted" : "rejected");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admission) begin
+(edf-admission) runtime greater than deadline: rejected.
+(edf-admission) deadline greater than period: rejected.
+(edf-admission) negative runtime: rejected.
+(edf-admission) period over a second: rejected.
+(edf-admission) 60% bandwidth: admitted.
+(edf-admission) change to 90%: admitted.
+(edf-admission) change to 100%: rejected.
+(edf-admission) leaving the class: admitted.
+(edf-admission) 95% bandwidth after leaving: admitted.
+(edf-admission) leaving again: admitted.
+(edf-admission) end
+EOF
+pass;
@@ -0,0 +1,122 @@
+/* Checks that EDF threads meet every deadline of an admissible
+   task set, even with a normal thread of the highest priority
+   competing for the CPU.
+
+   Three periodic tasks take (runtime, deadline, period) of
+   (20, 100, 100), (20, 150, 150) and (30, 200, 200) ms, 48% of
+   the CPU in all.  In each period, each does half its runtime's
+   worth of work, then waits for its next period.  Each job has
+   to be done by its deadline.  Meanwhile a PRI_MAX thread spins,
+   which would otherwise keep them all off the CPU. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MSEC (NSEC_PER_SEC / 1000)
+
+/* How long the test runs, in ticks. */
+#define TEST_TICKS (2 * TIMER_FREQ)
+
+struct task
+  {
+    const char *name;
+    int64_t runtime, deadline, period;
+    int64_t start_time;
+    int jobs;                   /* Jobs completed. */
+    int misses;                 /* Jobs completed late. */
+    struct semaphore *done;
+  };
+
+static void edf_thread (void *task_);
+static void spin_thread (void *done_);
+
+void
+test_edf_periodic (void)
+{
+  struct task tasks[] =
+    {
+      {.name = "edf 100", .runtime = 20 * MSEC,
+       .deadline = 100 * MSEC, .period = 100 * MSEC},
+      {.name = "edf 150", .runtime = 20 * MSEC,
+       .deadline = 150 * MSEC, .period = 150 * MSEC},
+      {.name = "edf 200", .runtime = 30 * MSEC,
+       .deadline = 200 * MSEC, .period = 200 * MSEC},
+    };
+  const int task_cnt = sizeof tasks / sizeof *tasks;
+  struct semaphore done;
+  int64_t start_time;
+  int i;
+
+  sema_init (&done, 0);
+  start_time = timer_ticks ();
+
+  /* The new threads must get to run, to make themselves EDF
+     threads, before the spinning thread can crowd them out. */
+  thread_set_priority (PRI_MAX);
+
+  msg ("Starting %d EDF threads...", task_cnt);
+  for (i = 0; i < task_cnt; i++)
+    {
+      tasks[i].start_time = start_time;
+      tasks[i].jobs = tasks[i].misses = 0;
+      tasks[i].done = &done;
+      thread_create (tasks[i].name, PRI_MAX, edf_thread, &tasks[i]);
+    }
+
+  msg ("Starting a spinning PRI_MAX thread.");
+  thread_create ("spin", PRI_MAX, spin_thread, &done);
+
+  for (i = 0; i < task_cnt + 1; i++)
+    sema_down (&done);
+
+  for (i = 0; i < task_cnt; i++)
+    {
+      struct task *t = &tasks[i];
+      int expected = TEST_TICKS * (NSEC_PER_SEC / TIMER_FREQ) / t->period;
+
+      if (t->misses != 0)
+        fail ("%s missed %d of %d deadlines", t->name, t->misses, t->jobs);
+      if (t->jobs < expected - 2)
+        fail ("%s completed only %d of about %d jobs", t->name, t->jobs, expected);
+      msg ("%s met all its deadlines.", t->name);
+    }
+}
+
+static void
+edf_thread (void *task_)
+{
+  struct task *t = task_;
+
+  if (!thread_set_deadline (t->runtime, t->deadline, t->period))
+    fail ("%s was not admitted", t->name);
+
+  while (timer_elapsed (t->start_time) < TEST_TICKS)
+    {
+      int64_t deadline = thread_get_deadline ();
+      int64_t end = timer_ns () + t->runtime / 2;
+
+      while (timer_ns () < end)
+        continue;
+      if (timer_ns () > deadline)
+        t->misses++;
+      t->jobs++;
+      thread_deadline_yield ();
+    }
+  sema_up (t->done);
+}
+
+static void
+spin_thread (void *done_)
+{
+  struct semaphore *done = done_;
+  int64_t start_time = timer_ticks ();
+
+  while (timer_elapsed (start_time) < TEST_TICKS + TIMER_FREQ / 2)
+    continue;
+  sema_up (done);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-periodic) begin
+(edf-periodic) Starting 3 EDF threads...
+(edf-periodic) Starting a spinning PRI_MAX thread.
+(edf-periodic) edf 100 met all its deadlines.
+(edf-periodic) edf 150 met all its deadlines.
+(edf-periodic) edf 200 met all its deadlines.
+(edf-periodic) end
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Checks that an EDF thread that overruns its budget is
+   throttled until its next period.
+
+   An EDF thread with a budget of 20 ms every 100 ms spins for 2
+   seconds without ever waiting for its next period, while a
+   normal thread spins alongside it.  The EDF thread should get
+   its 20%, plus at most one timer tick of overrun per period,
+   and the normal thread the rest. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MSEC (NSEC_PER_SEC / 1000)
+
+/* How long the threads spin, in ticks. */
+#define TEST_TICKS (2 * TIMER_FREQ)
+
+struct spinner
+  {
+    bool edf;
+    int64_t start_time;
+    uint64_t run_cycles;
+    struct semaphore *done;
+  };
+
+static void spin_thread (void *spinner_);
+
+void
+test_edf_throttle (void)
+{
+  struct spinner spinners[2];
+  struct semaphore done;
+  uint64_t total;
+  int i;
+
+  sema_init (&done, 0);
+  msg ("Starting an EDF thread and a normal thread...");
+  for (i = 0; i < 2; i++)
+    {
+      spinners[i].edf = i == 0;
+      spinners[i].start_time = timer_ticks ();
+      spinners[i].run_cycles = 0;
+      spinners[i].done = &done;
+      thread_create (i == 0 ? "edf" : "normal", PRI_DEFAULT, spin_thread,
+                     &spinners[i]);
+    }
+  for (i = 0; i < 2; i++)
+    sema_down (&done);
+
+  total = spinners[0].run_cycles + spinners[1].run_cycles;
+  if (spinners[0].run_cycles * 100 / total < 15
+      || spinners[0].run_cycles * 100 / total > 35)
+    fail ("EDF thread got %"PRIu64"%% of the CPU, expected 20%% to 30%%",
+          spinners[0].run_cycles * 100 / total);
+  msg ("EDF thread was held to its budget.");
+}
+
+static void
+spin_thread (void *spinner_)
+{
+  struct spinner *s = spinner_;
+  struct sched_stats before, after;
+
+  if (s->edf && !thread_set_deadline (20 * MSEC, 100 * MSEC, 100 * MSEC))
+    fail ("EDF thread was not admitted");
+
+  thread_get_sched_stats (thread_current (), &before);
+  while (timer_elapsed (s->start_time) < TEST_TICKS)
+    continue;
+  thread_get_sched_stats (thread_current (), &after);
+
+  s->run_cycles = after.run_cycles - before.run_cycles;
+  sema_up (s->done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-throttle) begin
+(edf-throttle) Starting an EDF thread and a normal thread...
+(edf-throttle) EDF thread was held to its budget.
+(edf-throttle) end
+EOF
+pass;
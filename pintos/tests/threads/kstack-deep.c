@@ -0,0 +1,53 @@
+/* Checks that a thread has more than the 4 kB of kernel stack
+   that fits in its `struct thread' page.  A new thread recurses,
+   with a few hundred bytes of locals per frame, until it has
+   used about 6 kB of stack, and checks the result. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define FRAME_BYTES 256
+#define DEPTH 24
+
+static thread_func deep_thread;
+static int recurse (int depth);
+
+void
+test_kstack_deep (void)
+{
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  thread_create ("deep", PRI_DEFAULT, deep_thread, &done);
+  sema_down (&done);
+}
+
+static void
+deep_thread (void *done_)
+{
+  struct semaphore *done = done_;
+  int sum = recurse (DEPTH);
+
+  msg ("Recursed %d deep: sum %d, expected %d.",
+       DEPTH, sum, DEPTH * (DEPTH + 1) / 2);
+  sema_up (done);
+}
+
+/* Returns DEPTH + (DEPTH - 1) + ... + 1, keeping FRAME_BYTES of
+   live locals in each frame. */
+static int
+recurse (int depth)
+{
+  volatile char buf[FRAME_BYTES];
+  int sum;
+
+  if (depth == 0)
+    return 0;
+  memset ((char *) buf, depth, sizeof buf);
+  sum = recurse (depth - 1);
+  return sum + buf[depth % FRAME_BYTES];
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(kstack-deep) begin
+(kstack-deep) Recursed 24 deep: sum 300, expected 300.
+(kstack-deep) end
+EOF
+pass;
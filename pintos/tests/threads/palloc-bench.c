@@ -0,0 +1,104 @@
+/* Measures page allocation latency as the user pool fills up.
+   The test takes every user page, then frees a scattered subset
+   of them to leave the pool 0%, 50%, 75%, 90% and 99% full, and
+   at each level times allocating and freeing 1 page and 4
+   contiguous pages.  Only the output format is checked, since
+   the numbers depend on the host. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "intrinsic.h"
+
+#define ROUND_CNT 1000          /* Allocations timed per size. */
+
+static const int fill_levels[] = {0, 50, 75, 90, 99};
+
+static void **take_all (void **list);
+static void **release (void **list, int fill);
+static void report_cycles (const char *what, size_t page_cnt);
+
+void
+test_palloc_bench (void)
+{
+  void **held = NULL;
+  size_t i;
+
+  for (i = 0; i < sizeof fill_levels / sizeof *fill_levels; i++)
+    {
+      char what[32];
+
+      held = release (take_all (held), fill_levels[i]);
+      snprintf (what, sizeof what, "%d%% full", fill_levels[i]);
+      report_cycles (what, 1);
+      report_cycles (what, 4);
+    }
+
+  release (held, 0);
+  msg ("Benchmark done.");
+}
+
+/* Allocates every free user page and adds it to LIST, a chain
+   linked through the first word of each page.  Returns the new
+   head of the chain. */
+static void **
+take_all (void **list)
+{
+  void **page;
+
+  while ((page = palloc_get_page (PAL_USER)) != NULL)
+    {
+      *page = list;
+      list = page;
+    }
+  return list;
+}
+
+/* Frees pages spread across LIST until about FILL percent of
+   them are left, and returns the chain of those left. */
+static void **
+release (void **list, int fill)
+{
+  void **kept = NULL;
+  size_t i = 0;
+
+  while (list != NULL)
+    {
+      void **page = list;
+
+      list = *page;
+      if ((i++ * 37) % 100 < (size_t) fill)
+        {
+          *page = kept;
+          kept = page;
+        }
+      else
+        palloc_free_page (page);
+    }
+  return kept;
+}
+
+/* Times ROUND_CNT allocations of PAGE_CNT pages, each freed right
+   away, and prints the mean cycles per allocation and free. */
+static void
+report_cycles (const char *what, size_t page_cnt)
+{
+  uint64_t start, cycles;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      void *pages = palloc_get_multiple (PAL_USER, page_cnt);
+      if (pages == NULL)
+        {
+          msg ("%s: %zu page(s): none free.", what, page_cnt);
+          return;
+        }
+      palloc_free_multiple (pages, page_cnt);
+    }
+  cycles = rdtsc () - start;
+  msg ("%s: %zu page(s): %llu cycles per get and free.",
+       what, page_cnt, cycles / ROUND_CNT);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The cycle counts vary from run to run, so only look for the
+# lines that do not.
+@output = get_core_output ("run", @output);
+fail "missing begin in output"
+  unless grep ($_ eq "(palloc-bench) begin", @output);
+foreach my $fill (0, 50, 75, 90, 99) {
+    foreach my $cnt (1, 4) {
+	fail "missing $cnt-page timing at $fill% full"
+	  unless grep (/^\(palloc-bench\) $fill% full: $cnt page\(s\): (\d+ cycles per get and free|none free)\.$/,
+		       @output);
+    }
+}
+fail "benchmark did not finish"
+  unless grep ($_ eq "(palloc-bench) Benchmark done.", @output);
+fail "missing end in output"
+  unless grep ($_ eq "(palloc-bench) end", @output);
+
+pass;
@@ -0,0 +1,95 @@
+/* The main thread sets its priority to PRI_MIN, acquires lock 0
+   and creates 20 threads (thread 1..20) with priorities
+   PRI_MIN + 3, 6, 9, ..., 60.  Thread[i] acquires lock[i] and
+   then blocks on lock[i-1], held by thread[i-1], so that each
+   new thread's priority must be passed down a chain one link
+   longer than the last before it reaches the main thread.  The
+   chain is more than twice as deep as in priority-donate-chain.
+
+   Lowering the main thread's own priority must not take away
+   what is donated to it.  Once the main thread releases lock[0],
+   each thread in turn gets its lock and releases it, unblocking
+   the next, until thread[20] finishes and the rest finish in
+   priority order. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define DEPTH 20
+
+struct lock_pair
+  {
+    struct lock *second;
+    struct lock *first;
+  };
+
+static thread_func donor_thread_func;
+
+void
+test_priority_donate_deep (void) 
+{
+  struct lock locks[DEPTH];
+  struct lock_pair lock_pairs[DEPTH + 1];
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_MIN);
+
+  for (i = 0; i < DEPTH; i++)
+    lock_init (&locks[i]);
+
+  lock_acquire (&locks[0]);
+
+  for (i = 1; i <= DEPTH; i++)
+    {
+      char name[16];
+      int thread_priority = PRI_MIN + i * 3;
+
+      snprintf (name, sizeof name, "thread %d", i);
+      lock_pairs[i].first = i < DEPTH ? locks + i : NULL;
+      lock_pairs[i].second = locks + i - 1;
+
+      thread_create (name, thread_priority, donor_thread_func, lock_pairs + i);
+      if (thread_get_priority () != thread_priority)
+        fail ("%s should have priority %d.  Actual priority: %d.",
+              thread_name (), thread_priority, thread_get_priority ());
+    }
+  msg ("%s has priority %d after %d donations.", thread_name (),
+       thread_get_priority (), DEPTH);
+
+  thread_set_priority (PRI_MIN + 1);
+  msg ("%s should have priority %d.  Actual priority: %d.",
+       thread_name (), PRI_MIN + DEPTH * 3, thread_get_priority ());
+
+  lock_release (&locks[0]);
+  msg ("%s finishing with priority %d.", thread_name (),
+       thread_get_priority ());
+}
+
+static void
+donor_thread_func (void *locks_) 
+{
+  struct lock_pair *locks = locks_;
+
+  if (locks->first)
+    lock_acquire (locks->first);
+
+  lock_acquire (locks->second);
+  msg ("%s got lock", thread_name ());
+
+  lock_release (locks->second);
+  if (thread_get_priority () != PRI_MIN + DEPTH * 3)
+    fail ("%s should have priority %d.  Actual priority: %d.",
+          thread_name (), PRI_MIN + DEPTH * 3, thread_get_priority ());
+
+  if (locks->first)
+    lock_release (locks->first);
+
+  msg ("%s finishing with priority %d.", thread_name (),
+       thread_get_priority ());
+}
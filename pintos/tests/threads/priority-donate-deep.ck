@@ -0,0 +1,52 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-deep) begin
+(priority-donate-deep) main has priority 60 after 20 donations.
+(priority-donate-deep) main should have priority 60.  Actual priority: 60.
+(priority-donate-deep) thread 1 got lock
+(priority-donate-deep) thread 2 got lock
+(priority-donate-deep) thread 3 got lock
+(priority-donate-deep) thread 4 got lock
+(priority-donate-deep) thread 5 got lock
+(priority-donate-deep) thread 6 got lock
+(priority-donate-deep) thread 7 got lock
+(priority-donate-deep) thread 8 got lock
+(priority-donate-deep) thread 9 got lock
+(priority-donate-deep) thread 10 got lock
+(priority-donate-deep) thread 11 got lock
+(priority-donate-deep) thread 12 got lock
+(priority-donate-deep) thread 13 got lock
+(priority-donate-deep) thread 14 got lock
+(priority-donate-deep) thread 15 got lock
+(priority-donate-deep) thread 16 got lock
+(priority-donate-deep) thread 17 got lock
+(priority-donate-deep) thread 18 got lock
+(priority-donate-deep) thread 19 got lock
+(priority-donate-deep) thread 20 got lock
+(priority-donate-deep) thread 20 finishing with priority 60.
+(priority-donate-deep) thread 19 finishing with priority 57.
+(priority-donate-deep) thread 18 finishing with priority 54.
+(priority-donate-deep) thread 17 finishing with priority 51.
+(priority-donate-deep) thread 16 finishing with priority 48.
+(priority-donate-deep) thread 15 finishing with priority 45.
+(priority-donate-deep) thread 14 finishing with priority 42.
+(priority-donate-deep) thread 13 finishing with priority 39.
+(priority-donate-deep) thread 12 finishing with priority 36.
+(priority-donate-deep) thread 11 finishing with priority 33.
+(priority-donate-deep) thread 10 finishing with priority 30.
+(priority-donate-deep) thread 9 finishing with priority 27.
+(priority-donate-deep) thread 8 finishing with priority 24.
+(priority-donate-deep) thread 7 finishing with priority 21.
+(priority-donate-deep) thread 6 finishing with priority 18.
+(priority-donate-deep) thread 5 finishing with priority 15.
+(priority-donate-deep) thread 4 finishing with priority 12.
+(priority-donate-deep) thread 3 finishing with priority 9.
+(priority-donate-deep) thread 2 finishing with priority 6.
+(priority-donate-deep) thread 1 finishing with priority 3.
+(priority-donate-deep) main finishing with priority 1.
+(priority-donate-deep) end
+EOF
+pass;
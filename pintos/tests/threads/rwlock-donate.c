@@ -0,0 +1,86 @@
+/* The main thread and two other readers hold a reader-writer
+   lock for reading when a writer and then a late reader arrive.
+   The writer waits for the readers, and the late reader waits
+   behind the writer even though it could share the lock with
+   the readers.  Both donate their priority to all three readers,
+   which are released one by one, after which the writer gets the
+   lock before the late reader. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+static thread_func late_reader_thread_func;
+
+static struct rwlock rw;
+static struct semaphore go;
+
+void
+test_rwlock_donate (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rw);
+  sema_init (&go, 0);
+
+  rwlock_acquire_read (&rw);
+  msg ("main got read lock.");
+
+  for (i = 1; i <= 2; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT + 1, reader_thread_func, NULL);
+    }
+
+  thread_create ("writer", PRI_DEFAULT + 9, writer_thread_func, NULL);
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 9, thread_get_priority ());
+
+  thread_create ("late reader", PRI_DEFAULT + 14,
+                 late_reader_thread_func, NULL);
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 14, thread_get_priority ());
+
+  sema_up (&go);
+  sema_up (&go);
+  msg ("main releasing read lock.");
+  rwlock_release_read (&rw);
+  msg ("main done.");
+}
+
+static void
+reader_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  msg ("%s got read lock.", thread_name ());
+  sema_down (&go);
+  msg ("%s should have priority %d.  Actual priority: %d.",
+       thread_name (), PRI_DEFAULT + 14, thread_get_priority ());
+  rwlock_release_read (&rw);
+  msg ("%s done.", thread_name ());
+}
+
+static void
+writer_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_write (&rw);
+  msg ("writer got write lock.");
+  rwlock_release_write (&rw);
+  msg ("writer done.");
+}
+
+static void
+late_reader_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  msg ("late reader got read lock.");
+  rwlock_release_read (&rw);
+}
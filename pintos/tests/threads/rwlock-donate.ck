@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-donate) begin
+(rwlock-donate) main got read lock.
+(rwlock-donate) reader 1 got read lock.
+(rwlock-donate) reader 2 got read lock.
+(rwlock-donate) main should have priority 40.  Actual priority: 40.
+(rwlock-donate) main should have priority 45.  Actual priority: 45.
+(rwlock-donate) main releasing read lock.
+(rwlock-donate) reader 1 should have priority 45.  Actual priority: 45.
+(rwlock-donate) reader 2 should have priority 45.  Actual priority: 45.
+(rwlock-donate) writer got write lock.
+(rwlock-donate) late reader got read lock.
+(rwlock-donate) writer done.
+(rwlock-donate) reader 1 done.
+(rwlock-donate) reader 2 done.
+(rwlock-donate) main done.
+(rwlock-donate) end
+EOF
+pass;
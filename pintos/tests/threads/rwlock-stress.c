@@ -0,0 +1,171 @@
+/* Runs readers, writers and upgrading readers of one reader-writer
+   lock at mixed priorities, each yielding while it holds the
+   lock, and checks that no writer ever shares the lock and that
+   an upgrade that reports keeping the lock sees no other write. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define READER_CNT 8
+#define WRITER_CNT 4
+#define UPGRADER_CNT 2
+#define ITER_CNT 100
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+static thread_func upgrader_thread_func;
+
+static struct rwlock rw;
+static struct semaphore done;
+static struct spinlock in_lock;     /* Protects the next two. */
+static int readers_in, writers_in;
+static int value;
+
+static void enter (bool writing);
+static void leave (bool writing);
+
+void
+test_rwlock_stress (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rw);
+  sema_init (&done, 0);
+  spinlock_init (&in_lock);
+
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("reader", PRI_DEFAULT - 1 + i % 3, reader_thread_func, NULL);
+  for (i = 0; i < WRITER_CNT; i++)
+    thread_create ("writer", PRI_DEFAULT - 1 + i % 3, writer_thread_func, NULL);
+  for (i = 0; i < UPGRADER_CNT; i++)
+    thread_create ("upgrader", PRI_DEFAULT - 1 + i % 3, upgrader_thread_func,
+                   NULL);
+
+  for (i = 0; i < READER_CNT + WRITER_CNT + UPGRADER_CNT; i++)
+    sema_down (&done);
+  msg ("%d threads finished %d iterations each.",
+       READER_CNT + WRITER_CNT + UPGRADER_CNT, ITER_CNT);
+
+  if (value != (WRITER_CNT + UPGRADER_CNT) * ITER_CNT)
+    fail ("value is %d, expected %d", value,
+          (WRITER_CNT + UPGRADER_CNT) * ITER_CNT);
+  msg ("value is %d.", value);
+}
+
+static void
+reader_thread_func (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      int seen;
+
+      if (i % 4 != 0 || !rwlock_try_acquire_read (&rw))
+        rwlock_acquire_read (&rw);
+      enter (false);
+      seen = value;
+      thread_yield ();
+      if (value != seen)
+        fail ("value changed under a reader");
+      leave (false);
+      rwlock_release_read (&rw);
+    }
+  sema_up (&done);
+}
+
+static void
+writer_thread_func (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      if (i % 4 != 0 || !rwlock_try_acquire_write (&rw))
+        rwlock_acquire_write (&rw);
+      enter (true);
+      value++;
+      thread_yield ();
+      leave (true);
+      rwlock_release_write (&rw);
+      thread_yield ();
+    }
+  sema_up (&done);
+}
+
+static void
+upgrader_thread_func (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      int seen;
+
+      rwlock_acquire_read (&rw);
+      enter (false);
+      seen = value;
+      thread_yield ();
+      leave (false);
+
+      if (rwlock_upgrade (&rw) && value != seen)
+        fail ("value changed during an upgrade that kept the lock");
+      enter (true);
+      value++;
+      thread_yield ();
+      leave (true);
+
+      if (i % 2 == 0)
+        rwlock_release_write (&rw);
+      else 
+        {
+          rwlock_downgrade (&rw);
+          enter (false);
+          thread_yield ();
+          leave (false);
+          rwlock_release_read (&rw);
+        }
+    }
+  sema_up (&done);
+}
+
+/* Records that the running thread now holds the lock for writing,
+   if WRITING, or for reading, and checks that it is not shared
+   with a writer. */
+static void
+enter (bool writing) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&in_lock);
+  if (writing)
+    writers_in++;
+  else
+    readers_in++;
+  if (writers_in > 1 || (writers_in > 0 && readers_in > 0))
+    fail ("%d writers and %d readers hold the lock", writers_in, readers_in);
+  spinlock_release (&in_lock);
+  intr_set_level (old_level);
+}
+
+/* Undoes enter (WRITING). */
+static void
+leave (bool writing) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&in_lock);
+  if (writing)
+    writers_in--;
+  else
+    readers_in--;
+  spinlock_release (&in_lock);
+  intr_set_level (old_level);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-stress) begin
+(rwlock-stress) 14 threads finished 100 iterations each.
+(rwlock-stress) value is 600.
+(rwlock-stress) end
+EOF
+pass;
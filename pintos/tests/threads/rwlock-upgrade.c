@@ -0,0 +1,77 @@
+/* The main thread upgrades its read hold on a reader-writer lock
+   while another reader holds it too and a writer waits for it.
+   The upgrade must wait for the other reader, whose priority the
+   writer raises, but must then go before the writer.  The main
+   thread then downgrades again, which must not let a late reader
+   in ahead of the waiting writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+static thread_func late_reader_thread_func;
+
+static struct rwlock rw;
+
+void
+test_rwlock_upgrade (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rw);
+
+  rwlock_acquire_read (&rw);
+  msg ("main got read lock.");
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread_func, NULL);
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread_func, NULL);
+
+  msg ("main upgrading.");
+  if (!rwlock_upgrade (&rw))
+    fail ("upgrade released the lock");
+  msg ("main upgraded.");
+
+  thread_create ("late reader", PRI_DEFAULT + 3,
+                 late_reader_thread_func, NULL);
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  rwlock_downgrade (&rw);
+  msg ("main downgraded.");
+  rwlock_release_read (&rw);
+  msg ("main done.");
+}
+
+static void
+reader_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  msg ("reader got read lock.");
+  timer_sleep (10);
+  msg ("reader should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  rwlock_release_read (&rw);
+  msg ("reader done.");
+}
+
+static void
+writer_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_write (&rw);
+  msg ("writer got write lock.");
+  rwlock_release_write (&rw);
+  msg ("writer done.");
+}
+
+static void
+late_reader_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  msg ("late reader got read lock.");
+  rwlock_release_read (&rw);
+}
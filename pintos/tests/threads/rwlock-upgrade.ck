@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-upgrade) begin
+(rwlock-upgrade) main got read lock.
+(rwlock-upgrade) reader got read lock.
+(rwlock-upgrade) main upgrading.
+(rwlock-upgrade) reader should have priority 33.  Actual priority: 33.
+(rwlock-upgrade) main upgraded.
+(rwlock-upgrade) main should have priority 34.  Actual priority: 34.
+(rwlock-upgrade) main downgraded.
+(rwlock-upgrade) writer got write lock.
+(rwlock-upgrade) late reader got read lock.
+(rwlock-upgrade) writer done.
+(rwlock-upgrade) reader done.
+(rwlock-upgrade) main done.
+(rwlock-upgrade) end
+EOF
+pass;
@@ -0,0 +1,122 @@
+/* Measures how throughput scales with the number of CPUs on a
+   fork/compute workload.  Each round forks WORKER_CNT threads
+   that crunch numbers independently, then joins them all before
+   starting the next round.  The same work is first done by the
+   main thread alone, as a baseline.
+
+   Run it with different `pintos -smp N' settings and compare the
+   reported throughput.  Besides the results of the computation,
+   the check script requires the parallel rounds to reach half of
+   the ideal speedup over the baseline, and no less than 1.5x,
+   whenever more than one CPU is online. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/mp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 8             /* Number of fork/join rounds. */
+#define WORKER_CNT 8            /* Workers forked per round. */
+#define WORK_ITERS (1 << 20)    /* Inner loop iterations per worker. */
+
+struct worker 
+  {
+    uint64_t seed;              /* Input. */
+    uint64_t result;            /* Output. */
+    struct semaphore *done;     /* Upped when the result is in. */
+  };
+
+static thread_func worker_func;
+static uint64_t crunch (uint64_t seed);
+static void report (const char *what, int64_t ticks);
+
+void
+test_smp_scaling (void) 
+{
+  static uint64_t expected[ROUND_CNT][WORKER_CNT];
+  struct worker workers[WORKER_CNT];
+  struct semaphore done;
+  int64_t start;
+  int round, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("%d rounds of %d workers on %d CPU(s).",
+       ROUND_CNT, WORKER_CNT, cpu_online_cnt);
+
+  /* Baseline: one thread does all the work. */
+  start = timer_ticks ();
+  for (round = 0; round < ROUND_CNT; round++)
+    for (i = 0; i < WORKER_CNT; i++)
+      expected[round][i] = crunch (round * WORKER_CNT + i + 1);
+  report ("serial", timer_elapsed (start));
+
+  /* Fork/join rounds. */
+  start = timer_ticks ();
+  for (round = 0; round < ROUND_CNT; round++) 
+    {
+      sema_init (&done, 0);
+      for (i = 0; i < WORKER_CNT; i++) 
+        {
+          char name[16];
+
+          workers[i].seed = round * WORKER_CNT + i + 1;
+          workers[i].done = &done;
+          snprintf (name, sizeof name, "worker %d", i);
+          thread_create (name, PRI_DEFAULT, worker_func, &workers[i]);
+        }
+      for (i = 0; i < WORKER_CNT; i++)
+        sema_down (&done);
+
+      for (i = 0; i < WORKER_CNT; i++)
+        if (workers[i].result != expected[round][i])
+          fail ("round %d, worker %d computed a wrong result", round, i);
+    }
+  report ("parallel", timer_elapsed (start));
+
+  msg ("Results match.");
+}
+
+static void
+worker_func (void *worker_) 
+{
+  struct worker *worker = worker_;
+
+  worker->result = crunch (worker->seed);
+  sema_up (worker->done);
+}
+
+/* Runs a xorshift generator seeded with SEED for WORK_ITERS
+   steps and returns the sum of its outputs. */
+static uint64_t
+crunch (uint64_t seed) 
+{
+  uint64_t x = seed, sum = 0;
+  int i;
+
+  for (i = 0; i < WORK_ITERS; i++) 
+    {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      sum += x;
+    }
+  return sum;
+}
+
+/* Reports the throughput of the run called WHAT, which took
+   TICKS timer ticks, in worker computations per second. */
+static void
+report (const char *what, int64_t ticks) 
+{
+  int64_t units = ROUND_CNT * WORKER_CNT;
+
+  if (ticks < 1)
+    ticks = 1;
+  msg ("%s: %lld ticks, %lld computations/s.",
+       what, ticks, units * TIMER_FREQ / ticks);
+}
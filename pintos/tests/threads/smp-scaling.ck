@@ -0,0 +1,40 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timing lines vary from run to run, so look for the lines
+# that do not and check the timings separately.
+@output = get_core_output ("run", @output);
+fail "missing begin in output"
+  unless grep ($_ eq '(smp-scaling) begin', @output);
+fail "results do not match"
+  unless grep ($_ eq '(smp-scaling) Results match.', @output);
+fail "missing end in output"
+  unless grep ($_ eq '(smp-scaling) end', @output);
+
+# With more than one CPU, the workers must actually run in
+# parallel.  Ask for half of the ideal speedup, at least 1.5x, to
+# leave room for the fork/join overhead and a noisy host.
+my ($cpus) = map (/^\(smp-scaling\) \d+ rounds of \d+ workers on (\d+) CPU/,
+		  @output);
+my ($serial) = map (/^\(smp-scaling\) serial: (\d+) ticks/, @output);
+my ($parallel) = map (/^\(smp-scaling\) parallel: (\d+) ticks/, @output);
+fail "missing CPU count in output" unless defined $cpus;
+fail "missing serial timing in output" unless defined $serial;
+fail "missing parallel timing in output" unless defined $parallel;
+if ($cpus > 1) {
+    my ($want) = $cpus / 2 < 1.5 ? 1.5 : $cpus / 2;
+    $parallel = 1 if $parallel < 1;
+    my ($speedup) = $serial / $parallel;
+    fail sprintf ("throughput did not scale: %.2fx speedup on %d CPUs, "
+		  . "wanted at least %.2fx", $speedup, $cpus, $want)
+      if $speedup < $want;
+}
+
+pass;
@@ -0,0 +1,67 @@
+/* Measures the cost of a thread switch.  Two threads take turns
+   on a pair of semaphores, as in sema_self_test(), so that every
+   sema_down() blocks and switches to the other one.
+
+   switch-pingpong-iret runs the same test with "-iret-switch",
+   so the two results compare switch_threads() against switching
+   through a full intr_frame and iretq.  Only the output format
+   is checked, since the numbers depend on the host. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define WARMUP_CNT 100          /* Round trips before measuring. */
+#define ROUND_TRIP_CNT 10000    /* Round trips measured. */
+
+static thread_func pong;
+
+void
+test_switch_pingpong (void) 
+{
+  struct semaphore sema[2];
+  uint64_t start, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema[0], 0);
+  sema_init (&sema[1], 0);
+  thread_create ("pong", PRI_DEFAULT, pong, sema);
+
+  for (i = 0; i < WARMUP_CNT; i++) 
+    {
+      sema_up (&sema[0]);
+      sema_down (&sema[1]);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < ROUND_TRIP_CNT; i++) 
+    {
+      sema_up (&sema[0]);
+      sema_down (&sema[1]);
+    }
+  cycles = rdtsc () - start;
+
+  /* Each round trip switches to pong and back. */
+  msg ("%s switch: %llu cycles per switch.",
+       thread_iret_switch ? "iretq" : "fast", cycles / (2 * ROUND_TRIP_CNT));
+  msg ("Ping-pong done.");
+}
+
+static void
+pong (void *sema_) 
+{
+  struct semaphore *sema = sema_;
+  int i;
+
+  for (i = 0; i < WARMUP_CNT + ROUND_TRIP_CNT; i++) 
+    {
+      sema_down (&sema[0]);
+      sema_up (&sema[1]);
+    }
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+my ($name) = $test;
+$name =~ s%.*/%%;
+
+# The cycle counts vary from run to run, so only look for the
+# lines that do not.
+@output = get_core_output ("run", @output);
+fail "missing begin in output"
+  unless grep ($_ eq "($name) begin", @output);
+fail "missing cycle count in output"
+  unless grep (/^\(\Q$name\E\) fast switch: \d+ cycles per switch\.$/, @output);
+fail "ping-pong did not finish"
+  unless grep ($_ eq "($name) Ping-pong done.", @output);
+fail "missing end in output"
+  unless grep ($_ eq "($name) end", @output);
+
+pass;
@@ -0,0 +1,105 @@
+/* Checks the timed waits.  A semaphore wait times out while the
+   semaphore stays at 0 and succeeds once it is up.  A
+   higher-priority thread waiting for a lock with a timeout
+   donates to the main thread, which holds it, until the wait
+   times out, and then the donation is taken back; another waits
+   long enough to get the lock.  A condition variable wait times
+   out unless it is signaled in time. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+struct cond_data
+  {
+    struct lock lock;
+    struct condition cond;
+  };
+
+static thread_func short_waiter;
+static thread_func long_waiter;
+static thread_func signaler;
+
+void
+test_synch_timeout (void)
+{
+  struct semaphore sema;
+  struct lock lock;
+  struct cond_data data;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&sema, 0);
+  msg ("sema_down_timeout on 0: %s.",
+       sema_down_timeout (&sema, 5) ? "acquired" : "timed out");
+  sema_up (&sema);
+  msg ("sema_down_timeout on 1: %s.",
+       sema_down_timeout (&sema, 5) ? "acquired" : "timed out");
+
+  lock_init (&lock);
+  lock_acquire (&lock);
+  thread_create ("short", PRI_DEFAULT + 10, short_waiter, &lock);
+  msg ("Main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 10, thread_get_priority ());
+  timer_sleep (20);
+  msg ("Main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+
+  thread_create ("long", PRI_DEFAULT + 5, long_waiter, &lock);
+  msg ("Main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  lock_release (&lock);
+  msg ("Main released the lock.");
+
+  lock_init (&data.lock);
+  cond_init (&data.cond);
+  lock_acquire (&data.lock);
+  msg ("cond_wait_timeout unsignaled: %s.",
+       cond_wait_timeout (&data.cond, &data.lock, 5) ? "signaled" : "timed out");
+  thread_create ("signaler", PRI_DEFAULT - 1, signaler, &data);
+  msg ("cond_wait_timeout signaled: %s.",
+       cond_wait_timeout (&data.cond, &data.lock, 1000) ? "signaled" : "timed out");
+  lock_release (&data.lock);
+}
+
+static void
+short_waiter (void *lock_)
+{
+  struct lock *lock = lock_;
+
+  if (lock_acquire_timeout (lock, 10))
+    msg ("Short waiter got the lock, but should have timed out.");
+  else
+    msg ("Short waiter timed out.");
+}
+
+static void
+long_waiter (void *lock_)
+{
+  struct lock *lock = lock_;
+
+  if (lock_acquire_timeout (lock, 1000))
+    {
+      msg ("Long waiter got the lock.");
+      lock_release (lock);
+    }
+  else
+    msg ("Long waiter timed out.");
+}
+
+static void
+signaler (void *data_)
+{
+  struct cond_data *data = data_;
+
+  lock_acquire (&data->lock);
+  cond_signal (&data->cond, &data->lock);
+  lock_release (&data->lock);
+}
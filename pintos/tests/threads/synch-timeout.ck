@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(synch-timeout) begin
+(synch-timeout) sema_down_timeout on 0: timed out.
+(synch-timeout) sema_down_timeout on 1: acquired.
+(synch-timeout) Main should have priority 41.  Actual priority: 41.
+(synch-timeout) Short waiter timed out.
+(synch-timeout) Main should have priority 31.  Actual priority: 31.
+(synch-timeout) Main should have priority 36.  Actual priority: 36.
+(synch-timeout) Long waiter got the lock.
+(synch-timeout) Main released the lock.
+(synch-timeout) cond_wait_timeout unsignaled: timed out.
+(synch-timeout) cond_wait_timeout signaled: signaled.
+(synch-timeout) end
+EOF
+pass;
@@ -25,10 +25,23 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-deep", test_priority_donate_deep},
+    {"rwlock-donate", test_rwlock_donate},
+    {"rwlock-upgrade", test_rwlock_upgrade},
+    {"rwlock-stress", test_rwlock_stress},
+    {"synch-timeout", test_synch_timeout},
+    {"kstack-deep", test_kstack_deep},
+    {"palloc-bench", test_palloc_bench},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"smp-scaling", test_smp_scaling},
+    {"switch-pingpong", test_switch_pingpong},
+    {"switch-pingpong-iret", test_switch_pingpong},
+    {"edf-admission", test_edf_admission},
+    {"edf-periodic", test_edf_periodic},
+    {"edf-throttle", test_edf_throttle},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -38,6 +51,9 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"cfs-fair-2", test_cfs_fair_2},
+    {"cfs-nice-3", test_cfs_nice_3},
+    {"cfs-latency", test_cfs_latency},
   };
 
 static const char *test_name;
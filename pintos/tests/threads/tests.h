@@ -19,10 +19,22 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_deep;
+extern test_func test_rwlock_donate;
+extern test_func test_rwlock_upgrade;
+extern test_func test_rwlock_stress;
+extern test_func test_synch_timeout;
+extern test_func test_kstack_deep;
+extern test_func test_palloc_bench;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_smp_scaling;
+extern test_func test_switch_pingpong;
+extern test_func test_edf_admission;
+extern test_func test_edf_periodic;
+extern test_func test_edf_throttle;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -32,6 +44,9 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_cfs_fair_2;
+extern test_func test_cfs_nice_3;
+extern test_func test_cfs_latency;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,52 @@
+/* Checks that SSE registers are inherited across fork and are
+   not disturbed by another process using them. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PARENT_PATTERN 0x0123456789abcdefULL
+#define CHILD_PATTERN 0xfedcba9876543210ULL
+
+static void
+set_xmm (uint64_t value)
+{
+  asm volatile ("movq %0, %%xmm0; movq %0, %%xmm7" : : "r" (value));
+}
+
+static uint64_t
+get_xmm (void)
+{
+  uint64_t xmm0, xmm7;
+
+  asm volatile ("movq %%xmm0, %0; movq %%xmm7, %1"
+                : "=r" (xmm0), "=r" (xmm7));
+  return xmm0 == xmm7 ? xmm0 : 0;
+}
+
+void
+test_main (void)
+{
+  int pid;
+
+  set_xmm (PARENT_PATTERN);
+  if ((pid = fork ("child")))
+    {
+      int status = wait (pid);
+      msg ("Parent: child exit status is %d", status);
+      if (get_xmm () != PARENT_PATTERN)
+        fail ("parent's xmm registers changed");
+      msg ("parent's xmm registers intact");
+    }
+  else
+    {
+      if (get_xmm () != PARENT_PATTERN)
+        fail ("child did not inherit xmm registers");
+      set_xmm (CHILD_PATTERN);
+      msg ("child run");
+      if (get_xmm () != CHILD_PATTERN)
+        fail ("child's xmm registers changed");
+      exit (81);
+    }
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-fpu) begin
+(fork-fpu) child run
+child: exit(81)
+(fork-fpu) Parent: child exit status is 81
+(fork-fpu) parent's xmm registers intact
+(fork-fpu) end
+fork-fpu: exit(0)
+EOF
+pass;
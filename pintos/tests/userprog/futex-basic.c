@@ -0,0 +1,19 @@
+/* Checks the futex system calls where no thread has to sleep:
+   waiting on an int that no longer holds the expected value, or
+   on a misaligned address, returns at once, and waking an int
+   that no one waits on wakes no one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word = 1;
+
+void
+test_main (void)
+{
+  CHECK (futex_wait (&word, 0) == -1, "futex_wait on changed value");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+  CHECK (futex_wait ((int *) ((char *) &word + 1), 1) == -1,
+         "futex_wait on misaligned address");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-basic) begin
+(futex-basic) futex_wait on changed value
+(futex-basic) futex_wake with no waiters
+(futex-basic) futex_wait on misaligned address
+(futex-basic) end
+futex-basic: exit(0)
+EOF
+pass;
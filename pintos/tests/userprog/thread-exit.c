@@ -0,0 +1,23 @@
+/* Calls exit() from a second thread while the first sleeps in
+   futex_wait().  The whole process must exit, once, with the
+   second thread's status. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word;
+
+static void
+exit_57 (void *aux UNUSED)
+{
+  exit (57);
+}
+
+void
+test_main (void)
+{
+  CHECK (uthread_create (exit_57, NULL) != -1, "uthread_create");
+  futex_wait (&word, 0);
+  fail ("should have exited with the other thread");
+}
@@ -0,0 +1,79 @@
+/* Has several threads increment a shared counter under a mutex
+   built on futex_wait() and futex_wake(), holding it long enough
+   that the others are bound to find it taken and sleep. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 50
+
+/* 0: unlocked, 1: locked, 2: locked, maybe with waiters. */
+static int lock_word;
+static int counter;
+
+static void
+mutex_lock (void)
+{
+  int c = __sync_val_compare_and_swap (&lock_word, 0, 1);
+
+  if (c != 0)
+    {
+      if (c != 2)
+        c = __sync_lock_test_and_set (&lock_word, 2);
+      while (c != 0)
+        {
+          futex_wait (&lock_word, 2);
+          c = __sync_lock_test_and_set (&lock_word, 2);
+        }
+    }
+}
+
+static void
+mutex_unlock (void)
+{
+  if (__sync_fetch_and_sub (&lock_word, 1) != 1)
+    {
+      lock_word = 0;
+      futex_wake (&lock_word, 1);
+    }
+}
+
+static void
+increment (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      volatile int spin;
+      int value;
+
+      mutex_lock ();
+      value = counter;
+      for (spin = 0; spin < 10000; spin++)
+        continue;
+      counter = value + 1;
+      mutex_unlock ();
+    }
+}
+
+void
+test_main (void)
+{
+  int tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tids[i] = uthread_create (increment, NULL);
+      if (tids[i] == -1)
+        fail ("uthread_create() failed");
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    if (uthread_join (tids[i]) != 0)
+      fail ("uthread_join(%d) failed", tids[i]);
+
+  msg ("counter is %d", counter);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-futex) begin
+(thread-futex) counter is 200
+(thread-futex) end
+thread-futex: exit(0)
+EOF
+pass;
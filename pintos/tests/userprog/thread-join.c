@@ -0,0 +1,48 @@
+/* Starts several threads in one process, checks that they all
+   wrote to the memory they share with it, and joins them.  A
+   thread can be joined only once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+
+static int values[THREAD_CNT];
+
+static void
+set_value (void *value_)
+{
+  int *value = value_;
+  int local = value - values;
+
+  /* Use the thread's own stack, too. */
+  *value = local + 1;
+}
+
+void
+test_main (void)
+{
+  int tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tids[i] = uthread_create (set_value, &values[i]);
+      if (tids[i] == -1)
+        fail ("uthread_create() failed");
+    }
+  msg ("created %d threads", THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (uthread_join (tids[i]) != 0)
+      fail ("uthread_join(%d) failed", tids[i]);
+  msg ("joined %d threads", THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (values[i] != i + 1)
+      fail ("values[%d] is %d, expected %d", i, values[i], i + 1);
+
+  CHECK (uthread_join (tids[0]) == -1, "joining a thread again fails");
+  CHECK (uthread_join (-1) == -1, "joining a bad tid fails");
+}
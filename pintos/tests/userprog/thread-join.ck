@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) created 4 threads
+(thread-join) joined 4 threads
+(thread-join) joining a thread again fails
+(thread-join) joining a bad tid fails
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
@@ -0,0 +1,304 @@
+#include "threads/fpu.h"
+
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "intrinsic.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/mp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* See [IA32-v1] chapter 13 "Managing State Using the XSAVE
+   Feature Set" and [IA32-v3a] 2.5 "Control Registers". */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002 /* Monitor coprocessor. */
+#define CR0_EM 0x00000004 /* x87 emulation. */
+#define CR0_TS 0x00000008 /* Task switched: next FPU use traps. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200     /* FXSAVE/FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* Unmasked SSE exceptions raise #XM. */
+#define CR4_OSXSAVE 0x00040000    /* XSAVE and XCR0 enabled. */
+
+/* CPUID.1 feature bits. */
+#define CPUID_1_EDX_FXSR (1u << 24)
+#define CPUID_1_ECX_XSAVE (1u << 26)
+#define CPUID_1_ECX_AVX (1u << 28)
+
+/* CPUID.(EAX=0DH,ECX=1) feature bits. */
+#define CPUID_D_1_EAX_XSAVEOPT (1u << 0)
+
+/* XCR0 state components. */
+#define XCR0_X87 0x1
+#define XCR0_SSE 0x2
+#define XCR0_AVX 0x4
+
+/* Layout of the legacy region shared by FXSAVE and XSAVE. */
+#define FXSAVE_SIZE 512
+#define FPU_FCW_OFS 0    /* x87 control word. */
+#define FPU_MXCSR_OFS 24 /* SSE control and status. */
+
+/* Power-on values of the control registers above. */
+#define FPU_FCW_INIT 0x037f
+#define FPU_MXCSR_INIT 0x1f80
+
+/* XSAVE requires 64-byte aligned save areas, FXSAVE 16-byte. */
+#define FPU_ALIGN 64
+
+static bool use_xsave;    /* XSAVE rather than FXSAVE? */
+static bool use_xsaveopt; /* XSAVEOPT rather than XSAVE? */
+static uint64_t xcr0;     /* Enabled XSAVE components. */
+static size_t fpu_size;   /* Bytes in a save area. */
+
+/* Serializes taking a thread's state out of another CPU's
+   registers, which fpu_disown() does, with that CPU saving it. */
+static struct spinlock fpu_lock;
+
+/* Statistics. */
+static long long trap_cnt;  /* # of #NM traps. */
+static long long area_cnt;  /* # of save areas allocated. */
+static long long eager_cnt; /* # of saves at context switch. */
+
+static intr_handler_func fpu_trap;
+static void fpu_init_cpu(void);
+static void* fpu_alloc(void);
+static void fpu_free(void* area);
+static void fpu_save(void* area);
+static void fpu_restore(void* area);
+static void fpu_disown(struct thread*);
+
+/* Sets CR0.TS, so that the next FPU instruction traps. */
+static inline void stts(void) { lcr0(rcr0() | CR0_TS); }
+
+/* Clears CR0.TS. */
+static inline void clts(void) { asm volatile("clts"); }
+
+/* Detects the FPU state-saving features, enables them on the
+   BSP and registers the #NM handler.  Must be called after
+   intr_init(). */
+void fpu_init(void) {
+    uint32_t a, b, c, d;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (!(d & CPUID_1_EDX_FXSR)) PANIC("FPU: FXSAVE not supported");
+    use_xsave = (c & CPUID_1_ECX_XSAVE) != 0;
+    xcr0 = XCR0_X87 | XCR0_SSE;
+    if (use_xsave && (c & CPUID_1_ECX_AVX)) xcr0 |= XCR0_AVX;
+
+    spinlock_init(&fpu_lock);
+    fpu_init_cpu();
+
+    if (use_xsave) {
+        /* With XCR0 set, CPUID reports the save area size for the
+           enabled components. */
+        cpuid(0xd, 0, &a, &b, &c, &d);
+        fpu_size = b;
+        cpuid(0xd, 1, &a, &b, &c, &d);
+        use_xsaveopt = (a & CPUID_D_1_EAX_XSAVEOPT) != 0;
+    } else
+        fpu_size = FXSAVE_SIZE;
+
+    intr_register_int(7, 0, INTR_ON, fpu_trap, "#NM Device Not Available Exception");
+    printf("FPU: %s, %zu-byte save areas%s\n", use_xsave ? "XSAVE" : "FXSAVE", fpu_size,
+           xcr0 & XCR0_AVX ? ", AVX" : "");
+}
+
+/* Enables FPU state saving on a secondary CPU, the same way as
+   fpu_init() did on the BSP. */
+void fpu_init_ap(void) { fpu_init_cpu(); }
+
+/* Sets up the running CPU's control registers.  FPU, SSE and (if
+   present) AVX instructions are allowed, but trap until their
+   first use. */
+static void fpu_init_cpu(void) {
+    uint64_t cr4 = rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+
+    if (use_xsave) cr4 |= CR4_OSXSAVE;
+    lcr4(cr4);
+    if (use_xsave)
+        asm volatile("xsetbv" : : "c"(0), "a"((uint32_t)xcr0), "d"((uint32_t)(xcr0 >> 32)));
+    lcr0((rcr0() & ~CR0_EM) | CR0_MP | CR0_TS);
+    this_cpu()->fpu_owner = NULL;
+}
+
+/* Called by schedule() with interrupts off when PREV is about to
+   be switched out for NEXT.  NEXT may use the registers without
+   trapping only if they already hold its state.
+
+   While more than one CPU runs threads, PREV might next run
+   elsewhere, so if it used the registers in this time slice its
+   state is saved now, while it is still in them. */
+void fpu_switch(struct thread* prev, struct thread* next) {
+    struct cpu* c = this_cpu();
+    bool live = !(rcr0() & CR0_TS);
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    if (live && c->fpu_owner == prev && cpu_online_cnt > 1) {
+        fpu_save(prev->fpu_state);
+        __atomic_fetch_add(&eager_cnt, 1, __ATOMIC_RELAXED);
+    }
+    if (c->fpu_owner == next) {
+        if (!live) clts();
+    } else if (live)
+        stts();
+}
+
+/* Gives DST, a new process forked from SRC, a copy of SRC's FPU
+   state.  Returns false if out of memory. */
+bool fpu_copy(struct thread* dst, struct thread* src) {
+    enum intr_level old_level;
+    void* area;
+
+    ASSERT(dst->fpu_state == NULL);
+    if (src->fpu_state == NULL) return true;
+
+    area = fpu_alloc();
+    if (area == NULL) return false;
+
+    /* SRC's newest state may only be in this CPU's registers.
+       Borrow them long enough to save it. */
+    old_level = intr_disable();
+    if (this_cpu()->fpu_owner == src) {
+        bool trapping = rcr0() & CR0_TS;
+
+        clts();
+        fpu_save(src->fpu_state);
+        if (trapping) stts();
+    }
+    memcpy(area, src->fpu_state, fpu_size);
+    dst->fpu_state = area;
+    intr_set_level(old_level);
+    return true;
+}
+
+/* Drops T's FPU state, as on exec or exit.  T starts over from
+   the initial state if it uses the FPU again. */
+void fpu_release(struct thread* t) {
+    enum intr_level old_level;
+    void* area;
+
+    old_level = intr_disable();
+    spinlock_acquire(&fpu_lock);
+    fpu_disown(t);
+    if (this_cpu()->fpu_owner == NULL && !(rcr0() & CR0_TS)) stts();
+    area = t->fpu_state;
+    t->fpu_state = NULL;
+    spinlock_release(&fpu_lock);
+    intr_set_level(old_level);
+
+    fpu_free(area);
+}
+
+/* Prints FPU statistics. */
+void fpu_print_stats(void) {
+    printf("FPU: %lld traps, %lld save areas, %lld eager saves\n", trap_cnt, area_cnt,
+           eager_cnt);
+}
+
+/* #NM handler.  The running thread used the FPU while CR0.TS was
+   set: load its state into the registers, saving whoever's state
+   was there, and let it retry the instruction. */
+static void fpu_trap(struct intr_frame* f) {
+    struct thread* cur = thread_current();
+    struct cpu* c;
+    void* area = NULL;
+
+    if (f->cs != SEL_UCSEG) {
+        intr_dump_frame(f);
+        PANIC("Kernel bug - FPU used in kernel");
+    }
+
+    /* First use: allocate before going atomic, since malloc() may
+       sleep. */
+    if (cur->fpu_state == NULL) {
+        area = fpu_alloc();
+        if (area == NULL) {
+            printf("%s: dying due to interrupt %#04llx (%s).\n", thread_name(), f->vec_no,
+                   intr_name(f->vec_no));
+            thread_exit();
+        }
+    }
+
+    intr_disable();
+    spinlock_acquire(&fpu_lock);
+    c = this_cpu();
+    trap_cnt++;
+    clts();
+    if (c->fpu_owner != cur) {
+        if (c->fpu_owner != NULL) fpu_save(c->fpu_owner->fpu_state);
+        if (area != NULL) cur->fpu_state = area;
+
+        /* Any other CPU that still holds our state holds an old
+           copy of it. */
+        fpu_disown(cur);
+        fpu_restore(cur->fpu_state);
+        c->fpu_owner = cur;
+    }
+    spinlock_release(&fpu_lock);
+    intr_enable();
+}
+
+/* Returns a new save area in the initial FPU state, or a null
+   pointer if memory is exhausted.
+
+   malloc() does not promise the alignment XSAVE needs, so the
+   area is carved out of a larger block, whose address is kept
+   just below the area for fpu_free(). */
+static void* fpu_alloc(void) {
+    uint8_t* block = malloc(fpu_size + FPU_ALIGN + sizeof(void*));
+    uint8_t* area;
+
+    if (block == NULL) return NULL;
+    area = (uint8_t*)ROUND_UP((uintptr_t)block + sizeof(void*), FPU_ALIGN);
+    ((void**)area)[-1] = block;
+
+    /* An all-zero XSAVE header marks every component as in its
+       initial state; only the control registers are loaded from
+       the legacy region regardless. */
+    memset(area, 0, fpu_size);
+    *(uint16_t*)(area + FPU_FCW_OFS) = FPU_FCW_INIT;
+    *(uint32_t*)(area + FPU_MXCSR_OFS) = FPU_MXCSR_INIT;
+    __atomic_fetch_add(&area_cnt, 1, __ATOMIC_RELAXED);
+    return area;
+}
+
+/* Frees AREA, which fpu_alloc() returned.  Does nothing if AREA
+   is a null pointer. */
+static void fpu_free(void* area) {
+    if (area != NULL) free(((void**)area)[-1]);
+}
+
+/* Saves the registers into AREA.  CR0.TS must be clear. */
+static void fpu_save(void* area) {
+    if (use_xsaveopt)
+        asm volatile("xsaveopt64 %0" : "=m"(*(uint8_t*)area) : "a"(-1), "d"(-1) : "memory");
+    else if (use_xsave)
+        asm volatile("xsave64 %0" : "=m"(*(uint8_t*)area) : "a"(-1), "d"(-1) : "memory");
+    else
+        asm volatile("fxsave64 %0" : "=m"(*(uint8_t*)area) : : "memory");
+}
+
+/* Loads the registers from AREA.  CR0.TS must be clear. */
+static void fpu_restore(void* area) {
+    if (use_xsave)
+        asm volatile("xrstor64 %0" : : "m"(*(uint8_t*)area), "a"(-1), "d"(-1) : "memory");
+    else
+        asm volatile("fxrstor64 %0" : : "m"(*(uint8_t*)area) : "memory");
+}
+
+/* Makes sure no CPU considers T's state to be in its registers.
+   fpu_lock must be held. */
+static void fpu_disown(struct thread* t) {
+    ASSERT(spinlock_held_by_current_cpu(&fpu_lock));
+
+    for (int i = 0; i < cpu_cnt; i++)
+        if (cpus[i].fpu_owner == t) cpus[i].fpu_owner = NULL;
+}
@@ -13,14 +13,20 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/mmu.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -74,6 +80,10 @@ main (void) {
 	/* Clear BSS and get machine's RAM size. */
 	bss_init ();
 
+	/* Point %gs at the boot CPU's per-CPU data, which
+	   intr_context() and therefore printf() rely on. */
+	mp_bsp_init ();
+
 	/* Break command line into arguments and parse options. */
 	argv = read_command_line ();
 	argv = parse_options (argv);
@@ -86,6 +96,7 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
 
 #ifdef USERPROG
@@ -95,6 +106,11 @@ main (void) {
 
 	/* Initialize interrupt handlers. */
 	intr_init ();
+	fpu_init ();
+	mp_init ();
+	kstack_init ();
+	trace_init ();
+	workqueue_init ();
 	timer_init ();
 	kbd_init ();
 	input_init ();
@@ -104,8 +120,10 @@ main (void) {
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
+	workqueue_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	mp_start_aps ();
 
 #ifdef USERPROG
 	init_std_fds();
@@ -226,6 +244,24 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-cfs"))
+			thread_cfs = true;
+		else if (!strcmp (name, "-cfs-gran")) {
+			thread_cfs_granularity = atoi (value) * 1000LL;
+			if (thread_cfs_granularity <= 0)
+				PANIC ("-cfs-gran must be positive");
+		}
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-trace"))
+			trace_enabled = true;
+		else if (!strcmp (name, "-iret-switch"))
+			thread_iret_switch = true;
+		else if (!strcmp (name, "-kstack")) {
+			kstack_pages = atoi (value);
+			if (kstack_pages < 1 || kstack_pages > KSTACK_PAGES_MAX)
+				PANIC ("-kstack must be between 1 and %d", KSTACK_PAGES_MAX);
+		}
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -235,6 +271,8 @@ parse_options (char **argv) {
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
 	}
+	if (thread_mlfqs && thread_cfs)
+		PANIC ("-mlfqs and -cfs are mutually exclusive");
 
 	return argv;
 }
@@ -257,6 +295,26 @@ run_task (char **argv) {
 	printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints per-thread scheduler statistics. */
+static void
+print_sched_stats (char **argv UNUSED) {
+	thread_print_sched_stats ();
+}
+
+/* Prints the events recorded with -trace. */
+static void
+dump_trace (char **argv UNUSED) {
+	trace_dump ();
+}
+
+#ifdef FILESYS
+/* Saves the events recorded with -trace to file ARGV[1]. */
+static void
+save_trace (char **argv) {
+	trace_save (argv[1]);
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -271,7 +329,10 @@ run_actions (char **argv) {
 	/* Table of supported actions. */
 	static const struct action actions[] = {
 		{"run", 2, run_task},
+		{"schedstat", 1, print_sched_stats},
+		{"tracedump", 1, dump_trace},
 #ifdef FILESYS
+		{"tracesave", 2, save_trace},
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
 		{"rm", 2, fsutil_rm},
@@ -317,10 +378,13 @@ usage (void) {
 #else
 			"  run TEST           Run TEST.\n"
 #endif
+			"  schedstat          Print per-thread scheduler statistics.\n"
+			"  tracedump          Print the events recorded with -trace.\n"
 #ifdef FILESYS
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
 			"  rm FILE            Delete FILE.\n"
+			"  tracesave FILE     Save the events recorded with -trace to FILE.\n"
 			"Use these actions indirectly via `pintos' -g and -p options:\n"
 			"  put FILE           Put FILE into file system from scratch disk.\n"
 			"  get FILE           Get FILE from file system into scratch disk.\n"
@@ -331,6 +395,12 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -cfs               Use fair-share (virtual run time) scheduler.\n"
+			"  -cfs-gran=US       Set its minimum granularity to US microseconds.\n"
+			"  -tickless          Stop the timer tick while the CPU is idle.\n"
+			"  -iret-switch       Switch threads through iretq (for comparison).\n"
+			"  -kstack=PAGES      Give each thread a PAGES-page kernel stack.\n"
+			"  -trace             Record scheduler and device events.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -359,6 +429,13 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	intr_print_stats ();
+	workqueue_print_stats ();
+	palloc_print_stats ();
+	malloc_print_stats ();
+	kmem_print_stats ();
+	mp_print_stats ();
+	fpu_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
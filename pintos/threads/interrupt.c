@@ -8,11 +8,16 @@
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
+#include "threads/mp.h"
+#include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #endif
 
 /* Number of x86_64 interrupts. */
@@ -93,15 +98,36 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 /* Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
+/* Time each external interrupt's handling has kept interrupts
+   off, measured from entry to intr_handler() to acknowledgement,
+   in TSC cycles. */
+struct intr_latency {
+	long long cnt;              /* # of interrupts handled. */
+	uint64_t total;             /* Cycles, all told. */
+	uint64_t max;               /* Cycles, longest. */
+};
+static struct intr_latency intr_latency[INTR_CNT];
+
+static void intr_account (uint8_t vec, uint64_t cycles);
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.
+
+   Inter-processor interrupts, raised by local APICs at vectors
+   0xf0 and up, are treated as external interrupts too.  Whether
+   we are in an external interrupt is a per-CPU property, so it
+   lives in struct cpu. */
+
+/* Returns true if VEC_NO is a 8259A PIC interrupt. */
+#define is_pic_intr(VEC_NO) ((VEC_NO) >= 0x20 && (VEC_NO) <= 0x2f)
+
+/* Returns true if VEC_NO is a local APIC interrupt. */
+#define is_lapic_intr(VEC_NO) ((VEC_NO) >= IPI_RESCHEDULE)
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -137,6 +163,14 @@ intr_enable (void) {
 	enum intr_level old_level = intr_get_level ();
 	ASSERT (!intr_context ());
 
+	/* A thread woken while interrupts were off should have
+	   preempted us then, but the waker may have held spin locks,
+	   so the switch was put off until now. */
+	if (old_level == INTR_OFF && this_cpu ()->preempt_pending) {
+		this_cpu ()->preempt_pending = false;
+		thread_preempt ();
+	}
+
 	/* Enable interrupts by setting the interrupt flag.
 
 	   See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -159,6 +193,18 @@ intr_disable (void) {
 	return old_level;
 }
 
+/* Re-enables interrupts and waits for the next one, for the idle
+   thread.  The `sti' instruction disables interrupts until the
+   completion of the next instruction, so `sti; hlt' executes
+   atomically and the CPU cannot miss a wake-up interrupt that
+   arrives in between.  Interrupts must be off. */
+void
+intr_idle (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	asm volatile ("sti; hlt" : : : "memory");
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init (void) {
@@ -173,15 +219,13 @@ intr_init (void) {
 		intr_names[i] = "unknown";
 	}
 
-#ifdef USERPROG
-	/* Load TSS. */
-	ltr (SEL_TSS);
-#endif
+	/* The TSS is loaded by kstack_cpu_init(). */
 
 	/* Load IDT register. */
 	lidt(&idt_desc);
 
 	/* Initialize intr_names. */
+	intr_names[LAPIC_SPURIOUS] = "Local APIC spurious interrupt";
 	intr_names[0] = "#DE Divide Error";
 	intr_names[1] = "#DB Debug Exception";
 	intr_names[2] = "NMI Interrupt";
@@ -203,6 +247,12 @@ intr_init (void) {
 	intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT on a secondary CPU.  All CPUs share one IDT. */
+void
+intr_init_ap (void) {
+	lidt(&idt_desc);
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -221,13 +271,24 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 	intr_names[vec_no] = name;
 }
 
+/* Makes interrupt VEC_NO switch to the stack in entry IST of
+   the interrupt stack table in the CPU's TSS, or, if IST is 0,
+   run on the interrupted stack as usual. */
+void
+intr_set_ist (uint8_t vec_no, int ist) {
+	ASSERT (ist >= 0 && ist <= 7);
+	ASSERT (intr_handlers[vec_no] != NULL);
+	idt[vec_no].ist = ist;
+}
+
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
    execute with interrupts disabled. */
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
 		const char *name) {
-	ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+	ASSERT (is_pic_intr (vec_no)
+			|| (is_lapic_intr (vec_no) && vec_no != LAPIC_SPURIOUS));
 	register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -248,7 +309,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 		intr_handler_func *handler, const char *name)
 {
-	ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+	ASSERT (!is_pic_intr (vec_no) && !is_lapic_intr (vec_no));
 	register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -256,7 +317,7 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
    and false at all other times. */
 bool
 intr_context (void) {
-	return in_external_intr;
+	return this_cpu ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -266,7 +327,7 @@ intr_context (void) {
 void
 intr_yield_on_return (void) {
 	ASSERT (intr_context ());
-	yield_on_return = true;
+	this_cpu ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -332,25 +393,39 @@ void
 intr_handler (struct intr_frame *frame) {
 	bool external;
 	intr_handler_func *handler;
+	uint64_t start = 0;
+
+	TRACE (TRACE_INTR_ENTER, frame->vec_no, 0);
 
 	/* External interrupts are special.
 	   We only handle one at a time (so interrupts must be off)
-	   and they need to be acknowledged on the PIC (see below).
-	   An external interrupt handler cannot sleep. */
-	external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+	   and they need to be acknowledged on the PIC or the local
+	   APIC (see below).  An external interrupt handler cannot
+	   sleep. */
+	external = (is_pic_intr (frame->vec_no) || is_lapic_intr (frame->vec_no))
+		&& frame->vec_no != LAPIC_SPURIOUS;
 	if (external) {
+		struct cpu *c = this_cpu ();
+
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (!intr_context ());
 
-		in_external_intr = true;
-		yield_on_return = false;
+		c->in_external_intr = true;
+		c->yield_on_return = false;
+		start = rdtsc ();
+
+		/* Any device or local APIC timer interrupt ends the BSP's
+		   tickless idle period. */
+		if (c->id == 0)
+			timer_tickless_exit ();
 	}
 
 	/* Invoke the interrupt's handler. */
 	handler = intr_handlers[frame->vec_no];
 	if (handler != NULL)
 		handler (frame);
-	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
+	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+			|| frame->vec_no == LAPIC_SPURIOUS) {
 		/* There is no handler, but this interrupt can trigger
 		   spuriously due to a hardware fault or hardware race
 		   condition.  Ignore it. */
@@ -360,17 +435,61 @@ intr_handler (struct intr_frame *frame) {
 		intr_dump_frame (frame);
 		PANIC ("Unexpected interrupt");
 	}
+	TRACE (TRACE_INTR_EXIT, frame->vec_no, 0);
 
 	/* Complete the processing of an external interrupt. */
 	if (external) {
+		struct cpu *c = this_cpu ();
+
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (intr_context ());
 
-		in_external_intr = false;
-		pic_end_of_interrupt (frame->vec_no);
+		intr_account (frame->vec_no, rdtsc () - start);
+		c->in_external_intr = false;
+		if (is_pic_intr (frame->vec_no))
+			pic_end_of_interrupt (frame->vec_no);
+		else
+			lapic_eoi ();
 
-		if (yield_on_return)
-			thread_yield ();
+		if (c->yield_on_return)
+			thread_preempt ();
+
+#ifdef USERPROG
+		/* A user thread whose process is exiting dies here
+		   instead of going back to user mode. */
+		if (frame->cs == SEL_UCSEG)
+			process_check_exiting ();
+#endif
+	}
+}
+
+/* Records that external interrupt VEC's handling took CYCLES. */
+static void
+intr_account (uint8_t vec, uint64_t cycles) {
+	struct intr_latency *l = &intr_latency[vec];
+
+	uint64_t max = __atomic_load_n (&l->max, __ATOMIC_RELAXED);
+
+	/* Every CPU takes interrupts, so update atomically. */
+	__atomic_fetch_add (&l->cnt, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&l->total, cycles, __ATOMIC_RELAXED);
+	while (cycles > max
+			&& !__atomic_compare_exchange_n (&l->max, &max, cycles, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		continue;
+}
+
+/* Prints, for each external interrupt that occurred, how long
+   its handling kept interrupts off. */
+void
+intr_print_stats (void) {
+	for (int vec = 0; vec < INTR_CNT; vec++) {
+		const struct intr_latency *l = &intr_latency[vec];
+
+		if (l->cnt > 0)
+			printf ("Interrupt %#04x (%s): %lld, %"PRIu64" cycles mean, "
+					"%"PRIu64" cycles max\n",
+					vec, intr_names[vec], l->cnt, l->total / l->cnt, l->max);
 	}
 }
 
@@ -0,0 +1,249 @@
+#include "threads/kstack.h"
+
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "intrinsic.h"
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/tss.h"
+
+/* Bytes of address space per stack slot. */
+#define SLOT_SIZE ((uint64_t)KSTACK_SLOT_PAGES * PGSIZE)
+
+/* Interrupt stack table entry the double fault handler runs on. */
+#define FAULT_IST 1
+
+int kstack_pages = 2;
+
+/* Slots handed out, and slots freed whose mappings may still be
+   cached in some CPU's TLB.  A stale slot counts as used until
+   the TLBs are flushed.  Protected by a spin lock, since
+   kstack_free() runs inside the scheduler. */
+static struct bitmap* used_slots;
+static struct bitmap* stale_slots;
+static struct bitmap* flushing_slots; /* Stale slots being reclaimed. */
+static struct spinlock slot_lock;
+
+/* Serializes mapping stacks, which may create page tables, and
+   reclaiming stale slots. */
+static struct lock map_lock;
+
+/* Each CPU's TSS. */
+static struct task_state* cpu_tss[CPU_MAX];
+
+static void double_fault(struct intr_frame*);
+static void reclaim_stale_slots(void);
+static uint64_t* stack_pte(uint64_t va);
+
+/* Sets up the stack slots and gives every CPU a TSS with a stack
+   for the double fault handler, then loads the boot CPU's.  Must
+   be called after mp_init() and intr_init(). */
+void kstack_init(void) {
+    ASSERT(kstack_pages >= 1 && kstack_pages <= KSTACK_PAGES_MAX);
+
+    used_slots = bitmap_create(KSTACK_SLOT_CNT);
+    stale_slots = bitmap_create(KSTACK_SLOT_CNT);
+    flushing_slots = bitmap_create(KSTACK_SLOT_CNT);
+    if (used_slots == NULL || stale_slots == NULL || flushing_slots == NULL)
+        PANIC("no memory for kernel stack slots");
+    spinlock_init(&slot_lock);
+    lock_init(&map_lock);
+
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        struct task_state* tss;
+        uint8_t* fault_stack = palloc_get_page(PAL_ASSERT);
+
+#ifdef USERPROG
+        /* The boot CPU keeps the TSS tss_init() gave it. */
+        if (cpu == 0)
+            tss = tss_get();
+        else
+#endif
+            tss = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+        tss->ist1 = (uint64_t)fault_stack + PGSIZE;
+        cpu_tss[cpu] = tss;
+        cpus[cpu].tss = tss;
+    }
+
+    intr_register_int(8, 0, INTR_OFF, double_fault, "#DF Double Fault Exception");
+    intr_set_ist(8, FAULT_IST);
+    kstack_cpu_init();
+}
+
+/* Installs the running CPU's TSS in the GDT and loads it. */
+void kstack_cpu_init(void) {
+    int id = this_cpu()->id;
+    uint64_t base = (uint64_t)cpu_tss[id];
+    uint64_t limit = sizeof(struct task_state) - 1;
+    struct desc_ptr gdtr;
+    uint64_t* gdt;
+
+    ASSERT(cpu_tss[id] != NULL);
+
+    asm volatile("sgdt %0" : "=m"(gdtr));
+    ASSERT(gdtr.size + 1u >= GDT_ENTRY_CNT * sizeof(uint64_t));
+    gdt = (uint64_t*)gdtr.address + SEL_CPU_TSS(id) / 8;
+
+    /* Present, DPL 0, available 64-bit TSS. */
+    gdt[0] = (limit & 0xffff) | (base & 0xffffff) << 16 | 0x89ULL << 40 |
+             ((limit >> 16) & 0xf) << 48 | ((base >> 24) & 0xff) << 56;
+    gdt[1] = base >> 32;
+    ltr(SEL_CPU_TSS(id));
+}
+
+/* Maps a new kernel stack and returns the address of its top, or
+   0 if memory or slots are exhausted. */
+uintptr_t kstack_alloc(void) {
+    enum intr_level old_level;
+    size_t slot;
+    uint64_t top;
+    int i;
+
+    old_level = intr_disable();
+    spinlock_acquire(&slot_lock);
+    slot = bitmap_scan_and_flip(used_slots, 0, 1, false);
+    spinlock_release(&slot_lock);
+    intr_set_level(old_level);
+    if (slot == BITMAP_ERROR && old_level == INTR_ON) {
+        reclaim_stale_slots();
+        old_level = intr_disable();
+        spinlock_acquire(&slot_lock);
+        slot = bitmap_scan_and_flip(used_slots, 0, 1, false);
+        spinlock_release(&slot_lock);
+        intr_set_level(old_level);
+    }
+    if (slot == BITMAP_ERROR) return 0;
+
+    top = KSTACK_BASE + (slot + 1) * SLOT_SIZE;
+    lock_acquire(&map_lock);
+    for (i = 1; i <= kstack_pages; i++) {
+        void* page = palloc_get_page(0);
+        uint64_t* pte;
+
+        if (page == NULL) break;
+        pte = pml4e_walk(base_pml4, top - i * PGSIZE, 1);
+        if (pte == NULL) {
+            palloc_free_page(page);
+            break;
+        }
+        *pte = vtop(page) | PTE_P | PTE_W;
+    }
+    lock_release(&map_lock);
+
+    if (i <= kstack_pages) {
+        /* Out of memory: unmap what we mapped. */
+        while (--i >= 1) {
+            uint64_t* pte = stack_pte(top - i * PGSIZE);
+
+            palloc_free_page(ptov(PTE_ADDR(*pte)));
+            *pte = 0;
+        }
+        old_level = intr_disable();
+        spinlock_acquire(&slot_lock);
+        bitmap_reset(used_slots, slot);
+        spinlock_release(&slot_lock);
+        intr_set_level(old_level);
+        return 0;
+    }
+    return top;
+}
+
+/* Unmaps and frees the kernel stack whose top is TOP.  The slot
+   is not reused until other CPUs' TLBs have been flushed. */
+void kstack_free(uintptr_t top) {
+    enum intr_level old_level;
+    size_t slot = (top - KSTACK_BASE) / SLOT_SIZE - 1;
+
+    ASSERT(top > KSTACK_BASE && (top - KSTACK_BASE) % SLOT_SIZE == 0);
+
+    for (int i = 1; i <= kstack_pages; i++) {
+        uint64_t va = top - i * PGSIZE;
+        uint64_t* pte = stack_pte(va);
+
+        palloc_free_page(ptov(PTE_ADDR(*pte)));
+        *pte = 0;
+        invlpg(va);
+    }
+
+    old_level = intr_disable();
+    spinlock_acquire(&slot_lock);
+    ASSERT(bitmap_test(used_slots, slot));
+    bitmap_mark(stale_slots, slot);
+    spinlock_release(&slot_lock);
+    intr_set_level(old_level);
+}
+
+/* Panics with a diagnostic if ADDR, the address of a fault F
+   took, is in the unmapped part of a kernel stack slot. */
+void kstack_check_fault(struct intr_frame* f, uint64_t addr) {
+    struct thread* t = this_cpu_thread();
+    uint64_t offset;
+
+    if (addr < KSTACK_BASE || addr >= KSTACK_BASE + KSTACK_SLOT_CNT * SLOT_SIZE) return;
+    offset = (addr - KSTACK_BASE) % SLOT_SIZE;
+    if (offset >= SLOT_SIZE - (uint64_t)kstack_pages * PGSIZE) return;
+
+    printf("Kernel stack overflow: access to %#" PRIx64 " at rip %#" PRIx64 ", ", addr, f->rip);
+    if (t != NULL && addr < t->kstack_top && addr >= t->kstack_top - SLOT_SIZE) {
+        printf("%zu bytes past the end of the %d-page stack of thread %s (tid %d).\n",
+               (size_t)(t->kstack_top - kstack_pages * PGSIZE - addr), kstack_pages, t->name,
+               t->tid);
+        intr_dump_frame(f);
+        PANIC("kernel stack overflow in thread %s", t->name);
+    }
+    printf("below another thread's kernel stack.\n");
+    intr_dump_frame(f);
+    PANIC("kernel stack overflow");
+}
+
+/* Double fault handler, entered on the CPU's own fault stack.
+   An access past the end of a kernel stack leaves no room to
+   deliver the page fault, so it ends up here, with the address
+   that could not be pushed to in CR2. */
+static void double_fault(struct intr_frame* f) {
+    kstack_check_fault(f, rcr2());
+    kstack_check_fault(f, f->rsp);
+    intr_dump_frame(f);
+    PANIC("double fault");
+}
+
+/* Makes the slots that are stale now usable again, once no TLB
+   can still map them.  Interrupts must be on. */
+static void reclaim_stale_slots(void) {
+    enum intr_level old_level;
+    size_t slot;
+
+    lock_acquire(&map_lock);
+    old_level = intr_disable();
+    spinlock_acquire(&slot_lock);
+    while ((slot = bitmap_scan_and_flip(stale_slots, 0, 1, true)) != BITMAP_ERROR)
+        bitmap_mark(flushing_slots, slot);
+    spinlock_release(&slot_lock);
+    intr_set_level(old_level);
+
+    mp_tlb_shootdown();
+
+    old_level = intr_disable();
+    spinlock_acquire(&slot_lock);
+    while ((slot = bitmap_scan_and_flip(flushing_slots, 0, 1, true)) != BITMAP_ERROR)
+        bitmap_reset(used_slots, slot);
+    spinlock_release(&slot_lock);
+    intr_set_level(old_level);
+    lock_release(&map_lock);
+}
+
+/* Returns the page table entry mapping stack page VA. */
+static uint64_t* stack_pte(uint64_t va) {
+    uint64_t* pte = pml4e_walk(base_pml4, va, 0);
+
+    ASSERT(pte != NULL && (*pte & PTE_P));
+    return pte;
+}
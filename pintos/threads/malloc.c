@@ -7,13 +7,14 @@
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
+   The size of each request, in bytes, is rounded up to the next
+   of a fixed set of block sizes and assigned to the "descriptor"
+   that manages blocks of that size.  The descriptor keeps a list of free blocks.  If
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
@@ -28,11 +29,54 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
+   We can't handle blocks bigger than about 2 kB using this
+   scheme, because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the descriptors sits a magazine layer.  Each
+   thread keeps, per descriptor, up to two "magazines" of blocks
+   it freed, and allocates from them and frees into them without
+   locking anything, since no other thread touches them.  Only
+   when both are empty (or full) does it take the descriptor's
+   lock, to trade a whole magazine with the descriptor's "depot"
+   of full and empty magazines.  The depot holds at most
+   DEPOT_MAX magazines of each kind; full ones beyond that have
+   their blocks returned to their arenas, and a thread's
+   magazines are emptied the same way when it exits, so that
+   arenas can still be freed.
+
+   realloc() keeps a block where it is if the new size still fits
+   it, and resizes a big block by freeing or taking pages at its
+   end, when the page allocator has them free.  Either way, the
+   statistics count it as an allocation of the new size, the same
+   as when it moves the block. */
+
+/* Block sizes.  Between powers of 2 are the sizes halfway to the
+   next, so that no block is more than a third unused, and sizes
+   that fit some common kernel objects tightly: 576 for struct
+   inode, 1344 so that three fit in an arena, which keeps an
+   object just over 1 KB from taking half a page, and 2032 so
+   that two do. */
+static const size_t block_sizes[] = {
+	16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 576, 768, 1024,
+	1344, 2032,
+};
+
+/* Blocks per magazine, chosen so that a magazine fills a
+   128-byte block. */
+#define MAG_ROUNDS 13
+
+/* Most full, and most empty, magazines a depot keeps. */
+#define DEPOT_MAX 4
+
+/* Magazine. */
+struct magazine {
+	struct list_elem elem;      /* Depot list element. */
+	size_t cnt;                 /* Number of blocks in ROUNDS. */
+	void *rounds[MAG_ROUNDS];   /* Blocks. */
+};
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +84,16 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+
+	/* Depot, protected by LOCK. */
+	struct list full_mags;      /* Full magazines. */
+	struct list empty_mags;     /* Empty magazines. */
+	size_t full_mag_cnt;        /* Length of FULL_MAGS. */
+	size_t empty_mag_cnt;       /* Length of EMPTY_MAGS. */
+
+	/* Statistics. */
+	long long allocs;           /* Blocks allocated by malloc(). */
+	long long requested;        /* Bytes requested for them. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -58,24 +112,70 @@ struct block {
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
+static struct desc *mag_desc;   /* Descriptor magazines come from. */
+
+/* Big block statistics. */
+static long long big_allocs;    /* Big blocks allocated by malloc(). */
+static long long big_requested; /* Bytes requested for them. */
+static long long big_reserved;  /* Bytes of pages they took. */
+
+static struct desc *size_to_desc (size_t);
+static bool resize_in_place (void *, size_t new_size);
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_alloc (struct desc *);
+static void desc_free (struct desc *, struct block *);
+static struct block *mag_alloc (struct desc *);
+static bool mag_free (struct desc *, struct block *);
+static struct magazine *mag_create (void);
+static void mag_destroy (struct magazine *);
+static void mag_empty (struct desc *, struct magazine *);
+static bool depot_reclaim (void);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) {
-	size_t block_size;
+	size_t i;
 
-	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+	for (i = 0; i < sizeof block_sizes / sizeof *block_sizes; i++) {
+		size_t block_size = block_sizes[i];
 		struct desc *d = &descs[desc_cnt++];
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+		ASSERT (i == 0 || block_size > block_sizes[i - 1]);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+		ASSERT (d->blocks_per_arena >= 2);
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+		list_init (&d->full_mags);
+		list_init (&d->empty_mags);
+		if (mag_desc == NULL && block_size >= sizeof (struct magazine))
+			mag_desc = d;
+	}
+	ASSERT (mag_desc != NULL);
+}
+
+/* Returns the running thread's cached blocks to their arenas and
+   frees its magazines.  Called when a thread exits. */
+void
+malloc_drain (void) {
+	struct thread *t = thread_current ();
+	size_t i;
+
+	for (i = 0; i < desc_cnt; i++) {
+		struct malloc_mags *mm = &t->mags[i];
+		struct magazine *m[2] = { mm->loaded, mm->prev };
+		size_t j;
+
+		mm->loaded = mm->prev = NULL;
+		for (j = 0; j < 2; j++)
+			if (m[j] != NULL) {
+				mag_empty (&descs[i], m[j]);
+				mag_destroy (m[j]);
+			}
 	}
 }
 
@@ -91,16 +191,14 @@ malloc (size_t size) {
 	if (size == 0)
 		return NULL;
 
-	/* Find the smallest descriptor that satisfies a SIZE-byte
-	   request. */
-	for (d = descs; d < descs + desc_cnt; d++)
-		if (d->block_size >= size)
-			break;
-	if (d == descs + desc_cnt) {
+	d = size_to_desc (size);
+	if (d == NULL) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
 		a = palloc_get_multiple (0, page_cnt);
+		if (a == NULL && depot_reclaim ())
+			a = palloc_get_multiple (0, page_cnt);
 		if (a == NULL)
 			return NULL;
 
@@ -109,37 +207,27 @@ malloc (size_t size) {
 		a->magic = ARENA_MAGIC;
 		a->desc = NULL;
 		a->free_cnt = page_cnt;
+		__atomic_fetch_add (&big_allocs, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add (&big_requested, size, __ATOMIC_RELAXED);
+		__atomic_fetch_add (&big_reserved, page_cnt * PGSIZE, __ATOMIC_RELAXED);
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
-
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	__atomic_fetch_add (&d->allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&d->requested, size, __ATOMIC_RELAXED);
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
-
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
+	b = mag_alloc (d);
+	if (b == NULL) {
+		lock_acquire (&d->lock);
+		b = desc_alloc (d);
+		lock_release (&d->lock);
+	}
+	if (b == NULL && depot_reclaim ()) {
+		/* Blocks cached in depots may have freed some arenas. */
+		lock_acquire (&d->lock);
+		b = desc_alloc (d);
+		lock_release (&d->lock);
 	}
-
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
-	lock_release (&d->lock);
 	return b;
 }
 
@@ -184,9 +272,13 @@ realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
 		free (old_block);
 		return NULL;
+	} else if (old_block == NULL) {
+		return malloc (new_size);
+	} else if (resize_in_place (old_block, new_size)) {
+		return old_block;
 	} else {
 		void *new_block = malloc (new_size);
-		if (old_block != NULL && new_block != NULL) {
+		if (new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
@@ -196,6 +288,43 @@ realloc (void *old_block, size_t new_size) {
 	}
 }
 
+/* Tries to make BLOCK hold NEW_SIZE bytes without moving it.  A
+   block from a descriptor stays put if NEW_SIZE fits and would
+   not fit a block half its size.  A big block that stays big
+   gives back pages at its end, or takes the pages just past it,
+   if they are free.  Returns true if successful. */
+static bool
+resize_in_place (void *block, size_t new_size) {
+	struct arena *a = block_to_arena (block);
+	struct desc *new_d = size_to_desc (new_size);
+
+	if (a->desc != NULL) {
+		struct desc *d = a->desc;
+
+		if (new_d == NULL || new_size > d->block_size
+				|| new_d->block_size * 2 <= d->block_size)
+			return false;
+		__atomic_fetch_add (&d->allocs, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add (&d->requested, new_size, __ATOMIC_RELAXED);
+		return true;
+	} else if (new_d == NULL) {
+		size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+		if (page_cnt < a->free_cnt)
+			palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+					a->free_cnt - page_cnt);
+		else if (page_cnt > a->free_cnt
+				&& !palloc_extend (a, a->free_cnt, page_cnt))
+			return false;
+		a->free_cnt = page_cnt;
+		__atomic_fetch_add (&big_allocs, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add (&big_requested, new_size, __ATOMIC_RELAXED);
+		__atomic_fetch_add (&big_reserved, page_cnt * PGSIZE, __ATOMIC_RELAXED);
+		return true;
+	}
+	return false;
+}
+
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void
@@ -213,24 +342,11 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			if (!mag_free (d, b)) {
+				lock_acquire (&d->lock);
+				desc_free (d, b);
+				lock_release (&d->lock);
 			}
-
-			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +355,40 @@ free (void *p) {
 	}
 }
 
+/* Prints, for each block size, how many bytes malloc() was asked
+   for and how many it set aside. */
+void
+malloc_print_stats (void) {
+	size_t i;
+
+	for (i = 0; i < desc_cnt; i++) {
+		struct desc *d = &descs[i];
+		long long reserved = d->allocs * (long long) d->block_size;
+
+		if (d->allocs == 0)
+			continue;
+		printf ("Malloc: %zu-byte blocks: %lld allocs, %lld bytes requested, "
+				"%lld reserved (%lld%% used)\n", d->block_size, d->allocs,
+				d->requested, reserved, d->requested * 100 / reserved);
+	}
+	if (big_allocs > 0)
+		printf ("Malloc: big blocks: %lld allocs, %lld bytes requested, "
+				"%lld reserved (%lld%% used)\n", big_allocs, big_requested,
+				big_reserved, big_requested * 100 / big_reserved);
+}
+
+/* Returns the descriptor of the smallest blocks that hold SIZE
+   bytes, or a null pointer if SIZE needs a big block. */
+static struct desc *
+size_to_desc (size_t size) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= size)
+			return d;
+	return NULL;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -266,3 +416,232 @@ arena_to_block (struct arena *a, size_t idx) {
 			+ sizeof *a
 			+ idx * a->desc->block_size);
 }
+
+/* Takes a block from descriptor D's arenas, creating a new
+   arena if none has a free block, and returns it.  Returns a
+   null pointer if memory is not available.  D's lock must be
+   held. */
+static struct block *
+desc_alloc (struct desc *d) {
+	struct block *b;
+	struct arena *a;
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* If the free list is empty, create a new arena. */
+	if (list_empty (&d->free_list)) {
+		size_t i;
+
+		/* Allocate a page. */
+		a = palloc_get_page (0);
+		if (a == NULL)
+			return NULL;
+
+		/* Initialize arena and add its blocks to the free list. */
+		a->magic = ARENA_MAGIC;
+		a->desc = d;
+		a->free_cnt = d->blocks_per_arena;
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_push_back (&d->free_list, &b->free_elem);
+		}
+	}
+
+	/* Get a block from free list and return it. */
+	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+	a = block_to_arena (b);
+	a->free_cnt--;
+	return b;
+}
+
+/* Returns block B to its arena in descriptor D, freeing the
+   arena if it is now entirely unused.  D's lock must be held. */
+static void
+desc_free (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		palloc_free_page (a);
+	}
+}
+
+/* Takes a block of descriptor D from the running thread's
+   magazines, reloading them from D's depot if both are empty.
+   Returns a null pointer if there is none there either. */
+static struct block *
+mag_alloc (struct desc *d) {
+	struct malloc_mags *mm = &thread_current ()->mags[d - descs];
+	struct magazine *full = NULL;
+	struct magazine *extra = NULL;
+
+	/* Fast path. */
+	if (mm->loaded != NULL && mm->loaded->cnt > 0)
+		return mm->loaded->rounds[--mm->loaded->cnt];
+	if (mm->prev != NULL && mm->prev->cnt > 0) {
+		struct magazine *m = mm->prev;
+		mm->prev = mm->loaded;
+		mm->loaded = m;
+		return m->rounds[--m->cnt];
+	}
+
+	/* Both empty: trade one for a full magazine from the depot. */
+	lock_acquire (&d->lock);
+	if (!list_empty (&d->full_mags)) {
+		full = list_entry (list_pop_front (&d->full_mags),
+				struct magazine, elem);
+		d->full_mag_cnt--;
+		if (mm->prev != NULL) {
+			if (d->empty_mag_cnt < DEPOT_MAX) {
+				list_push_front (&d->empty_mags, &mm->prev->elem);
+				d->empty_mag_cnt++;
+			} else
+				extra = mm->prev;
+		}
+		mm->prev = mm->loaded;
+		mm->loaded = full;
+	}
+	lock_release (&d->lock);
+
+	if (extra != NULL)
+		mag_destroy (extra);
+	if (full == NULL)
+		return NULL;
+	return full->rounds[--full->cnt];
+}
+
+/* Puts block B of descriptor D into the running thread's
+   magazines, trading a full one to D's depot for an empty one if
+   both are full.  Returns false if B could not be cached because
+   no magazine could be had. */
+static bool
+mag_free (struct desc *d, struct block *b) {
+	struct malloc_mags *mm = &thread_current ()->mags[d - descs];
+	struct magazine *empty = NULL;
+
+	/* Fast path. */
+	if (mm->loaded != NULL && mm->loaded->cnt < MAG_ROUNDS) {
+		mm->loaded->rounds[mm->loaded->cnt++] = b;
+		return true;
+	}
+	if (mm->prev != NULL && mm->prev->cnt < MAG_ROUNDS) {
+		struct magazine *m = mm->prev;
+		mm->prev = mm->loaded;
+		mm->loaded = m;
+		m->rounds[m->cnt++] = b;
+		return true;
+	}
+
+	/* Both full: trade one for an empty magazine from the depot. */
+	lock_acquire (&d->lock);
+	if (mm->prev != NULL && d->full_mag_cnt < DEPOT_MAX) {
+		list_push_front (&d->full_mags, &mm->prev->elem);
+		d->full_mag_cnt++;
+		mm->prev = NULL;
+	}
+	if (!list_empty (&d->empty_mags)) {
+		empty = list_entry (list_pop_front (&d->empty_mags),
+				struct magazine, elem);
+		d->empty_mag_cnt--;
+	}
+	lock_release (&d->lock);
+
+	/* The depot is full: return the blocks to their arenas. */
+	if (mm->prev != NULL) {
+		mag_empty (d, mm->prev);
+		if (empty == NULL)
+			empty = mm->prev;
+		else
+			mag_destroy (mm->prev);
+		mm->prev = NULL;
+	}
+
+	if (empty == NULL) {
+		empty = mag_create ();
+		if (empty == NULL)
+			return false;
+	}
+	mm->prev = mm->loaded;
+	mm->loaded = empty;
+	empty->rounds[empty->cnt++] = b;
+	return true;
+}
+
+/* Returns a new empty magazine, or a null pointer if memory is
+   not available.  Magazines bypass the magazine layer. */
+static struct magazine *
+mag_create (void) {
+	struct magazine *m;
+
+	lock_acquire (&mag_desc->lock);
+	m = (struct magazine *) desc_alloc (mag_desc);
+	lock_release (&mag_desc->lock);
+	if (m != NULL)
+		m->cnt = 0;
+	return m;
+}
+
+/* Frees magazine M, which must be empty. */
+static void
+mag_destroy (struct magazine *m) {
+	ASSERT (m->cnt == 0);
+
+	lock_acquire (&mag_desc->lock);
+	desc_free (mag_desc, (struct block *) m);
+	lock_release (&mag_desc->lock);
+}
+
+/* Returns the blocks in magazine M to their arenas in descriptor
+   D, leaving M empty. */
+static void
+mag_empty (struct desc *d, struct magazine *m) {
+	lock_acquire (&d->lock);
+	while (m->cnt > 0)
+		desc_free (d, m->rounds[--m->cnt]);
+	lock_release (&d->lock);
+}
+
+/* Empties every depot, returning the blocks in its magazines to
+   their arenas and freeing the magazines, so that unused arenas
+   go back to the page allocator.  Returns true if there was
+   anything to free. */
+static bool
+depot_reclaim (void) {
+	bool freed = false;
+	size_t i;
+
+	for (i = 0; i < desc_cnt; i++) {
+		struct desc *d = &descs[i];
+		struct list mags;
+
+		list_init (&mags);
+		lock_acquire (&d->lock);
+		while (!list_empty (&d->full_mags))
+			list_push_back (&mags, list_pop_front (&d->full_mags));
+		while (!list_empty (&d->empty_mags))
+			list_push_back (&mags, list_pop_front (&d->empty_mags));
+		d->full_mag_cnt = d->empty_mag_cnt = 0;
+		lock_release (&d->lock);
+
+		while (!list_empty (&mags)) {
+			struct magazine *m = list_entry (list_pop_front (&mags),
+					struct magazine, elem);
+			mag_empty (d, m);
+			mag_destroy (m);
+			freed = true;
+		}
+	}
+	return freed;
+}
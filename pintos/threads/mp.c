@@ -0,0 +1,346 @@
+#include "threads/mp.h"
+
+#include <debug.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/kstack.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/syscall.h"
+#endif
+
+/* Model-specific registers holding the %gs base.  `swapgs'
+   exchanges the two. */
+#define MSR_GS_BASE 0xc0000101
+#define MSR_KERNEL_GS_BASE 0xc0000102
+
+/* Physical address the AP start-up code is copied to.  Must
+   match mpentry.S. */
+#define MPENTRY_PADDR 0x8000
+
+struct cpu cpus[CPU_MAX];
+int cpu_cnt;
+int cpu_online_cnt;
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fp {
+    char signature[4];   /* "_MP_". */
+    uint32_t config;     /* Physical address of mp_config. */
+    uint8_t length;      /* In 16-byte units. */
+    uint8_t spec_rev;    /* [MP] version. */
+    uint8_t checksum;    /* Makes all bytes sum to 0. */
+    uint8_t type;        /* Default configuration type. */
+    uint8_t imcrp;       /* Bit 7: IMCR present. */
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config {
+    char signature[4];   /* "PCMP". */
+    uint16_t length;     /* Including the header. */
+    uint8_t version;     /* [MP] version. */
+    uint8_t checksum;    /* Makes all bytes sum to 0. */
+    char product[20];    /* OEM and product ID. */
+    uint32_t oem_table;  /* Physical address of OEM table. */
+    uint16_t oem_length; /* Size of OEM table. */
+    uint16_t entry_cnt;  /* # of entries after the header. */
+    uint32_t lapic_addr; /* Physical address of local APICs. */
+    uint16_t xlength;    /* Extended table length. */
+    uint8_t xchecksum;   /* Extended table checksum. */
+    uint8_t reserved;
+} __attribute__((packed));
+
+/* Configuration table entry types and the processor and I/O
+   APIC entries.  See [MP] 4.3. */
+enum mp_entry_type {
+    MP_PROC = 0x00,   /* One per processor, 20 bytes. */
+    MP_BUS = 0x01,    /* 8 bytes. */
+    MP_IOAPIC = 0x02, /* 8 bytes. */
+    MP_IOINTR = 0x03, /* 8 bytes. */
+    MP_LINTR = 0x04,  /* 8 bytes. */
+};
+
+struct mp_proc {
+    uint8_t type;       /* MP_PROC. */
+    uint8_t apic_id;    /* Local APIC ID. */
+    uint8_t version;    /* Local APIC version. */
+    uint8_t flags;      /* See below. */
+    uint8_t signature[4];
+    uint32_t features;
+    uint8_t reserved[8];
+} __attribute__((packed));
+
+#define MP_PROC_ENABLED 0x01 /* Processor is usable. */
+#define MP_PROC_BSP 0x02     /* Processor is the BSP. */
+
+struct mp_ioapic {
+    uint8_t type;    /* MP_IOAPIC. */
+    uint8_t apic_id; /* I/O APIC ID. */
+    uint8_t version; /* I/O APIC version. */
+    uint8_t flags;   /* Bit 0: usable. */
+    uint32_t addr;   /* Physical address. */
+} __attribute__((packed));
+
+/* What mp_init() found, for the boot messages. */
+static uint64_t lapic_paddr;
+static uint64_t ioapic_paddr;
+static int ioapic_cnt;
+
+/* The AP being started, and the GDT it should load. */
+static struct cpu* volatile booting_cpu;
+static struct desc_ptr ap_gdt_desc;
+
+/* Set up for each AP by mp_start_aps() before it is started.
+   See mpentry.S. */
+extern char mpentry_start[], mpentry_end[], mpentry_boot_cr3[];
+extern uint64_t mp_ap_cr3, mp_ap_stack;
+extern char boot_pml4e[];
+
+/* TLB shootdown state.  The lock serializes shootdowns; the
+   counter is the number of CPUs that have yet to flush. */
+static struct spinlock shootdown_lock;
+static volatile int shootdown_pending;
+
+void ap_main(void) NO_RETURN;
+static intr_handler_func ipi_reschedule;
+static intr_handler_func ipi_tlb_shootdown;
+
+/* Sets up the boot processor's `struct cpu' and points %gs at
+   it.  Must run before anything calls this_cpu(), which includes
+   intr_context() and so printf(). */
+void mp_bsp_init(void) {
+    struct cpu* c = &cpus[0];
+
+    c->self = c;
+    c->id = 0;
+    c->started = true;
+    cpu_cnt = cpu_online_cnt = 1;
+
+    write_msr(MSR_GS_BASE, (uint64_t)c);
+    write_msr(MSR_KERNEL_GS_BASE, 0);
+}
+
+/* Returns the sum of the LEN bytes at ADDR. */
+static uint8_t sum(const void* addr, size_t len) {
+    const uint8_t* p = addr;
+    uint8_t s = 0;
+
+    while (len-- > 0) s += *p++;
+    return s;
+}
+
+/* Searches for an MP floating pointer structure in the LEN
+   bytes at physical address PADDR. */
+static struct mp_fp* search_fp(uint64_t paddr, size_t len) {
+    uint8_t* p = ptov(paddr);
+    uint8_t* end = p + len;
+
+    for (; p + sizeof(struct mp_fp) <= end; p += sizeof(struct mp_fp))
+        if (!memcmp(p, "_MP_", 4) && sum(p, sizeof(struct mp_fp)) == 0) return (struct mp_fp*)p;
+    return NULL;
+}
+
+/* Finds the MP floating pointer structure, which [MP] 4 places
+   in the first kB of the EBDA, the last kB of base memory, or
+   the BIOS ROM between 0xf0000 and 0xfffff. */
+static struct mp_fp* find_fp(void) {
+    uint8_t* bda = ptov(0x400);
+    uint64_t paddr;
+    struct mp_fp* fp;
+
+    paddr = (uint64_t)(bda[0x0f] << 8 | bda[0x0e]) << 4;
+    if (paddr != 0 && (fp = search_fp(paddr, 1024)) != NULL) return fp;
+
+    paddr = (uint64_t)(bda[0x14] << 8 | bda[0x13]) * 1024;
+    if (paddr >= 1024 && (fp = search_fp(paddr - 1024, 1024)) != NULL) return fp;
+
+    return search_fp(0xf0000, 0x10000);
+}
+
+/* Finds the CPUs and APICs described by the MP tables, enables
+   the BSP's local APIC and installs the IPI handlers.  Without
+   MP tables the machine is treated as a uniprocessor. */
+void mp_init(void) {
+    struct mp_fp* fp = find_fp();
+    struct mp_config* conf;
+    uint8_t *p, *end;
+
+    spinlock_init(&shootdown_lock);
+
+    if (fp == NULL || fp->config == 0) return;
+    conf = ptov(fp->config);
+    if (memcmp(conf->signature, "PCMP", 4) || sum(conf, conf->length) != 0) return;
+
+    lapic_paddr = conf->lapic_addr != 0 ? conf->lapic_addr : LAPIC_DEFAULT_PADDR;
+    p = (uint8_t*)(conf + 1);
+    end = (uint8_t*)conf + conf->length;
+    while (p < end) {
+        switch (*p) {
+            case MP_PROC: {
+                struct mp_proc* proc = (struct mp_proc*)p;
+                p += sizeof *proc;
+                if (!(proc->flags & MP_PROC_ENABLED)) break;
+                if (proc->flags & MP_PROC_BSP)
+                    cpus[0].apic_id = proc->apic_id;
+                else if (cpu_cnt < CPU_MAX) {
+                    struct cpu* c = &cpus[cpu_cnt];
+                    c->self = c;
+                    c->id = cpu_cnt++;
+                    c->apic_id = proc->apic_id;
+                }
+                break;
+            }
+            case MP_IOAPIC: {
+                struct mp_ioapic* ioapic = (struct mp_ioapic*)p;
+                p += sizeof *ioapic;
+                if (ioapic_cnt++ == 0) ioapic_paddr = ioapic->addr;
+                break;
+            }
+            case MP_BUS:
+            case MP_IOINTR:
+            case MP_LINTR:
+                p += 8;
+                break;
+            default:
+                printf("MP: unknown configuration entry type %#x\n", *p);
+                cpu_cnt = 1;
+                return;
+        }
+    }
+
+    /* Device interrupts keep going through the 8259A PICs to the
+       BSP; the local APICs are used for inter-processor
+       interrupts and timers only. */
+    lapic_map(lapic_paddr);
+    lapic_init();
+    intr_register_ext(IPI_RESCHEDULE, ipi_reschedule, "Reschedule IPI");
+    intr_register_ext(IPI_TLB_SHOOTDOWN, ipi_tlb_shootdown, "TLB shootdown IPI");
+
+    printf("MP: %d CPU(s), local APIC at %#llx, %d I/O APIC(s) at %#llx\n", cpu_cnt, lapic_paddr,
+           ioapic_cnt, ioapic_paddr);
+}
+
+/* Starts every AP found by mp_init(), one at a time, and waits
+   for each to check in.  Must be called with interrupts on, after
+   timer_calibrate(). */
+void mp_start_aps(void) {
+    uint8_t* code = ptov(MPENTRY_PADDR);
+
+    ASSERT(intr_get_level() == INTR_ON);
+    if (cpu_cnt < 2) return;
+
+    memcpy(code, mpentry_start, mpentry_end - mpentry_start);
+    *(uint32_t*)(code + (mpentry_boot_cr3 - mpentry_start)) = vtop(boot_pml4e);
+    asm volatile("sgdt %0" : "=m"(ap_gdt_desc));
+
+    for (int i = 1; i < cpu_cnt; i++) {
+        struct cpu* c = &cpus[i];
+        struct thread* idle = thread_create_ap_idle(c);
+
+        if (idle == NULL) {
+            printf("MP: out of memory starting CPU %d\n", c->id);
+            break;
+        }
+
+        booting_cpu = c;
+        mp_ap_cr3 = vtop(base_pml4);
+        mp_ap_stack = idle->kstack_top;
+        barrier();
+        lapic_start_ap(c->apic_id, MPENTRY_PADDR);
+
+        /* Give the AP up to 100 ms to come up. */
+        for (int ms = 0; ms < 100 && !c->started; ms++) timer_msleep(1);
+        if (c->started)
+            cpu_online_cnt++;
+        else
+            printf("MP: CPU %d (APIC %d) did not start\n", c->id, c->apic_id);
+    }
+    booting_cpu = NULL;
+    printf("MP: %d of %d CPU(s) online\n", cpu_online_cnt, cpu_cnt);
+}
+
+/* C entry point for an AP, called from mpentry.S on the stack of
+   its idle thread. */
+void ap_main(void) {
+    struct cpu* c = booting_cpu;
+
+    write_msr(MSR_GS_BASE, (uint64_t)c);
+    write_msr(MSR_KERNEL_GS_BASE, 0);
+    c->thread = c->idle_thread;
+
+    lgdt(&ap_gdt_desc);
+    asm volatile("movw %%ax, %%ds\n"
+                 "movw %%ax, %%es\n"
+                 "movw %%ax, %%ss\n" ::"a"(SEL_KDSEG));
+    intr_init_ap();
+    kstack_cpu_init();
+    fpu_init_ap();
+#ifdef USERPROG
+    syscall_cpu_init();
+#endif
+    lapic_init();
+    timer_start_ap();
+
+    barrier();
+    c->started = true;
+    thread_ap_idle();
+}
+
+/* Asks CPU C to reschedule. */
+void mp_send_reschedule(struct cpu* c) {
+    ASSERT(c != NULL && c->started);
+    if (c != this_cpu()) lapic_send_ipi(c->apic_id, IPI_RESCHEDULE);
+}
+
+/* Flushes the TLB of this CPU and makes every other online CPU
+   flush its own, and waits until they all have.  Must be called
+   with interrupts on and no spin lock held, so that we can serve
+   another CPU's shootdown while we wait for ours, and so that no
+   CPU is left spinning for a lock of ours with interrupts off,
+   where it could never take our IPI. */
+void mp_tlb_shootdown(void) {
+    ASSERT(intr_get_level() == INTR_ON);
+
+    asm volatile("cli" : : : "memory");
+    if (cpu_online_cnt < 2) {
+        lcr3(rcr3());
+        asm volatile("sti" : : : "memory");
+        return;
+    }
+    while (!spinlock_try_acquire(&shootdown_lock)) {
+        asm volatile("sti; pause; cli" : : : "memory");
+    }
+    lcr3(rcr3());
+    __atomic_store_n(&shootdown_pending, cpu_online_cnt - 1, __ATOMIC_SEQ_CST);
+    lapic_broadcast_ipi(IPI_TLB_SHOOTDOWN);
+    while (__atomic_load_n(&shootdown_pending, __ATOMIC_SEQ_CST) > 0) asm volatile("pause");
+    spinlock_release(&shootdown_lock);
+    asm volatile("sti" : : : "memory");
+}
+
+/* Prints multiprocessor statistics. */
+void mp_print_stats(void) {
+    if (cpu_cnt > 1) printf("MP: %d of %d CPU(s) online\n", cpu_online_cnt, cpu_cnt);
+}
+
+/* Reschedule IPI handler. */
+static void ipi_reschedule(struct intr_frame* f UNUSED) { intr_yield_on_return(); }
+
+/* TLB shootdown IPI handler. */
+static void ipi_tlb_shootdown(struct intr_frame* f UNUSED) {
+    lcr3(rcr3());
+    __atomic_sub_fetch(&shootdown_pending, 1, __ATOMIC_SEQ_CST);
+}
+
@@ -2,12 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,13 +26,54 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
-
-/* A memory pool. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Its free pages form
+   blocks of 2**ORDER pages, each aligned, relative to the pool's
+   base, to its own size, and kept on a free list per order.  An
+   allocation takes the first block on the lowest nonempty list
+   that is big enough, and splits it in halves until it is just
+   big enough, freeing the halves it does not need.  Freeing a
+   block merges it with its "buddy", the other half of the block
+   it was split from, for as long as the buddy is free as well.
+   Both take O(log n) steps, however full or fragmented the pool
+   is.  A request that is not a power of 2 pages long gets the
+   pages beyond its end freed right back.
+
+   The free list links are kept in the free pages themselves.
+
+   Zeroing a page is most of the cost of a PAL_ZERO allocation, so
+   the idle thread zeroes free pages ahead of time, up to
+   ZEROED_MAX per pool, and single-page PAL_ZERO requests take
+   those first.  When a pool runs out of free blocks, its zeroed
+   pages serve any request. */
+
+/* Maximum number of pre-zeroed pages kept per pool. */
+#define ZEROED_MAX 64
+
+/* Number of block orders: the largest block is 2**(ORDER_CNT - 1)
+   pages, 1 GB. */
+#define ORDER_CNT 19
+
+/* In a pool's block_state[], the entry for the first page of a
+   free block is BLOCK_FREE | its order.  Every other entry is 0. */
+#define BLOCK_FREE 0x80
+
+/* A memory pool.  Its members are protected by a spin lock, not
+   a sleeping lock, because a dying thread's pages are freed from inside
+   the scheduler. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
+	struct spinlock lock;           /* Protects the rest. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
+	uint8_t *block_state;           /* Per page: see BLOCK_FREE. */
+	struct list free_list[ORDER_CNT]; /* Free blocks of each order. */
 	uint8_t *base;                  /* Base of pool. */
+
+	struct list zeroed;             /* Pre-zeroed pages, out of the buddy lists. */
+	size_t zeroed_cnt;              /* Pages in ZEROED or being zeroed. */
+	long long zero_hits;            /* PAL_ZERO pages found pre-zeroed. */
+	long long zero_misses;          /* PAL_ZERO pages zeroed on demand. */
+	long long zeroed_total;         /* Pages zeroed by the idle thread. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +85,12 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static bool pool_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zeroed (struct pool *);
+static void release_zeroed (struct pool *);
+static void print_pool_stats (const char *name, const struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -223,12 +272,12 @@ split:
 			page_idx = pg_no (start) - pg_no (pool->base);
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool_free (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool_free (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -262,19 +311,42 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
-
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	enum intr_level old_level;
+	size_t page_idx = BITMAP_ERROR;
+	void *pages = NULL;
+
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
+	if (page_cnt == 1 && (flags & PAL_ZERO))
+		pages = take_zeroed (pool);
+	if (pages == NULL) {
+		page_idx = pool_alloc (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR && !list_empty (&pool->zeroed)) {
+			/* Out of free blocks: fall back on the zeroed pages. */
+			if (page_cnt == 1)
+				pages = take_zeroed (pool);
+			else {
+				release_zeroed (pool);
+				page_idx = pool_alloc (pool, page_cnt);
+			}
+		}
+		if (page_idx != BITMAP_ERROR)
+			pages = pool->base + PGSIZE * page_idx;
+	}
+	if (pages != NULL && page_cnt == 1 && (flags & PAL_ZERO)) {
+		if (page_idx == BITMAP_ERROR)
+			pool->zero_hits++;
+		else
+			pool->zero_misses++;
+	}
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
 
 	if (pages) {
-		if (flags & PAL_ZERO)
+		/* A pre-zeroed page needs only its list link cleared. */
+		if (page_idx == BITMAP_ERROR)
+			memset (pages, 0, sizeof (struct list_elem));
+		else if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
 	} else {
 		if (flags & PAL_ASSERT)
@@ -301,6 +373,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -318,8 +391,12 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool_free (pool, page_idx, page_cnt);
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,23 +405,117 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Tries to grow the PAGE_CNT pages starting at PAGES, obtained
+   from palloc_get_multiple(), to NEW_CNT pages in place, by
+   taking the pages just past their end.  Returns true if
+   successful, false if any of those pages is in use. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt) {
+	struct pool *pool;
+	size_t page_idx;
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (pg_ofs (pages) == 0);
+	ASSERT (new_cnt >= page_cnt);
+
+	if (page_from_pool (&kernel_pool, pages))
+		pool = &kernel_pool;
+	else if (page_from_pool (&user_pool, pages))
+		pool = &user_pool;
+	else
+		NOT_REACHED ();
+
+	page_idx = pg_no (pages) - pg_no (pool->base);
+
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
+	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	success = pool_claim (pool, page_idx + page_cnt, new_cnt - page_cnt);
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
+	return success;
+}
+
+/* Zeroes a free page ahead of time, for a pool with fewer than
+   ZEROED_MAX zeroed pages.  Returns true if it zeroed one, false
+   if there was nothing to do.  Called by the idle thread with
+   interrupts off; turns them on while zeroing. */
+bool
+palloc_zero_idle (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (size_t i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+		size_t page_idx;
+		void *page;
+
+		spinlock_acquire (&pool->lock);
+		page_idx = pool->zeroed_cnt < ZEROED_MAX ? pool_alloc (pool, 1) : BITMAP_ERROR;
+		if (page_idx != BITMAP_ERROR)
+			pool->zeroed_cnt++;
+		spinlock_release (&pool->lock);
+		if (page_idx == BITMAP_ERROR)
+			continue;
+		page = pool->base + PGSIZE * page_idx;
+
+		intr_enable ();
+		memset (page, 0, PGSIZE);
+		intr_disable ();
+
+		spinlock_acquire (&pool->lock);
+		list_push_front (&pool->zeroed, page);
+		pool->zeroed_total++;
+		spinlock_release (&pool->lock);
+		return true;
+	}
+	return false;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	print_pool_stats ("kernel", &kernel_pool);
+	print_pool_stats ("user", &user_pool);
+}
+
+/* Prints the PAL_ZERO hit rate of the pool called NAME. */
+static void
+print_pool_stats (const char *name, const struct pool *pool) {
+	long long requests = pool->zero_hits + pool->zero_misses;
+
+	printf ("Palloc: %s pool: %lld of %lld PAL_ZERO pages pre-zeroed",
+			name, pool->zero_hits, requests);
+	if (requests > 0)
+		printf (" (%lld%%)", pool->zero_hits * 100 / requests);
+	printf (", %lld zeroed while idle\n", pool->zeroed_total);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
+  /* We'll put the pool's used_map and block_state at BM_BASE.
+     Calculate the space needed for them and advance BM_BASE
+     past it. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t state_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->block_state = *bm_base + bm_pages;
 	p->base = (void *) start;
+	spinlock_init (&p->lock);
+	for (int order = 0; order < ORDER_CNT; order++)
+		list_init (&p->free_list[order]);
+	list_init (&p->zeroed);
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	memset (p->block_state, 0, pgcnt);
 
-	*bm_base += bm_pages;
+	*bm_base += bm_pages + state_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +527,165 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the list element kept in the first page of the block at
+   PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx) {
+	return (struct list_elem *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Puts the block of 2**ORDER pages at PAGE_IDX on POOL's free
+   list, without merging. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) {
+	pool->block_state[page_idx] = BLOCK_FREE | order;
+	list_push_front (&pool->free_list[order], block_elem (pool, page_idx));
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX, merging it with
+   its buddy as long as that is free too. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) {
+	size_t page_cnt = bitmap_size (pool->used_map);
+
+	for (; order < ORDER_CNT - 1; order++) {
+		size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+		if (buddy >= page_cnt || pool->block_state[buddy] != (BLOCK_FREE | order))
+			break;
+		list_remove (block_elem (pool, buddy));
+		pool->block_state[buddy] = 0;
+		page_idx &= ~((size_t) 1 << order);
+	}
+	push_block (pool, page_idx, order);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   big enough.  POOL's lock must be held. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt) {
+	int order = 0, k;
+	size_t page_idx;
+
+	ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+	if (page_cnt == 0)
+		return BITMAP_ERROR;
+	while (((size_t) 1 << order) < page_cnt)
+		if (++order == ORDER_CNT)
+			return BITMAP_ERROR;
+
+	for (k = order; k < ORDER_CNT; k++)
+		if (!list_empty (&pool->free_list[k]))
+			break;
+	if (k == ORDER_CNT)
+		return BITMAP_ERROR;
+
+	page_idx = ((uint8_t *) list_pop_front (&pool->free_list[k]) - pool->base)
+		/ PGSIZE;
+	pool->block_state[page_idx] = 0;
+	while (k > order) {
+		k--;
+		push_block (pool, page_idx + ((size_t) 1 << k), k);
+	}
+
+	/* Give back the pages past the end of the request. */
+	pool_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	return page_idx;
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, which need not
+   form a single block: they are freed as the largest aligned
+   blocks that fit.  POOL's lock must be held, except while the
+   pools are set up. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order < ORDER_CNT - 1
+				&& (page_idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates the PAGE_CNT pages at PAGE_IDX in POOL, if all of
+   them are free, taking each free block that holds any of them
+   off its list and freeing its pages outside the range again.
+   Returns true if successful, false if any page is in use or the
+   range runs past the end of the pool.  POOL's lock must be
+   held. */
+static bool
+pool_claim (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t end = page_idx + page_cnt;
+	size_t i;
+
+	ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+	if (end > bitmap_size (pool->used_map)
+			|| !bitmap_none (pool->used_map, page_idx, page_cnt))
+		return false;
+
+	for (i = page_idx; i < end; ) {
+		size_t start, block_end;
+		int order;
+
+		/* Find the free block that holds page I. */
+		for (order = 0; order < ORDER_CNT; order++) {
+			start = i & ~(((size_t) 1 << order) - 1);
+			if (pool->block_state[start] == (BLOCK_FREE | order))
+				break;
+		}
+		ASSERT (order < ORDER_CNT);
+		list_remove (block_elem (pool, start));
+		pool->block_state[start] = 0;
+		block_end = start + ((size_t) 1 << order);
+		bitmap_set_multiple (pool->used_map, start, block_end - start, true);
+
+		/* Only the first block can start before the range, and
+		   only the last can run past it. */
+		if (start < i)
+			pool_free (pool, start, i - start);
+		if (block_end > end)
+			pool_free (pool, end, block_end - end);
+		i = block_end < end ? block_end : end;
+	}
+	return true;
+}
+
+/* Takes a page off POOL's pre-zeroed list and returns it, or
+   returns a null pointer if the list is empty.  Only the page's
+   first bytes, which held the list link, are no longer zero.
+   POOL's lock must be held. */
+static void *
+take_zeroed (struct pool *pool) {
+	ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+	if (list_empty (&pool->zeroed))
+		return NULL;
+	pool->zeroed_cnt--;
+	return list_pop_front (&pool->zeroed);
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free blocks, so
+   that they can be merged for a multi-page request.  POOL's lock
+   must be held. */
+static void
+release_zeroed (struct pool *pool) {
+	ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+	while (!list_empty (&pool->zeroed)) {
+		uint8_t *page = (uint8_t *) list_pop_front (&pool->zeroed);
+
+		pool->zeroed_cnt--;
+		pool_free (pool, (page - pool->base) / PGSIZE, 1);
+	}
+}
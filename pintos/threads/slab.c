@@ -0,0 +1,261 @@
+#include "threads/slab.h"
+
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Colours are this many bytes apart: a cache line. */
+#define COLOUR_STEP 64
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Marks the end of a slab's free object chain. */
+#define FREE_END UINT16_MAX
+
+/* An object cache. */
+struct kmem_cache {
+    const char* name;        /* For statistics. */
+    size_t size;             /* Object size, a multiple of ALIGN. */
+    size_t align;            /* Object alignment. */
+    kmem_ctor_func* ctor;    /* Constructor, or null. */
+    size_t obj_cnt;          /* Objects per slab. */
+    size_t obj_ofs;          /* Offset of first object, before colouring. */
+    size_t colour_cnt;       /* Number of distinct colours. */
+    size_t colour_next;      /* Colour of the next slab. */
+    struct lock lock;        /* Protects everything below. */
+    struct list partial;     /* Slabs with free and used objects. */
+    struct list full;        /* Slabs with no free objects. */
+    struct list empty;       /* At most one slab with no used objects. */
+    struct list_elem elem;   /* In all_caches. */
+
+    /* Statistics. */
+    long long allocs;        /* Objects allocated. */
+    long long frees;         /* Objects freed. */
+    long long slabs_created; /* Pages taken from palloc. */
+    long long slabs_freed;   /* Pages given back. */
+    size_t in_use;           /* Objects allocated now. */
+    size_t peak;             /* Most objects ever allocated at once. */
+};
+
+/* A slab, at the start of its page.  It is followed by OBJ_CNT
+   free chain links, then by the objects.  Free objects are
+   chained through the links, not through the objects, so that
+   constructed state survives a free. */
+struct slab {
+    unsigned magic;          /* Always set to SLAB_MAGIC. */
+    struct kmem_cache* cache; /* Owning cache. */
+    struct list_elem elem;   /* In one of the cache's slab lists. */
+    uint8_t* objs;           /* First object. */
+    size_t in_use;           /* Allocated objects. */
+    uint16_t free;           /* First free object, or FREE_END. */
+    uint16_t next[];         /* Next free object after each free one. */
+};
+
+/* All caches, for statistics.  Caches are only made at boot and
+   never destroyed, so this needs no lock. */
+static struct list all_caches;
+
+static struct slab* slab_create(struct kmem_cache*);
+static struct slab* obj_to_slab(struct kmem_cache*, void* obj);
+
+/* Initializes the object cache allocator.  Must be called
+   before any cache is made. */
+void kmem_init(void) { list_init(&all_caches); }
+
+/* Creates and returns a cache of SIZE-byte objects named NAME,
+   which must stay valid.  Objects are aligned on ALIGN bytes, a
+   power of 2, or on a pointer's size if ALIGN is 0.  If CTOR is
+   nonnull, it is called on every object when its slab is made.
+   Panics if memory is short, since caches are made at boot. */
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align,
+                                     kmem_ctor_func* ctor) {
+    struct kmem_cache* c;
+    size_t n, used;
+
+    if (align == 0) align = sizeof(void*);
+    ASSERT(size > 0);
+    ASSERT(align <= PGSIZE && (align & (align - 1)) == 0);
+
+    c = calloc(1, sizeof *c);
+    if (c == NULL) PANIC("kmem_cache_create: out of memory");
+    c->name = name;
+    c->align = align;
+    c->size = ROUND_UP(size, align);
+    c->ctor = ctor;
+
+    /* Fit as many objects as we can, each with a free chain link. */
+    for (n = (PGSIZE - sizeof(struct slab)) / (c->size + sizeof(uint16_t)); n > 0; n--) {
+        c->obj_ofs = ROUND_UP(sizeof(struct slab) + n * sizeof(uint16_t), align);
+        if (c->obj_ofs + n * c->size <= PGSIZE) break;
+    }
+    if (n == 0) PANIC("kmem_cache_create: %s: %zu-byte objects do not fit in a slab", name, size);
+    c->obj_cnt = n;
+
+    /* Spread the slack at the end of the page over the colours. */
+    used = c->obj_ofs + c->obj_cnt * c->size;
+    c->colour_cnt = (PGSIZE - used) / (align > COLOUR_STEP ? align : COLOUR_STEP) + 1;
+
+    lock_init(&c->lock);
+    list_init(&c->partial);
+    list_init(&c->full);
+    list_init(&c->empty);
+    list_push_back(&all_caches, &c->elem);
+    return c;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available. */
+void* kmem_cache_alloc(struct kmem_cache* c) {
+    struct slab* s;
+    void* obj;
+
+    lock_acquire(&c->lock);
+    if (list_empty(&c->partial)) {
+        if (!list_empty(&c->empty))
+            s = list_entry(list_pop_front(&c->empty), struct slab, elem);
+        else {
+            s = slab_create(c);
+            if (s == NULL) {
+                lock_release(&c->lock);
+                return NULL;
+            }
+        }
+        list_push_front(&c->partial, &s->elem);
+    }
+
+    s = list_entry(list_front(&c->partial), struct slab, elem);
+    ASSERT(s->free != FREE_END);
+    obj = s->objs + s->free * c->size;
+    s->free = s->next[s->free];
+    if (++s->in_use == c->obj_cnt) {
+        list_remove(&s->elem);
+        list_push_front(&c->full, &s->elem);
+    }
+
+    c->allocs++;
+    if (++c->in_use > c->peak) c->peak = c->in_use;
+    lock_release(&c->lock);
+    return obj;
+}
+
+/* Allocates an object from cache C and zeroes it, for caches
+   without a constructor.  Returns a null pointer if memory is
+   not available. */
+void* kmem_cache_zalloc(struct kmem_cache* c) {
+    void* obj;
+
+    ASSERT(c->ctor == NULL);
+
+    obj = kmem_cache_alloc(c);
+    if (obj != NULL) memset(obj, 0, c->size);
+    return obj;
+}
+
+/* Returns OBJ, which must have come from cache C, to C.  Does
+   nothing if OBJ is null. */
+void kmem_cache_free(struct kmem_cache* c, void* obj) {
+    struct slab* s;
+    size_t idx;
+
+    if (obj == NULL) return;
+    s = obj_to_slab(c, obj);
+    idx = ((uint8_t*)obj - s->objs) / c->size;
+
+#ifndef NDEBUG
+    /* Clear the object to help detect use-after-free bugs. */
+    if (c->ctor == NULL) memset(obj, 0xcc, c->size);
+#endif
+
+    lock_acquire(&c->lock);
+    ASSERT(s->in_use > 0);
+    if (s->in_use-- == c->obj_cnt) {
+        list_remove(&s->elem);
+        list_push_front(&c->partial, &s->elem);
+    }
+    s->next[idx] = s->free;
+    s->free = idx;
+
+    /* Keep one empty slab for the next allocation; give back the
+       rest. */
+    if (s->in_use == 0) {
+        list_remove(&s->elem);
+        if (list_empty(&c->empty))
+            list_push_front(&c->empty, &s->elem);
+        else {
+            s->magic = 0;
+            palloc_free_page(s);
+            c->slabs_freed++;
+        }
+    }
+
+    c->frees++;
+    c->in_use--;
+    lock_release(&c->lock);
+}
+
+/* Prints statistics for each cache. */
+void kmem_print_stats(void) {
+    struct list_elem* e;
+
+    for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+        struct kmem_cache* c = list_entry(e, struct kmem_cache, elem);
+
+        printf("Slab: %s: %zu-byte objects, %zu per slab, %zu colours; "
+               "%zu in use (peak %zu), %lld allocs, %lld frees; "
+               "%zu partial, %zu full, %zu empty slabs; "
+               "%lld slabs created, %lld freed\n",
+               c->name, c->size, c->obj_cnt, c->colour_cnt, c->in_use, c->peak, c->allocs,
+               c->frees, list_size(&c->partial), list_size(&c->full), list_size(&c->empty),
+               c->slabs_created, c->slabs_freed);
+    }
+}
+
+/* Makes a new slab for cache C, with every object free and
+   constructed, and returns it without putting it on a list.
+   Returns a null pointer if no page is available.  C's lock must
+   be held. */
+static struct slab* slab_create(struct kmem_cache* c) {
+    struct slab* s;
+    size_t colour;
+
+    ASSERT(lock_held_by_current_thread(&c->lock));
+
+    s = palloc_get_page(0);
+    if (s == NULL) return NULL;
+
+    colour = c->colour_next++ % c->colour_cnt;
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->objs = (uint8_t*)s + c->obj_ofs +
+              colour * (c->align > COLOUR_STEP ? c->align : COLOUR_STEP);
+    s->in_use = 0;
+    s->free = 0;
+    for (size_t i = 0; i < c->obj_cnt; i++) {
+        s->next[i] = i + 1 < c->obj_cnt ? i + 1 : FREE_END;
+        if (c->ctor != NULL) c->ctor(s->objs + i * c->size);
+    }
+    c->slabs_created++;
+    return s;
+}
+
+/* Returns the slab that OBJ, an object of cache C, is in. */
+static struct slab* obj_to_slab(struct kmem_cache* c, void* obj) {
+    struct slab* s = pg_round_down(obj);
+
+    /* Check that the slab is valid and OBJ is an object in it. */
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->cache == c);
+    ASSERT((uint8_t*)obj >= s->objs && ((uint8_t*)obj - s->objs) % c->size == 0);
+    ASSERT(((uint8_t*)obj - s->objs) / c->size < c->obj_cnt);
+
+    return s;
+}
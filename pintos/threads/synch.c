@@ -31,15 +31,53 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/mp.h"
 #include "threads/thread.h"
-
-#define MAX_DEPTH 8
-
-static bool cond_insert_by_priority(struct list_elem* current, struct list_elem* e2,
-                                    void* aux UNUSED);
-static bool donor_higher_priority(struct list_elem* e1, struct list_elem* e2, void* aux UNUSED);
-static bool cond_sema_priority(struct list_elem* a, struct list_elem* b, void* aux UNUSED);
+#include "threads/trace.h"
+
+/* Priority donation.
+
+   A thread waiting for a lock donates its priority to the lock's
+   holder, and, if the holder is itself waiting for a lock, on to
+   that lock's holder, and so on.  To keep this cheap however
+   many threads are involved, each semaphore's waiters are kept
+   in a tree ordered by priority, so that a lock's most urgent
+   waiter is at hand, and each thread keeps the locks it holds in
+   a tree ordered by that waiter's priority.  A thread's effective
+   priority is then the higher of its base priority and the
+   priority of its first held lock's first waiter, found in
+   constant time, and a change in priority is passed along a
+   chain of locks one O(log n) tree update per link.
+
+   A reader-writer lock may have many holders at once.  Each
+   reader has its own hold, so a waiter donates to all of them.
+
+   Locking.  A semaphore's own spin lock protects its value and
+   waiters.  Donation links the locks, reader-writer locks and
+   threads into chains that a single change may walk end to end,
+   so all of that is protected by one spin lock, donation_lock,
+   instead: the semaphores of locks, reader-writer locks, each
+   thread's held_locks, and the waiting_lock, waiting_rwlock and
+   holder pointers.  A thread's waiter_node key may be changed by
+   a donation while the thread waits on a semaphore of either
+   kind; the thread's wait_lock says which spin lock protects the
+   tree it is in, and keeps that tree from going away meanwhile. */
+
+static struct spinlock donation_lock = {.locked = 0, .cpu = NULL};
+
+static bool sema_wait(struct semaphore*, struct spinlock*, int64_t deadline, bool interruptible);
+static void sema_post(struct semaphore*);
+static void waiter_add(struct thread*, struct rb_tree* waiters, struct spinlock*);
+static void waiter_remove(struct thread*);
+static void waited_holds_apply(struct thread*, void (*)(struct rb_tree*, struct rb_node*));
+static struct thread* donation_target(struct thread*);
+static void donation_refresh(struct thread*);
+static int hold_priority(const struct lock_hold*);
+static bool waiter_higher_priority(const struct rb_node*, const struct rb_node*, void* aux);
+static bool hold_higher_priority(const struct rb_node*, const struct rb_node*, void* aux);
+static bool cond_waiter_less(const struct list_elem*, const struct list_elem*, void* aux);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -53,8 +91,9 @@ static bool cond_sema_priority(struct list_elem* a, struct list_elem* b, void* a
 void sema_init(struct semaphore* sema, unsigned value) {
     ASSERT(sema != NULL);
 
+    spinlock_init(&sema->lock);
     sema->value = value;
-    list_init(&sema->waiters);
+    rb_init(&sema->waiters, waiter_higher_priority, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -63,8 +102,7 @@ void sema_init(struct semaphore* sema, unsigned value) {
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but if it sleeps then the next scheduled
-   thread will probably turn interrupts back on. This is
-   sema_down function. */
+   thread will probably turn interrupts back on. */
 void sema_down(struct semaphore* sema) {
     enum intr_level old_level;
 
@@ -72,12 +110,100 @@ void sema_down(struct semaphore* sema) {
     ASSERT(!intr_context());
 
     old_level = intr_disable();
+    spinlock_acquire(&sema->lock);
+    sema_wait(sema, &sema->lock, INT64_MAX, false);
+    spinlock_release(&sema->lock);
+    intr_set_level(old_level);
+}
+
+/* Down or "P" operation on a semaphore, waiting no more than
+   TICKS timer ticks for SEMA's value to become positive.  Returns
+   true if the semaphore is decremented, false if the wait timed
+   out.  If TICKS is not positive, only tries once.  A thread
+   woken in time that loses the semaphore to another waits again
+   only as long as is left of TICKS.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool sema_down_timeout(struct semaphore* sema, int64_t ticks) {
+    enum intr_level old_level;
+    int64_t deadline;
+    bool success;
+
+    ASSERT(sema != NULL);
+    ASSERT(!intr_context());
+
+    deadline = timer_ticks() + ticks;
+    old_level = intr_disable();
+    spinlock_acquire(&sema->lock);
+    success = sema_wait(sema, &sema->lock, deadline, false);
+    spinlock_release(&sema->lock);
+    intr_set_level(old_level);
+    return success;
+}
+
+/* Down or "P" operation on a semaphore, unless the thread is
+   interrupted by thread_interrupt() before or while it waits.
+   Returns true if the semaphore is decremented, false if the
+   wait was interrupted.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool sema_down_interruptible(struct semaphore* sema) {
+    enum intr_level old_level;
+    bool success;
+
+    ASSERT(sema != NULL);
+    ASSERT(!intr_context());
+
+    old_level = intr_disable();
+    spinlock_acquire(&sema->lock);
+    success = sema_wait(sema, &sema->lock, INT64_MAX, true);
+    spinlock_release(&sema->lock);
+    intr_set_level(old_level);
+    return success;
+}
+
+/* Waits for SEMA's value to become positive and decrements it,
+   with SPIN, the spin lock protecting SEMA, held throughout
+   except while asleep.  Gives up once timer_ticks() reaches
+   DEADLINE, unless it is INT64_MAX, or, if INTERRUPTIBLE, once
+   the thread is interrupted, and returns false.  A wait for a
+   lock's semaphore donates the thread's priority to the lock's
+   holder, and giving up takes the donation back. */
+static bool sema_wait(struct semaphore* sema, struct spinlock* spin, int64_t deadline,
+                      bool interruptible) {
+    struct thread* t = thread_current();
+    bool success = true;
+
+    ASSERT(spinlock_held_by_current_cpu(spin));
+
+    if (interruptible) thread_set_interruptible(true);
     while (sema->value == 0) {
-        list_push_front(&sema->waiters, &thread_current()->elem);
-        thread_block();
+        if (interruptible && __atomic_load_n(&t->interrupted, __ATOMIC_SEQ_CST)) {
+            success = false;
+            break;
+        }
+        if (deadline != INT64_MAX && timer_ticks() >= deadline) {
+            success = false;
+            break;
+        }
+
+        /* A timed-out or interrupted wait leaves us among the
+           waiters, and sema_post() takes us out. */
+        if (t->waiting_in == NULL) waiter_add(t, &sema->waiters, spin);
+        if (deadline != INT64_MAX)
+            thread_block_timeout(deadline, spin);
+        else
+            thread_block_locked(spin);
     }
-    sema->value--;
-    intr_set_level(old_level);
+    if (t->waiting_in != NULL) {
+        waiter_remove(t);
+        donation_refresh(donation_target(t));
+    }
+    if (interruptible) thread_set_interruptible(false);
+    if (success) sema->value--;
+    return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -92,18 +218,21 @@ bool sema_try_down(struct semaphore* sema) {
     ASSERT(sema != NULL);
 
     old_level = intr_disable();
+    spinlock_acquire(&sema->lock);
     if (sema->value > 0) {
         sema->value--;
         success = true;
     } else
         success = false;
+    spinlock_release(&sema->lock);
     intr_set_level(old_level);
 
     return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, the one that has waited longest among equals.
 
    This function may be called from an interrupt handler. */
 void sema_up(struct semaphore* sema) {
@@ -112,14 +241,22 @@ void sema_up(struct semaphore* sema) {
     ASSERT(sema != NULL);
 
     old_level = intr_disable();
+    spinlock_acquire(&sema->lock);
+    sema_post(sema);
+    spinlock_release(&sema->lock);
+    intr_set_level(old_level);
+}
+
+/* Increments SEMA's value and wakes its first waiter, if any.
+   The spin lock protecting SEMA must be held. */
+static void sema_post(struct semaphore* sema) {
     sema->value++;
-    if (!list_empty(&sema->waiters)) {
-        struct list_elem* max_elem = list_max(&sema->waiters, thread_priority_max, NULL);
-        list_remove(max_elem);
-        thread_unblock(list_entry(max_elem, struct thread, elem));
-    }
+    if (!rb_empty(&sema->waiters)) {
+        struct thread* t = rb_entry(rb_min(&sema->waiters), struct thread, waiter_node);
 
-    intr_set_level(old_level);
+        waiter_remove(t);
+        thread_unblock(t);
+    }
 }
 
 static void sema_test_helper(void* sema_);
@@ -173,6 +310,8 @@ void lock_init(struct lock* lock) {
 
     lock->holder = NULL;
     sema_init(&lock->semaphore, 1);
+    lock->hold.waiters[0] = &lock->semaphore.waiters;
+    lock->hold.waiters[1] = NULL;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -184,31 +323,66 @@ void lock_init(struct lock* lock) {
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void lock_acquire(struct lock* lock) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+    bool waited;
+
     ASSERT(lock != NULL);
     ASSERT(!intr_context());
     ASSERT(!lock_held_by_current_thread(lock));
 
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    waited = lock->holder != NULL;
+    if (waited) TRACE(TRACE_LOCK_WAIT, lock, 0);
+    t->waiting_lock = lock;
+    sema_wait(&lock->semaphore, &donation_lock, INT64_MAX, false);
+    t->waiting_lock = NULL;
+    TRACE(TRACE_LOCK_ACQUIRE, lock, waited);
+
+    /* Any threads still waiting now donate to us. */
+    lock->holder = t;
+    rb_insert(&t->held_locks, &lock->hold.node);
+    donation_refresh(t);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+}
+
+/* Acquires LOCK like lock_acquire(), but gives up after TICKS
+   timer ticks, taking back the priority donated to the holder
+   meanwhile.  Returns true if LOCK was acquired.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool lock_acquire_timeout(struct lock* lock, int64_t ticks) {
     struct thread* t = thread_current();
-    if (lock->holder != NULL && lock->holder->priority < t->priority) {
-        enum intr_level old = intr_disable();
-        t->waiting_lock = lock;
-        struct thread* cur = lock->holder;
-
-        int depth = 0;
-        while (cur && depth < MAX_DEPTH) {
-            cur->priority = t->priority;
-            if (!cur->waiting_lock) break;
-            cur = cur->waiting_lock->holder;
-            depth++;
-        }
+    enum intr_level old_level;
+    int64_t deadline;
+    bool success, waited;
 
-        list_push_front(&lock->holder->donor_list, &t->donor_elem);
-        intr_set_level(old);
-    }
+    ASSERT(lock != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!lock_held_by_current_thread(lock));
 
-    sema_down(&lock->semaphore);
+    deadline = timer_ticks() + ticks;
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    waited = lock->holder != NULL;
+    if (waited) TRACE(TRACE_LOCK_WAIT, lock, 0);
+    t->waiting_lock = lock;
+    success = sema_wait(&lock->semaphore, &donation_lock, deadline, false);
     t->waiting_lock = NULL;
-    lock->holder = t;
+
+    if (success) {
+        TRACE(TRACE_LOCK_ACQUIRE, lock, waited);
+        lock->holder = t;
+        rb_insert(&t->held_locks, &lock->hold.node);
+        donation_refresh(t);
+    } else if (waited)
+        TRACE(TRACE_LOCK_TIMEOUT, lock, 0);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    return success;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -218,13 +392,23 @@ void lock_acquire(struct lock* lock) {
    This function will not sleep, so it may be called within an
    interrupt handler. */
 bool lock_try_acquire(struct lock* lock) {
+    enum intr_level old_level;
     bool success;
 
     ASSERT(lock != NULL);
     ASSERT(!lock_held_by_current_thread(lock));
 
-    success = sema_try_down(&lock->semaphore);
-    if (success) lock->holder = thread_current();
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    success = lock->semaphore.value > 0;
+    if (success) {
+        TRACE(TRACE_LOCK_ACQUIRE, lock, 0);
+        lock->semaphore.value--;
+        lock->holder = thread_current();
+        rb_insert(&lock->holder->held_locks, &lock->hold.node);
+    }
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
     return success;
 }
 
@@ -235,25 +419,23 @@ bool lock_try_acquire(struct lock* lock) {
    make sense to try to release a lock within an interrupt
    handler. */
 void lock_release(struct lock* lock) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+
     ASSERT(lock != NULL);
     ASSERT(lock_held_by_current_thread(lock));
 
-    struct thread* cur = thread_current();
-    int max_priority = lock->holder->base_priority;
-
-    struct list_elem* e;
-    for (e = list_begin(&cur->donor_list); e != list_end(&cur->donor_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, donor_elem);
-        if (t->waiting_lock == lock) {
-            list_remove(e);
-            continue;
-        }
-        if (t->priority > max_priority) max_priority = t->priority;
-    }
-    lock->holder->priority = max_priority;
-
+    /* Give up what LOCK's waiters donated before letting one of
+       them have it. */
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    TRACE(TRACE_LOCK_RELEASE, lock, 0);
+    rb_remove(&t->held_locks, &lock->hold.node);
     lock->holder = NULL;
-    sema_up(&lock->semaphore);
+    donation_refresh(t);
+    sema_post(&lock->semaphore);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -265,10 +447,574 @@ bool lock_held_by_current_thread(const struct lock* lock) {
     return lock->holder == thread_current();
 }
 
+static struct rwlock_reader* rwlock_reader_of(const struct thread*, const struct rwlock*);
+static void rwlock_grant_read(struct rwlock*, struct thread*);
+static void rwlock_grant_write(struct rwlock*, struct thread*);
+static struct thread* rwlock_pop(struct rb_tree* waiters);
+static void rwlock_wake(struct rwlock*);
+
+/* Initializes RW.  A reader-writer lock can be held by any number
+   of readers at once, or by a single writer.  It suits data that
+   is looked up much more often than it is changed.
+
+   A thread that arrives to read while a writer is waiting waits
+   too, so that a steady stream of readers cannot starve writers.
+   Threads waiting for RW donate their priority to all of its
+   holders.  A reader-writer lock is not recursive: a thread must
+   not acquire it again, in either mode, while holding it. */
+void rwlock_init(struct rwlock* rw) {
+    ASSERT(rw != NULL);
+
+    rw->writer = NULL;
+    list_init(&rw->readers);
+    rb_init(&rw->read_waiters, waiter_higher_priority, NULL);
+    rb_init(&rw->write_waiters, waiter_higher_priority, NULL);
+    rw->write_hold.waiters[0] = &rw->read_waiters;
+    rw->write_hold.waiters[1] = &rw->write_waiters;
+    rw->upgrader = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no thread holds it or
+   waits to hold it for writing.  A thread may hold at most
+   RWLOCK_READ_MAX reader-writer locks for reading at a time.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_read(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!rwlock_held_by_current_thread(rw));
+    /* Checked here, in the caller, since the hold may be granted
+       by the thread that wakes us.  Nothing else can take the
+       free slot while we wait. */
+    ASSERT(rwlock_reader_of(t, NULL) != NULL);
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    if (rw->writer == NULL && rb_empty(&rw->write_waiters))
+        rwlock_grant_read(rw, t);
+    else {
+        /* Whoever wakes us hands RW over. */
+        t->waiting_rwlock = rw;
+        waiter_add(t, &rw->read_waiters, &donation_lock);
+        while (t->waiting_rwlock != NULL) thread_block_locked(&donation_lock);
+    }
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_write(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!rwlock_held_by_current_thread(rw));
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    if (rw->writer == NULL && list_empty(&rw->readers))
+        rwlock_grant_write(rw, t);
+    else {
+        t->waiting_rwlock = rw;
+        waiter_add(t, &rw->write_waiters, &donation_lock);
+        while (t->waiting_rwlock != NULL) thread_block_locked(&donation_lock);
+    }
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+}
+
+/* Tries to acquire RW for reading without sleeping.  Returns true
+   if successful, false if a writer holds RW or is waiting for it.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool rwlock_try_acquire_read(struct rwlock* rw) {
+    enum intr_level old_level;
+    bool success;
+
+    ASSERT(rw != NULL);
+    ASSERT(!rwlock_held_by_current_thread(rw));
+    ASSERT(rwlock_reader_of(thread_current(), NULL) != NULL);
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    success = rw->writer == NULL && rb_empty(&rw->write_waiters);
+    if (success) rwlock_grant_read(rw, thread_current());
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    return success;
+}
+
+/* Tries to acquire RW for writing without sleeping.  Returns true
+   if successful, false if any other thread holds RW.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool rwlock_try_acquire_write(struct rwlock* rw) {
+    enum intr_level old_level;
+    bool success;
+
+    ASSERT(rw != NULL);
+    ASSERT(!rwlock_held_by_current_thread(rw));
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    success = rw->writer == NULL && list_empty(&rw->readers);
+    if (success) rwlock_grant_write(rw, thread_current());
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    return success;
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void rwlock_release_read(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    struct rwlock_reader* r;
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    r = rwlock_reader_of(t, rw);
+    ASSERT(r != NULL);
+    ASSERT(rw->upgrader != t);
+
+    rb_remove(&t->held_locks, &r->hold.node);
+    list_remove(&r->elem);
+    r->rwlock = NULL;
+    donation_refresh(t);
+    rwlock_wake(rw);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    thread_yield_to_higher();
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void rwlock_release_write(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(rwlock_write_held_by_current_thread(rw));
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    rb_remove(&t->held_locks, &rw->write_hold.node);
+    rw->writer = NULL;
+    donation_refresh(t);
+    rwlock_wake(rw);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    thread_yield_to_higher();
+}
+
+/* Turns the current thread's read hold on RW into a write hold,
+   sleeping until the other readers are gone.
+
+   Returns true if RW was held throughout, so that what the
+   thread read is still valid.  Two readers cannot both upgrade
+   that way, since each would wait for the other, so if another
+   reader is already upgrading, RW is instead released and then
+   acquired for writing, and the return value is false.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool rwlock_upgrade(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    struct rwlock_reader* r;
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    r = rwlock_reader_of(t, rw);
+    ASSERT(r != NULL);
+
+    if (rw->upgrader != NULL) {
+        spinlock_release(&donation_lock);
+        rwlock_release_read(rw);
+        rwlock_acquire_write(rw);
+        intr_set_level(old_level);
+        return false;
+    }
+
+    if (list_size(&rw->readers) == 1) {
+        rb_remove(&t->held_locks, &r->hold.node);
+        list_remove(&r->elem);
+        r->rwlock = NULL;
+        rwlock_grant_write(rw, t);
+    } else {
+        /* Keep our read hold, so that no writer gets in first, but
+           take it out of our holds: waiting to write, we would
+           otherwise donate to ourselves.  The last other reader
+           to leave hands RW over. */
+        rb_remove(&t->held_locks, &r->hold.node);
+        rw->upgrader = t;
+        donation_refresh(t);
+        t->waiting_rwlock = rw;
+        waiter_add(t, &rw->write_waiters, &donation_lock);
+        while (t->waiting_rwlock != NULL) thread_block_locked(&donation_lock);
+    }
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+    return true;
+}
+
+/* Turns the current thread's write hold on RW into a read hold,
+   letting waiting readers in too unless a writer is waiting. */
+void rwlock_downgrade(struct rwlock* rw) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(rwlock_write_held_by_current_thread(rw));
+
+    old_level = intr_disable();
+    spinlock_acquire(&donation_lock);
+    rb_remove(&t->held_locks, &rw->write_hold.node);
+    rw->writer = NULL;
+    rwlock_grant_read(rw, t);
+    rwlock_wake(rw);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+}
+
+/* Returns true if the current thread holds RW, for reading or
+   writing, false otherwise. */
+bool rwlock_held_by_current_thread(const struct rwlock* rw) {
+    ASSERT(rw != NULL);
+
+    return rw->writer == thread_current() || rwlock_reader_of(thread_current(), rw) != NULL;
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool rwlock_write_held_by_current_thread(const struct rwlock* rw) {
+    ASSERT(rw != NULL);
+
+    return rw->writer == thread_current();
+}
+
+/* Returns T's read hold on RW, or, if RW is a null pointer, a
+   free read hold slot.  Returns a null pointer if there is none. */
+static struct rwlock_reader* rwlock_reader_of(const struct thread* t, const struct rwlock* rw) {
+    for (int i = 0; i < RWLOCK_READ_MAX; i++)
+        if (t->read_holds[i].rwlock == rw) return (struct rwlock_reader*)&t->read_holds[i];
+    return NULL;
+}
+
+/* Makes T a reader of RW.  The donation lock must be held. */
+static void rwlock_grant_read(struct rwlock* rw, struct thread* t) {
+    struct rwlock_reader* r = rwlock_reader_of(t, NULL);
+
+    ASSERT(r != NULL);
+
+    r->rwlock = rw;
+    r->hold.waiters[0] = &rw->read_waiters;
+    r->hold.waiters[1] = &rw->write_waiters;
+    list_push_back(&rw->readers, &r->elem);
+    rb_insert(&t->held_locks, &r->hold.node);
+    donation_refresh(t);
+}
+
+/* Makes T the writer of RW.  The donation lock must be held. */
+static void rwlock_grant_write(struct rwlock* rw, struct thread* t) {
+    rw->writer = t;
+    rb_insert(&t->held_locks, &rw->write_hold.node);
+    donation_refresh(t);
+}
+
+/* Removes the highest-priority thread from WAITERS, one of the
+   trees of a reader-writer lock, and returns it. */
+static struct thread* rwlock_pop(struct rb_tree* waiters) {
+    struct thread* t = rb_entry(rb_min(waiters), struct thread, waiter_node);
+
+    waiter_remove(t);
+    t->waiting_rwlock = NULL;
+    return t;
+}
+
+/* Hands RW over to whichever waiters may now have it, after a
+   holder has released it or downgraded.  All the new holders are
+   in place before any of them is woken, since waking one may
+   switch to it.  The donation lock must be held. */
+static void rwlock_wake(struct rwlock* rw) {
+    struct list woken;
+    struct thread* t;
+
+    if (rw->writer != NULL) return;
+
+    if (rw->upgrader != NULL) {
+        struct rwlock_reader* r;
+
+        if (list_size(&rw->readers) > 1) return;
+        t = rw->upgrader;
+        r = rwlock_reader_of(t, rw);
+        waiter_remove(t);
+        t->waiting_rwlock = NULL;
+        list_remove(&r->elem);
+        r->rwlock = NULL;
+        rw->upgrader = NULL;
+        rwlock_grant_write(rw, t);
+        thread_unblock(t);
+        return;
+    }
+
+    if (!rb_empty(&rw->write_waiters)) {
+        if (!list_empty(&rw->readers)) return;
+        t = rwlock_pop(&rw->write_waiters);
+        rwlock_grant_write(rw, t);
+        thread_unblock(t);
+        return;
+    }
+
+    list_init(&woken);
+    while (!rb_empty(&rw->read_waiters)) {
+        t = rwlock_pop(&rw->read_waiters);
+        rwlock_grant_read(rw, t);
+        list_push_back(&woken, &t->elem);
+    }
+    while (!list_empty(&woken)) thread_unblock(list_entry(list_pop_front(&woken), struct thread, elem));
+}
+
+/* Initializes the priority donation state of new thread T. */
+void lock_donation_init(struct thread* t) {
+    t->waiting_lock = NULL;
+    t->waiting_rwlock = NULL;
+    t->waiting_in = NULL;
+    t->waiting_spin = NULL;
+    spinlock_init(&t->wait_lock);
+    rb_init(&t->held_locks, hold_higher_priority, NULL);
+    for (int i = 0; i < RWLOCK_READ_MAX; i++) {
+        t->read_holds[i].rwlock = NULL;
+        t->read_holds[i].thread = t;
+    }
+}
+
+/* Recomputes T's effective priority, the higher of its base
+   priority and what the waiters for the locks it holds donate,
+   after either may have changed.  If it changes and T is waiting
+   for a lock, the change is passed on to the lock's holder, and
+   so on down the chain, however long.
+
+   The multi-level feedback queue scheduler computes priorities
+   itself, so it does without donation. */
+void lock_donation_refresh(struct thread* t) {
+    enum intr_level old_level = intr_disable();
+
+    spinlock_acquire(&donation_lock);
+    donation_refresh(t);
+    spinlock_release(&donation_lock);
+    intr_set_level(old_level);
+}
+
+/* Does the work of lock_donation_refresh() with the donation
+   lock held. */
+static void donation_refresh(struct thread* t) {
+    if (thread_mlfqs) return;
+
+    while (t != NULL) {
+        struct rb_node* first;
+        int priority = t->base_priority;
+
+        ASSERT(spinlock_held_by_current_cpu(&donation_lock));
+
+        first = rb_min(&t->held_locks);
+        if (first != NULL) {
+            int donated = hold_priority(rb_entry(first, struct lock_hold, node));
+            if (donated > priority) priority = donated;
+        }
+        if (priority == t->priority) return;
+
+        thread_change_priority(t, priority);
+        t = donation_target(t);
+    }
+}
+
+/* Sets the priority of T to PRIORITY.  If T is waiting, its
+   priority is its key among the waiters and decides the keys of
+   the holds of what it waits for, so all of them are re-filed,
+   with the spin lock protecting the waiters held.  Interrupts
+   must be off. */
+void lock_donation_set_priority(struct thread* t, int priority) {
+    struct spinlock* spin;
+    bool locked = false;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    /* The waiters' spin lock comes before T's wait_lock, so it
+       can only be tried for here.  Whoever holds it may be taking
+       T out of the waiters, which needs wait_lock. */
+    for (;;) {
+        spinlock_acquire(&t->wait_lock);
+        spin = t->waiting_spin;
+        if (spin == NULL || spinlock_held_by_current_cpu(spin)) break;
+        if (spinlock_try_acquire(spin)) {
+            locked = true;
+            break;
+        }
+        spinlock_release(&t->wait_lock);
+        asm volatile("pause");
+    }
+
+    waited_holds_apply(t, rb_remove);
+    if (t->waiting_in != NULL) rb_remove(t->waiting_in, &t->waiter_node);
+    t->waiter_priority = priority;
+    t->priority = priority;
+    if (t->waiting_in != NULL) rb_insert(t->waiting_in, &t->waiter_node);
+    waited_holds_apply(t, rb_insert);
+
+    if (locked) spinlock_release(spin);
+    spinlock_release(&t->wait_lock);
+}
+
+/* Adds T to WAITERS, protected by SPIN, which must be held, as it
+   is about to block, and donates its priority to whoever holds
+   what it waits for. */
+static void waiter_add(struct thread* t, struct rb_tree* waiters, struct spinlock* spin) {
+    ASSERT(t->waiting_in == NULL);
+    ASSERT(spinlock_held_by_current_cpu(spin));
+
+    waited_holds_apply(t, rb_remove);
+    spinlock_acquire(&t->wait_lock);
+    t->waiter_priority = t->priority;
+    rb_insert(waiters, &t->waiter_node);
+    t->waiting_in = waiters;
+    t->waiting_spin = spin;
+    spinlock_release(&t->wait_lock);
+    waited_holds_apply(t, rb_insert);
+    donation_refresh(donation_target(t));
+}
+
+/* Removes T from the waiters it is in, as it is about to be
+   woken.  The spin lock protecting them must be held. */
+static void waiter_remove(struct thread* t) {
+    ASSERT(spinlock_held_by_current_cpu(t->waiting_spin));
+
+    waited_holds_apply(t, rb_remove);
+    spinlock_acquire(&t->wait_lock);
+    rb_remove(t->waiting_in, &t->waiter_node);
+    t->waiting_in = NULL;
+    t->waiting_spin = NULL;
+    spinlock_release(&t->wait_lock);
+    waited_holds_apply(t, rb_insert);
+}
+
+/* Calls OP, which is rb_insert() or rb_remove(), on each hold
+   that T's priority may help order, that is, every hold on the
+   lock or reader-writer lock T is acquiring. */
+static void waited_holds_apply(struct thread* t,
+                               void (*op)(struct rb_tree*, struct rb_node*)) {
+    struct lock* lock = t->waiting_lock;
+    struct rwlock* rw = t->waiting_rwlock;
+
+    if (lock != NULL && lock->holder != NULL) op(&lock->holder->held_locks, &lock->hold.node);
+    if (rw != NULL) {
+        struct list_elem* e;
+
+        if (rw->writer != NULL) op(&rw->writer->held_locks, &rw->write_hold.node);
+        for (e = list_begin(&rw->readers); e != list_end(&rw->readers); e = list_next(e)) {
+            struct rwlock_reader* r = list_entry(e, struct rwlock_reader, elem);
+            if (r->thread != rw->upgrader) op(&r->thread->held_locks, &r->hold.node);
+        }
+    }
+}
+
+/* Passes on a change in T's priority to the holders of what T is
+   acquiring.  Returns the one holder whose priority remains to
+   be recomputed, having done it already for any others, or a null
+   pointer if there is none. */
+static struct thread* donation_target(struct thread* t) {
+    struct rwlock* rw = t->waiting_rwlock;
+    struct thread* target = NULL;
+    struct list_elem* e;
+
+    if (t->waiting_lock != NULL) return t->waiting_lock->holder;
+    if (rw == NULL) return NULL;
+    if (rw->writer != NULL) return rw->writer;
+
+    /* Donating to several readers branches the chain.  All but
+       one branch are followed by recursion. */
+    for (e = list_begin(&rw->readers); e != list_end(&rw->readers); e = list_next(e)) {
+        struct thread* reader = list_entry(e, struct rwlock_reader, elem)->thread;
+
+        if (reader == t) continue;
+        if (target != NULL) donation_refresh(target);
+        target = reader;
+    }
+    return target;
+}
+
+/* Initializes spin lock SPIN.  Unlike a lock, a spin lock may
+   be acquired by an interrupt handler, and it excludes other
+   CPUs rather than other threads: the current CPU must already
+   have interrupts turned off before acquiring it, and must keep
+   them off until it releases it. */
+void spinlock_init(struct spinlock* spin) {
+    ASSERT(spin != NULL);
+
+    spin->locked = 0;
+    spin->cpu = NULL;
+}
+
+/* Acquires SPIN, busy-waiting until it becomes available.  SPIN
+   must not already be held by the current CPU.  Interrupts must
+   be off. */
+void spinlock_acquire(struct spinlock* spin) {
+    ASSERT(spin != NULL);
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(!spinlock_held_by_current_cpu(spin));
+
+    while (__atomic_exchange_n(&spin->locked, 1, __ATOMIC_ACQUIRE))
+        while (spin->locked) asm volatile("pause");
+    spin->cpu = this_cpu();
+}
+
+/* Tries to acquire SPIN and returns true if successful or false
+   on failure.  Interrupts must be off. */
+bool spinlock_try_acquire(struct spinlock* spin) {
+    ASSERT(spin != NULL);
+    ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(!spinlock_held_by_current_cpu(spin));
+
+    if (__atomic_exchange_n(&spin->locked, 1, __ATOMIC_ACQUIRE)) return false;
+    spin->cpu = this_cpu();
+    return true;
+}
+
+/* Releases SPIN, which must be held by the current CPU. */
+void spinlock_release(struct spinlock* spin) {
+    ASSERT(spin != NULL);
+    ASSERT(spinlock_held_by_current_cpu(spin));
+
+    spin->cpu = NULL;
+    __atomic_store_n(&spin->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns true if the current CPU holds SPIN, false otherwise. */
+bool spinlock_held_by_current_cpu(const struct spinlock* spin) {
+    ASSERT(spin != NULL);
+
+    return spin->locked && spin->cpu == this_cpu();
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem {
     struct list_elem elem;      /* List element. */
     struct semaphore semaphore; /* This semaphore. */
+    struct thread* thread;      /* Thread waiting on it. */
 };
 
 /* Initializes condition variable COND.  A condition variable
@@ -309,14 +1055,47 @@ void cond_wait(struct condition* cond, struct lock* lock) {
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
-    list_insert_ordered(&cond->waiters, &waiter.elem, cond_insert_by_priority, NULL);
+    waiter.thread = thread_current();
+    list_push_back(&cond->waiters, &waiter.elem);
     lock_release(lock);
     sema_down(&waiter.semaphore);
     lock_acquire(lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND after TICKS
+   timer ticks.  LOCK is reacquired either way.  Returns true if
+   COND was signaled, false if the wait timed out.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool cond_wait_timeout(struct condition* cond, struct lock* lock, int64_t ticks) {
+    struct semaphore_elem waiter;
+    bool signaled;
+
+    ASSERT(cond != NULL);
+    ASSERT(lock != NULL);
+    ASSERT(!intr_context());
+    ASSERT(lock_held_by_current_thread(lock));
+
+    sema_init(&waiter.semaphore, 0);
+    waiter.thread = thread_current();
+    list_push_back(&cond->waiters, &waiter.elem);
+    lock_release(lock);
+    signaled = sema_down_timeout(&waiter.semaphore, ticks);
+    lock_acquire(lock);
+
+    /* A signal may have come between the timeout and getting
+       LOCK back.  If not, WAITER is still on the list. */
+    if (!signaled) {
+        signaled = sema_try_down(&waiter.semaphore);
+        if (!signaled) list_remove(&waiter.elem);
+    }
+    return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one, the one that
+   has waited longest among equals, to wake up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -328,9 +1107,12 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
     ASSERT(!intr_context());
     ASSERT(lock_held_by_current_thread(lock));
 
-    if (!list_empty(&cond->waiters))
-        sema_up(
-            &list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+    if (!list_empty(&cond->waiters)) {
+        struct list_elem* e = list_max(&cond->waiters, cond_waiter_less, NULL);
+
+        list_remove(e);
+        sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -346,19 +1128,41 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
     while (!list_empty(&cond->waiters)) cond_signal(cond, lock);
 }
 
-static bool cond_insert_by_priority(struct list_elem* cur UNUSED, struct list_elem* e,
-                                    void* aux UNUSED) {
-    struct semaphore_elem* sema_elem = list_entry(e, struct semaphore_elem, elem);
-    if (!list_empty(&sema_elem->semaphore.waiters)) {
-        struct list_elem* elem = list_front(&sema_elem->semaphore.waiters);
-        struct thread* t = list_entry(elem, struct thread, elem);
-        return thread_current()->priority > t->priority;
+/* Returns the priority that the waiters donate through HOLD,
+   or PRI_MIN - 1 if it has none. */
+static int hold_priority(const struct lock_hold* hold) {
+    int priority = PRI_MIN - 1;
+
+    for (int i = 0; i < 2; i++) {
+        struct rb_node* first = hold->waiters[i] != NULL ? rb_min(hold->waiters[i]) : NULL;
+
+        if (first != NULL) {
+            int p = rb_entry(first, struct thread, waiter_node)->waiter_priority;
+            if (p > priority) priority = p;
+        }
     }
-    return !list_empty(&sema_elem->semaphore.waiters);
+    return priority;
+}
+
+/* Orders the waiters of a semaphore by priority, highest first. */
+static bool waiter_higher_priority(const struct rb_node* a, const struct rb_node* b,
+                                   void* aux UNUSED) {
+    return rb_entry(a, struct thread, waiter_node)->waiter_priority >
+           rb_entry(b, struct thread, waiter_node)->waiter_priority;
+}
+
+/* Orders the holds of a thread by the priority of their waiters,
+   highest first. */
+static bool hold_higher_priority(const struct rb_node* a, const struct rb_node* b,
+                                 void* aux UNUSED) {
+    return hold_priority(rb_entry(a, struct lock_hold, node)) >
+           hold_priority(rb_entry(b, struct lock_hold, node));
 }
 
-static bool donor_higher_priority(struct list_elem* e1, struct list_elem* e2, void* aux UNUSED) {
-    struct thread* thread1 = list_entry(e1, struct thread, donor_elem);
-    struct thread* thread2 = list_entry(e2, struct thread, donor_elem);
-    return thread1->priority > thread2->priority;
+/* Orders condition variable waiters by the priority of the
+   waiting thread. */
+static bool cond_waiter_less(const struct list_elem* a, const struct list_elem* b,
+                             void* aux UNUSED) {
+    return list_entry(a, struct semaphore_elem, elem)->thread->priority <
+           list_entry(b, struct semaphore_elem, elem)->thread->priority;
 }
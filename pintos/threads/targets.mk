@@ -5,5 +5,13 @@ threads_SRC += threads/intr-stubs.S	# Interrupt stubs.
 threads_SRC += threads/synch.c		# Synchronization.
 threads_SRC += threads/palloc.c		# Page allocator.
 threads_SRC += threads/malloc.c		# Subpage allocator.
+threads_SRC += threads/slab.c		# Object caches.
 threads_SRC += threads/start.S		# Startup code.
 threads_SRC += threads/mmu.c		    # Memory management unit related things.
+threads_SRC += threads/mp.c		# Multiprocessor support.
+threads_SRC += threads/mpentry.S	# Application processor start-up.
+threads_SRC += threads/fpu.c		# Lazy FPU/SSE/AVX state switching.
+threads_SRC += threads/switch.S		# Kernel thread context switch.
+threads_SRC += threads/workqueue.c	# Deferred interrupt work.
+threads_SRC += threads/trace.c		# Event trace ring buffers.
+threads_SRC += threads/kstack.c		# Guarded kernel stacks.
@@ -11,11 +11,19 @@
 #include "intrinsic.h"
 #include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
+#include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -29,13 +37,88 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-static struct list sleep_list;
+/* Per-CPU run queue of processes in THREAD_READY state, that
+   is, processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit N of bitmap
+   is set iff queues[N] is non-empty, so the highest ready
+   priority is found with a single bit scan.  Each CPU schedules
+   from its own queue, and steals from the others when they hold
+   more urgent work or it has none (see next_thread_to_run()).
+
+   Under the fair-share scheduler the priority queues go unused.
+   Ready threads are kept instead in a red-black tree ordered by
+   vruntime, their run time scaled down by their weight, and the
+   leftmost thread, the one furthest behind its fair share, runs
+   next.
+
+   Real-time threads of the EDF class sit above either scheduler
+   in a tree of their own, ordered by absolute deadline.  They are
+   admitted to, and stay on, one CPU, and are never stolen.
+
+   Kernel worker threads (see workqueue.c) come before all of
+   these.  They run deferred interrupt work and stay on the CPU
+   that woke them.  They are not counted as ready threads, and a
+   thread that gives way to one keeps its place in line.
+
+   Each run queue has a spin lock of its own, which protects the
+   queue and the threads in it.  A CPU holds its own queue's lock
+   from the moment the running thread gives up the CPU until the
+   next one is running (see schedule_tail()), and other CPUs take
+   it to wake a thread onto the queue or to steal from it.  The
+   counts and the running thread are also read without the lock,
+   as hints, by CPUs choosing a queue. */
+struct run_queue {
+    struct spinlock lock; /* Protects the rest. */
+    struct list queues[PRI_MAX + 1];
+    uint64_t bitmap;
+    struct rb_tree cfs_tree;  /* CFS: ready threads by vruntime. */
+    int64_t min_vruntime;     /* CFS: monotonic floor of vruntimes. */
+    int64_t cfs_load;         /* CFS: total weight of the tree. */
+    struct rb_tree dl_tree;   /* EDF: ready threads by deadline. */
+    struct list dl_throttled; /* EDF: out of budget, by next period. */
+    int64_t dl_bw;            /* EDF: admitted bandwidth, DL_BW_ONE = 100%. */
+    int dl_cnt;               /* # of threads in dl_tree. */
+    int cnt;                  /* # of other threads in the queues. */
+    struct list workers;      /* Ready kernel worker threads. */
+    struct thread* curr;      /* Thread running on this CPU. */
+    struct thread* prev;      /* Thread switched away from, for schedule_tail(). */
+    struct list mlfqs_ready;  /* MLFQS: ready threads, next to refresh first. */
+    unsigned slice_ticks;     /* # of timer ticks since last yield. */
+    int64_t ticks;            /* # of timer ticks on this CPU. */
+    long long steals;         /* # of threads stolen from other CPUs. */
+    long long kicks;          /* # of reschedule IPIs sent to this CPU. */
+};
+
+/* Run queues, indexed like cpus[]. */
+static struct run_queue run_queues[CPU_MAX];
+static int ready_cnt; /* # of threads in all run queues. */
 static struct list all_list;
-/* Idle thread. */
-static struct thread* idle_thread;
+static struct spinlock all_lock; /* Protects all_list. */
+
+/* Returns the running CPU's run queue. */
+#define this_run_queue() (&run_queues[this_cpu()->id])
+
+/* Hierarchical timing wheel of sleeping threads, indexed by
+   wakeup_tick.  Level 0 has one slot per tick for the next
+   SLEEP_WHEEL_SLOTS ticks; each higher level covers
+   SLEEP_WHEEL_SLOTS times the span of the level below, and its
+   slots are cascaded into the lower levels when the wheel turns
+   over.  Sleepers due further out than the top level can reach
+   park in its farthest slot and are re-filed on each cascade. */
+#define SLEEP_WHEEL_BITS 8
+#define SLEEP_WHEEL_SLOTS (1 << SLEEP_WHEEL_BITS)
+#define SLEEP_WHEEL_MASK (SLEEP_WHEEL_SLOTS - 1)
+#define SLEEP_WHEEL_LEVELS 4
+static struct list sleep_wheel[SLEEP_WHEEL_LEVELS][SLEEP_WHEEL_SLOTS];
+static int64_t sleep_wheel_base; /* Next tick the wheel will expire. */
+
+/* Protects the wheel and the wakeup_tick, sleep_elem, timed_wait
+   and timed_out members of the threads on it. */
+static struct spinlock sleep_lock;
+
+#ifdef USERPROG
+struct kmem_cache* child_info_cache;
+#endif
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread* initial_thread;
@@ -43,56 +126,170 @@ static struct thread* initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
-/* Thread destruction requests */
-static struct list destruction_req;
-
 /* Statistics. */
 static long long idle_ticks;   /* # of timer ticks spent idle. */
 static long long kernel_ticks; /* # of timer ticks in kernel threads. */
 static long long user_ticks;   /* # of timer ticks in user programs. */
 
+/* Wakeup-to-run latency of all threads, as in struct sched_stats. */
+static uint64_t wakeup_latency[SCHED_HIST_BUCKETS];
+
 /* Scheduling. */
-#define TIME_SLICE 4          /* # of timer ticks to give each thread. */
-static unsigned thread_ticks; /* # of timer ticks since last yield. */
+#define TIME_SLICE 4 /* # of timer ticks to give each thread. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+/* Fair-share scheduling.  Every runnable thread should get a
+   turn within CFS_LATENCY, in slices proportional to its weight,
+   but no slice is shorter than the minimum granularity; with
+   many threads the period stretches instead.  A waking thread
+   preempts the running one if it is more than the wakeup
+   granularity behind it.  Times are in nanoseconds. */
+#define CFS_LATENCY (TIME_SLICE * (NSEC_PER_SEC / TIMER_FREQ))
+#define CFS_NICE_0_WEIGHT 1024
+int64_t thread_cfs_granularity = NSEC_PER_SEC / TIMER_FREQ;
+
+/* Weight of each nice value, from -20 to 20.  Each step of nice
+   is worth about 10% of CPU time against a thread one step away,
+   so neighbouring weights differ by a factor of 1.25. */
+static const int cfs_nice_weights[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548,  7620,  6100,  4904,  3906,
+    /*  -5 */ 3121,  2501,  1991,  1586,  1277,
+    /*   0 */ 1024,  820,   655,   526,   423,
+    /*   5 */ 335,   272,   215,   172,   137,
+    /*  10 */ 110,   87,    70,    56,    45,
+    /*  15 */ 36,    29,    23,    18,    15,
+    /*  20 */ 12,
+};
+
+/* Earliest-deadline-first scheduling.  A thread in the EDF class
+   may run for dl_runtime in every dl_period, and each such job
+   must be done within dl_deadline of the period's start.  Ready
+   EDF threads run before all others, earliest absolute deadline
+   first, which meets every deadline as long as the CPU is not
+   overcommitted: admission control keeps the bandwidth,
+   runtime / period, admitted to each CPU under DL_BW_MAX.  A
+   thread that uses up its budget is throttled until its next
+   period (the constant bandwidth server), so that an overrun
+   cannot take time from the other EDF threads.  Times are in
+   nanoseconds; budgets are enforced at timer ticks. */
+#define DL_BW_SHIFT 20
+#define DL_BW_ONE (1 << DL_BW_SHIFT)
+#define DL_BW_MAX (DL_BW_ONE * 95 / 100)
+#define DL_PERIOD_MAX NSEC_PER_SEC /* Longest period accepted. */
+
+/* Returns true if T is in the EDF class. */
+#define is_dl_thread(t) ((t)->dl_runtime != 0)
+
+/* If true, switch threads through iretq.
+   Controlled by kernel command-line option "-iret-switch". */
+bool thread_iret_switch;
+
 static void kernel_thread(thread_func*, void* aux);
+static void thread_first_launch(void) NO_RETURN;
+static void thread_launch_iret(struct thread* curr, struct thread* th);
 
 static void idle(void* aux UNUSED);
+static void idle_loop(void) NO_RETURN;
+static bool is_idle_thread(const struct thread*);
 static struct thread* next_thread_to_run(void);
 static void init_thread(struct thread*, const char* name, int priority);
-static void do_schedule(int status);
+static bool thread_alloc_stack(struct thread*);
 static void schedule(void);
+static void schedule_tail(void);
+static void wake_thread(struct thread* t);
+static void resched(struct run_queue*);
+static struct run_queue* thread_rq_lock(struct thread* t);
+static void set_priority_locked(struct run_queue*, struct thread* t, int priority);
 static tid_t allocate_tid(void);
-
-static bool sleep_list_order(const struct list_elem* e1, const struct list_elem* e2, void* aux);
+static void account_switch(struct thread* curr, struct thread* next);
+static int latency_bucket(uint64_t cycles);
+
+static void ready_queue_push(struct run_queue*, struct thread* t);
+static void ready_queue_remove(struct thread* t);
+static struct thread* ready_queue_pop(struct run_queue*);
+static int ready_queue_max_priority(const struct run_queue*);
+static int ready_max_priority(void);
+
+static bool run_queue_online(const struct run_queue*);
+static struct thread* run_queue_busy(const struct run_queue*);
+static int run_queue_load(const struct run_queue*);
+static int run_queue_urgency(const struct run_queue*);
+static struct run_queue* select_run_queue(struct thread* t);
+static struct thread* steal_thread(struct run_queue*);
+
+static bool should_preempt(struct run_queue*, struct thread* t);
+
+static void sleep_wheel_insert(struct thread* t);
+static void sleep_wheel_cascade(int level);
+static void sleep_wheel_expire(void);
+
+static int cfs_weight(const struct thread* t);
+static int64_t cfs_vdelta(int64_t delta, const struct thread* t);
+static int64_t cfs_slice(const struct run_queue*, const struct thread* t);
+static void update_curr(struct run_queue*);
+static void cfs_update_min_vruntime(struct run_queue*);
+static void cfs_migrate(struct thread* t, struct run_queue* from, struct run_queue* to);
+static void cfs_place_wakeup(struct run_queue*, struct thread* t);
+static bool cfs_tick_preempt(struct run_queue*);
+static bool cfs_vruntime_less(const struct rb_node*, const struct rb_node*, void* aux);
+
+static int64_t dl_bw(int64_t runtime, int64_t period);
+static struct thread* dl_pop(struct run_queue*);
+static void dl_throttle(struct run_queue*, struct thread* t);
+static void dl_replenish_due(struct run_queue*);
+static bool dl_place_wakeup(struct thread* t);
+static bool dl_deadline_less(const struct rb_node*, const struct rb_node*, void* aux);
+static bool dl_release_less(const struct list_elem*, const struct list_elem*, void* aux);
 
 static fixed_t load_avg;
 
-static void mlfqs_update_priority(struct thread* t);
+/* Once-per-second recent_cpu decay, applied lazily.  Instead of
+   decaying every thread when a second ends, the decay factor for
+   that second is recorded here and each thread applies the ones
+   it has missed, as stamped by its recent_cpu_epoch, when it is
+   next looked at.  A thread that sat out longer than the history
+   only gets the last MLFQS_DECAY_HISTORY decays, by which point
+   its old recent_cpu has all but decayed away. */
+#define MLFQS_DECAY_HISTORY 1024
+static fixed_t mlfqs_decay[MLFQS_DECAY_HISTORY]; /* Indexed by epoch. */
+static int64_t mlfqs_epoch;                       /* # of decays so far. */
+
+/* Ready threads are not decayed when a second ends either.
+   thread_tick() instead brings up to MLFQS_REFRESH_MAX of them up
+   to date per tick on each CPU, taking them in turn from its run
+   queue's mlfqs_ready list, so that the run queues catch up
+   within a few ticks without the work in any one tick growing
+   with the number of ready threads.  The BSP alone records the
+   decays; the other CPUs pick them up through mlfqs_epoch. */
+#define MLFQS_REFRESH_MAX 8
+
+static int mlfqs_priority(const struct thread* t);
 static void mlfqs_update_recent_cpu(struct thread* t);
 static void mlfqs_update_load_avg(void);
-static void mlfqs_update_recent_cpu_all(void);
-static void mlfqs_update_priority_all(void);
+static void mlfqs_refresh_ready(struct run_queue*);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
 
-/* Returns the running thread.
- * Read the CPU's stack pointer `rsp', and then round that
- * down to the start of a page.  Since `struct thread' is
- * always at the beginning of a page and the stack pointer is
- * somewhere in the middle, this locates the curent thread. */
-#define running_thread() ((struct thread*)(pg_round_down(rrsp())))
+/* Returns the running thread, which schedule() records in the
+   CPU's `struct cpu' just before switching to it. */
+#define running_thread() this_cpu_thread()
 
 // Global descriptor table for the thread_start.
 // Because the gdt will be setup after the thread_init, we should
-// setup temporal gdt first.
-static uint64_t gdt[3] = {0, 0x00af9a000000ffff, 0x00cf92000000ffff};
+// setup temporal gdt first.  It has room for the TSS descriptors
+// kstack_cpu_init() adds.
+static uint64_t gdt[GDT_ENTRY_CNT] = {0, 0x00af9a000000ffff, 0x00cf92000000ffff};
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -118,18 +315,38 @@ void thread_init(void) {
 
     /* Init the globla thread context */
     lock_init(&tid_lock);
-    list_init(&ready_list);
-    list_init(&destruction_req);
+    for (int cpu = 0; cpu < CPU_MAX; cpu++) {
+        spinlock_init(&run_queues[cpu].lock);
+        for (int pri = PRI_MIN; pri <= PRI_MAX; pri++) list_init(&run_queues[cpu].queues[pri]);
+        rb_init(&run_queues[cpu].cfs_tree, cfs_vruntime_less, NULL);
+        rb_init(&run_queues[cpu].dl_tree, dl_deadline_less, NULL);
+        list_init(&run_queues[cpu].dl_throttled);
+        list_init(&run_queues[cpu].workers);
+        list_init(&run_queues[cpu].mlfqs_ready);
+    }
+    ready_cnt = 0;
     list_init(&all_list);
+    spinlock_init(&all_lock);
 
     load_avg = FP_CONST(0);
-    /* Set up a thread structure for the running thread. */
-    initial_thread = running_thread();
+    /* Set up a thread structure for the running thread.  It runs
+       on the page-sized stack loader.S set up, with its `struct
+       thread' at the bottom, and has no guard below it. */
+    initial_thread = pg_round_down(rrsp());
     init_thread(initial_thread, "main", PRI_DEFAULT);
+    initial_thread->kstack_top = (uintptr_t)initial_thread + PGSIZE;
+    this_cpu()->thread = initial_thread;
     initial_thread->status = THREAD_RUNNING;
+    initial_thread->on_cpu = true;
     initial_thread->tid = allocate_tid();
-
-    list_init(&sleep_list);
+    run_queues[0].curr = initial_thread;
+    initial_thread->state_tsc = rdtsc();
+    list_push_back(&all_list, &initial_thread->allelem);
+
+    for (int level = 0; level < SLEEP_WHEEL_LEVELS; level++)
+        for (int slot = 0; slot < SLEEP_WHEEL_SLOTS; slot++) list_init(&sleep_wheel[level][slot]);
+    sleep_wheel_base = 0;
+    spinlock_init(&sleep_lock);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -137,48 +354,172 @@ void thread_init(void) {
 void thread_start(void) {
     /* Create the idle thread. */
     struct semaphore idle_started;
+#ifdef USERPROG
+    child_info_cache = kmem_cache_create("child_info", sizeof(struct child_info), 0, NULL);
+#endif
     sema_init(&idle_started, 0);
     thread_create("idle", PRI_MIN, idle, &idle_started);
 
     /* Start preemptive thread scheduling. */
     intr_enable();
 
-    /* Wait for the idle thread to initialize idle_thread. */
+    /* Wait for the idle thread to initialize this CPU's idle_thread. */
     sema_down(&idle_started);
 }
 
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void thread_tick(void) {
+    struct run_queue* rq = this_run_queue();
     struct thread* t = thread_current();
+    bool idle = is_idle_thread(t), yield = false;
+
+    spinlock_acquire(&rq->lock);
+    rq->ticks++;
 
-    /* Update statistics. */
-    if (t == idle_thread) idle_ticks++;
+    /* Update statistics.  Every CPU ticks, so count atomically. */
+    if (idle) __atomic_fetch_add(&idle_ticks, 1, __ATOMIC_RELAXED);
 #ifdef USERPROG
     else if (t->pml4 != NULL)
-        user_ticks++;
+        __atomic_fetch_add(&user_ticks, 1, __ATOMIC_RELAXED);
 #endif
     else
-        kernel_ticks++;
+        __atomic_fetch_add(&kernel_ticks, 1, __ATOMIC_RELAXED);
 
     if (thread_mlfqs) {
-        if (t != idle_thread) t->recent_cpu = FP_ADD_MIXED(t->recent_cpu, 1);
+        /* Only the running thread accrues CPU time, so it is the
+           only one whose priority changes between seconds. */
+        mlfqs_update_recent_cpu(t);
+        if (!idle) t->recent_cpu = FP_ADD_MIXED(t->recent_cpu, 1);
 
-        if (timer_ticks() % TIMER_FREQ == 0) {
-            mlfqs_update_load_avg();
-            mlfqs_update_recent_cpu_all();
-        }
+        /* load_avg is system-wide, so only the BSP, whose ticks
+           drive timer_ticks(), updates it. */
+        if (this_cpu()->id == 0 && timer_ticks() % TIMER_FREQ == 0) mlfqs_update_load_avg();
+        mlfqs_refresh_ready(rq);
 
-        if (timer_ticks() % 4 == 0) mlfqs_update_priority_all();
+        if (rq->ticks % 4 == 0) set_priority_locked(rq, t, mlfqs_priority(t));
     }
-    /* Enforce preemption. */
-    if (++thread_ticks >= TIME_SLICE) intr_yield_on_return();
+    /* Enforce preemption.  EDF threads run until they block, use
+       up their budget, or a thread with an earlier deadline
+       becomes ready, which thread_unblock() sees to. */
+    dl_replenish_due(rq);
+    if (t->worker)
+        ; /* Runs until it blocks. */
+    else if (is_dl_thread(t)) {
+        update_curr(rq);
+        yield = t->dl_budget <= 0;
+    } else if (thread_cfs)
+        yield = idle ? rq->cnt > 0 : cfs_tick_preempt(rq);
+    else
+        yield = ++rq->slice_ticks >= TIME_SLICE;
+    spinlock_release(&rq->lock);
+
+    if (yield) intr_yield_on_return();
 }
 
 /* Prints thread statistics. */
 void thread_print_stats(void) {
     printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks,
            kernel_ticks, user_ticks);
+    if (cpu_cnt > 1)
+        for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+            struct run_queue* rq = &run_queues[cpu];
+            printf("CPU %d: %lld ticks, %lld steals, %lld reschedule IPIs\n", cpu, rq->ticks,
+                   rq->steals, rq->kicks);
+        }
+}
+
+/* Stores T's scheduler statistics in *STATS, including the time
+   T has spent in its current state if it is RUNNING or READY. */
+void thread_get_sched_stats(struct thread* t, struct sched_stats* stats) {
+    enum intr_level old_level;
+    struct run_queue* rq;
+    uint64_t now;
+
+    ASSERT(is_thread(t));
+
+    old_level = intr_disable();
+    rq = thread_rq_lock(t);
+    now = rdtsc();
+    *stats = t->stats;
+    if (t->status == THREAD_RUNNING)
+        stats->run_cycles += now - t->state_tsc;
+    else if (t->status == THREAD_READY)
+        stats->ready_cycles += now - t->state_tsc;
+    spinlock_release(&rq->lock);
+    intr_set_level(old_level);
+}
+
+/* Prints the scheduler statistics of every thread and the
+   system-wide wakeup-to-run latency histogram. */
+void thread_print_sched_stats(void) {
+    static const char* state_names[] = {"run", "ready", "block", "dying", "wake"};
+    struct snapshot {
+        tid_t tid;
+        char name[16];
+        enum thread_status status;
+        struct sched_stats stats;
+    };
+    uint64_t latency[SCHED_HIST_BUCKETS];
+    struct snapshot* snaps;
+    enum intr_level old_level;
+    struct list_elem* e;
+    size_t cnt, cap, i;
+
+    /* Copy everything out first: printing may block.  So may
+       malloc(), so the buffer is allocated with interrupts on,
+       with room for a few threads created meanwhile, and again
+       if more than that were. */
+    old_level = intr_disable();
+    spinlock_acquire(&all_lock);
+    cnt = list_size(&all_list);
+    spinlock_release(&all_lock);
+    intr_set_level(old_level);
+    for (;;) {
+        cap = cnt + 8;
+        snaps = malloc(cap * sizeof *snaps);
+        if (snaps == NULL) {
+            printf("schedstat: out of memory\n");
+            return;
+        }
+        old_level = intr_disable();
+        spinlock_acquire(&all_lock);
+        cnt = list_size(&all_list);
+        if (cnt <= cap) break;
+        spinlock_release(&all_lock);
+        intr_set_level(old_level);
+        free(snaps);
+    }
+    cnt = 0;
+    for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
+        struct thread* t = list_entry(e, struct thread, allelem);
+        struct snapshot* s = &snaps[cnt++];
+
+        s->tid = t->tid;
+        strlcpy(s->name, t->name, sizeof s->name);
+        s->status = t->status;
+        thread_get_sched_stats(t, &s->stats);
+    }
+    memcpy(latency, wakeup_latency, sizeof latency);
+    spinlock_release(&all_lock);
+    intr_set_level(old_level);
+
+    printf("Scheduler statistics (TSC cycles):\n");
+    printf("%5s %-16s %-5s %16s %16s %8s %8s\n", "tid", "name", "state", "running", "ready",
+           "vol", "invol");
+    for (i = 0; i < cnt; i++) {
+        struct snapshot* s = &snaps[i];
+        printf("%5d %-16s %-5s %16llu %16llu %8llu %8llu\n", s->tid, s->name,
+               state_names[s->status], s->stats.run_cycles, s->stats.ready_cycles,
+               s->stats.voluntary_switches, s->stats.involuntary_switches);
+    }
+    free(snaps);
+
+    printf("Wakeup-to-run latency (TSC cycles):\n");
+    for (i = 0; i < SCHED_HIST_BUCKETS; i++)
+        if (latency[i] != 0)
+            printf("  %s%20llu: %llu\n", i == SCHED_HIST_BUCKETS - 1 ? ">=" : "  ", 1ULL << i,
+                   latency[i]);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -198,6 +539,8 @@ void thread_print_stats(void) {
    Priority scheduling is the goal of Problem 1-3. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
     struct thread* parent_t = thread_current();
+    struct switch_frame* frame;
+    enum intr_level old_level;
     struct thread* t;
     tid_t tid;
 
@@ -207,14 +550,31 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
     t = palloc_get_page(PAL_ZERO);
     if (t == NULL) return TID_ERROR;
 
-    /* Initialize thread. */
+    /* Initialize thread.  The fair-share scheduler has no use
+       for priorities, so every thread gets the default one and
+       donation never changes it.  The idle thread, which runs
+       only when nothing else can, is the exception. */
+    if (thread_cfs && function != idle) priority = PRI_DEFAULT;
     init_thread(t, name, priority);
+    if (!thread_alloc_stack(t)) {
+        palloc_free_page(t);
+        return TID_ERROR;
+    }
     tid = t->tid = allocate_tid();
+    t->cpu = this_cpu()->id;
+    trace_thread_name(tid, t->name);
 
     if (thread_mlfqs) {
         t->nice = parent_t->nice;
         t->recent_cpu = parent_t->recent_cpu;
-        mlfqs_update_priority(t);
+        t->recent_cpu_epoch = parent_t->recent_cpu_epoch;
+        mlfqs_update_recent_cpu(t);
+        t->priority = mlfqs_priority(t);
+    } else if (thread_cfs) {
+        /* Start out one slice in debt, so that a thread cannot get
+           ahead of the others by creating new ones. */
+        t->nice = parent_t->nice;
+        t->vruntime = this_run_queue()->min_vruntime + cfs_vdelta(thread_cfs_granularity, t);
     }
 
     /* Call the kernel_thread if it scheduled.
@@ -226,18 +586,35 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
     t->tf.es = SEL_KDSEG;
     t->tf.ss = SEL_KDSEG;
     t->tf.cs = SEL_KCSEG;
-    t->tf.eflags = FLAG_IF;
+    t->tf.eflags = FLAG_MBS; /* kernel_thread() turns interrupts on. */
+
+    /* The first switch_threads() to T returns into
+       thread_first_launch(), which enters kernel_thread() through
+       the frame above.  The frame is placed so that the stack is
+       aligned as if thread_first_launch() had been called. */
+    frame = (struct switch_frame*)(t->kstack_top - sizeof(void*) - sizeof *frame);
+    memset(frame, 0, sizeof *frame);
+    frame->rip = thread_first_launch;
+    t->ksp = (uint64_t)frame;
 
 #ifdef USERPROG
-    t->my_entry = calloc(1, sizeof(struct child_info));
+    t->my_entry = kmem_cache_zalloc(child_info_cache);
     sema_init(&t->my_entry->wait_sema, 0);
     t->my_entry->tid = tid;
     t->my_entry->wait = false;
     t->my_entry->exit_status = -1;
-    list_push_front(&parent_t->child_list, &t->my_entry->child_elem);
+    old_level = intr_disable();
+    spinlock_acquire(&parent_t->leader->process_lock);
+    list_push_front(&parent_t->leader->child_list, &t->my_entry->child_elem);
+    spinlock_release(&parent_t->leader->process_lock);
+    intr_set_level(old_level);
 #endif
 
+    old_level = intr_disable();
+    spinlock_acquire(&all_lock);
     list_push_back(&all_list, &t->allelem);
+    spinlock_release(&all_lock);
+    intr_set_level(old_level);
 
     /* Add to run queue. */
     thread_unblock(t);
@@ -248,39 +625,149 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
 
-   This function must be called with interrupts turned off.  It
-   is usually a better idea to use one of the synchronization
-   primitives in synch.h. */
+   This function must be called with interrupts turned off, and
+   only where nothing can wake the thread before it is asleep:
+   nothing but an interrupt on this CPU, or nothing at all, as for
+   the idle thread.  Otherwise use thread_block_locked(), or
+   better one of the synchronization primitives in synch.h. */
 void thread_block(void) {
+    struct run_queue* rq = this_run_queue();
+
+    ASSERT(!intr_context());
+    ASSERT(intr_get_level() == INTR_OFF);
+    TRACE(TRACE_BLOCK, 0, 0);
+    spinlock_acquire(&rq->lock);
+    __atomic_store_n(&thread_current()->status, THREAD_BLOCKED, __ATOMIC_RELEASE);
+    schedule();
+}
+
+/* Puts the current thread to sleep like thread_block().  SPIN,
+   which the caller holds, protects whatever will wake the thread,
+   and is released only once the thread counts as blocked, so a
+   waker holding SPIN cannot miss it.  SPIN is held again on
+   return.
+
+   Returns at once if a timed wait has timed out, or an
+   interruptible one has been interrupted, since these wake the
+   thread without SPIN.  A wakeup may also come from an earlier
+   wait, so callers must check what they wait for in a loop. */
+void thread_block_locked(struct spinlock* spin) {
+    struct thread* t = running_thread();
+    int blocked = THREAD_BLOCKED;
+
     ASSERT(!intr_context());
     ASSERT(intr_get_level() == INTR_OFF);
-    thread_current()->status = THREAD_BLOCKED;
+    ASSERT(spinlock_held_by_current_cpu(spin));
+    ASSERT(t->status == THREAD_RUNNING);
+
+    TRACE(TRACE_BLOCK, 0, 0);
+    __atomic_store_n(&t->status, THREAD_BLOCKED, __ATOMIC_SEQ_CST);
+    if ((__atomic_load_n(&t->timed_out, __ATOMIC_SEQ_CST) ||
+         (t->interruptible && __atomic_load_n(&t->interrupted, __ATOMIC_SEQ_CST))) &&
+        __atomic_compare_exchange_n(&t->status, &blocked, THREAD_RUNNING, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE))
+        return;
+
+    spinlock_release(spin);
+    spinlock_acquire(&this_run_queue()->lock);
     schedule();
+    spinlock_acquire(spin);
 }
 
-/* Transitions a blocked thread T to the ready-to-run state.
-   This is an error if T is not blocked.  (Use thread_yield() to
-   make the running thread ready.)
+/* Transitions a blocked thread T to the ready-to-run state.  Does
+   nothing if T is not blocked, or if another CPU is readying it
+   already.  (Use thread_yield() to make the running thread
+   ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T should preempt the running thread, the switch happens
+   when interrupts are next turned on, since the caller may hold
+   spin locks or expect to unblock a thread and update other data
+   atomically. */
 void thread_unblock(struct thread* t) {
     enum intr_level old_level;
 
     ASSERT(is_thread(t));
 
     old_level = intr_disable();
-    ASSERT(t->status == THREAD_BLOCKED);
-    t->status = THREAD_READY;
-    list_push_front(&ready_list, &t->elem);
+    wake_thread(t);
     intr_set_level(old_level);
-    if (t->priority > thread_current()->priority) {
-        if (intr_context())
-            intr_yield_on_return();
-        else
-            thread_yield();
+}
+
+/* Does the work of thread_unblock() with interrupts off.  T is
+   marked THREAD_WAKING meanwhile, so that no one else readies it
+   or re-files it, and is only queued once its CPU has switched
+   away from it. */
+static void wake_thread(struct thread* t) {
+    int blocked = THREAD_BLOCKED;
+    struct run_queue* rq;
+    bool preempt;
+
+    if (!__atomic_compare_exchange_n(&t->status, &blocked, THREAD_WAKING, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE))
+        return;
+    while (__atomic_load_n(&t->on_cpu, __ATOMIC_ACQUIRE)) asm volatile("pause");
+
+    /* A throttled EDF thread waits for its next period, whoever
+       wakes it; dl_replenish_due() readies it then. */
+    if (t->dl_throttled) {
+        __atomic_store_n(&t->status, THREAD_BLOCKED, __ATOMIC_RELEASE);
+        return;
+    }
+    if (thread_mlfqs) {
+        mlfqs_update_recent_cpu(t);
+        t->priority = mlfqs_priority(t);
+    }
+    if (is_dl_thread(t) && !dl_place_wakeup(t)) {
+        /* Woke up with its budget already spent. */
+        rq = &run_queues[t->cpu];
+        spinlock_acquire(&rq->lock);
+        dl_throttle(rq, t);
+        __atomic_store_n(&t->status, THREAD_BLOCKED, __ATOMIC_RELEASE);
+        spinlock_release(&rq->lock);
+        return;
+    }
+
+    rq = select_run_queue(t);
+    spinlock_acquire(&rq->lock);
+    t->state_tsc = t->wakeup_tsc = rdtsc();
+    TRACE(TRACE_UNBLOCK, t->tid, 0);
+    if (thread_cfs && !t->worker) cfs_place_wakeup(rq, t);
+    ready_queue_push(rq, t);
+    __atomic_store_n(&t->status, THREAD_READY, __ATOMIC_RELEASE);
+    preempt = should_preempt(rq, t);
+    spinlock_release(&rq->lock);
+
+    if (preempt) resched(rq);
+}
+
+/* Makes RQ's CPU reschedule, because a thread that should preempt
+   the one it is running has just joined RQ.  Another CPU is sent
+   an IPI, and an idle one is woken by it.  Our own CPU switches
+   on the way out of the interrupt being handled, if any, or else
+   once interrupts are next turned on. */
+static void resched(struct run_queue* rq) {
+    if (rq != this_run_queue()) {
+        __atomic_fetch_add(&rq->kicks, 1, __ATOMIC_RELAXED);
+        mp_send_reschedule(&cpus[rq - run_queues]);
+    } else if (intr_context())
+        intr_yield_on_return();
+    else
+        this_cpu()->preempt_pending = true;
+}
+
+/* Locks and returns the run queue whose lock protects T's
+   scheduling state, waiting first for any wakeup of T in
+   progress to finish.  Interrupts must be off. */
+static struct run_queue* thread_rq_lock(struct thread* t) {
+    for (;;) {
+        struct run_queue* rq;
+
+        while (__atomic_load_n(&t->status, __ATOMIC_ACQUIRE) == THREAD_WAKING)
+            asm volatile("pause");
+        rq = &run_queues[__atomic_load_n(&t->cpu, __ATOMIC_RELAXED)];
+        spinlock_acquire(&rq->lock);
+        if (rq == &run_queues[t->cpu] && t->status != THREAD_WAKING) return rq;
+        spinlock_release(&rq->lock);
     }
 }
 
@@ -294,10 +781,9 @@ struct thread* thread_current(void) {
     struct thread* t = running_thread();
 
     /* Make sure T is really a thread.
-       If either of these assertions fire, then your thread may
-       have overflowed its stack.  Each thread has less than 4 kB
-       of stack, so a few big automatic arrays or moderate
-       recursion can cause stack overflow. */
+       If either of these assertions fire, then the initial
+       thread may have overflowed its stack, which is less than
+       4 kB and, unlike the others, has no guard below it. */
     ASSERT(is_thread(t));
     ASSERT(t->status == THREAD_RUNNING);
 
@@ -310,17 +796,27 @@ tid_t thread_tid(void) { return thread_current()->tid; }
 /* Deschedules the current thread and destroys it.  Never
    returns to the caller. */
 void thread_exit(void) {
+    struct thread* t = thread_current();
+    struct run_queue* rq;
+
     ASSERT(!intr_context());
 
 #ifdef USERPROG
     process_exit();
 #endif
+    malloc_drain();
 
     /* Just set our status to dying and schedule another process.
        We will be destroyed during the call to schedule_tail(). */
     intr_disable();
-    list_remove(&thread_current()->allelem);
-    do_schedule(THREAD_DYING);
+    spinlock_acquire(&all_lock);
+    list_remove(&t->allelem);
+    spinlock_release(&all_lock);
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    if (is_dl_thread(t)) rq->dl_bw -= dl_bw(t->dl_runtime, t->dl_period);
+    t->status = THREAD_DYING;
+    schedule();
     NOT_REACHED();
 }
 
@@ -329,79 +825,289 @@ void thread_exit(void) {
 void thread_yield(void) {
     struct thread* curr = thread_current();
     enum intr_level old_level;
+    struct run_queue* rq;
 
     ASSERT(!intr_context());
 
     old_level = intr_disable();
-    if (curr != idle_thread) list_push_front(&ready_list, &curr->elem);
-    do_schedule(THREAD_READY);
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    if (is_idle_thread(curr))
+        curr->status = THREAD_READY;
+    else {
+        /* Queue CURR under its up-to-date vruntime, or, if it is an
+           EDF thread out of budget, hold it until its next period. */
+        update_curr(rq);
+        if (is_dl_thread(curr) && curr->dl_budget <= 0) {
+            dl_throttle(rq, curr);
+            __atomic_store_n(&curr->status, THREAD_BLOCKED, __ATOMIC_RELEASE);
+        } else {
+            ready_queue_push(rq, curr);
+            curr->status = THREAD_READY;
+        }
+    }
+    schedule();
     intr_set_level(old_level);
 }
 
+/* Yields the CPU because another thread should run instead.
+   Unlike thread_yield(), the switch counts as involuntary. */
+void thread_preempt(void) {
+    thread_current()->preempted = true;
+    thread_yield();
+}
+
 /// @brief
 /// 현재 스레드를 지정된 시간까지 재운다.
-/// 스레드는 sleep_list에 추가되고, wakeup_tick이 도달할 때까지 BLOCKED 상태로 전환된다.
+/// 스레드는 sleep_wheel에 추가되고, wakeup_tick이 도달할 때까지 BLOCKED 상태로 전환된다.
 ///
 /// @param wakeup_tick
 /// 스레드가 다시 깨어날 시점의 절대 tick 값 (`timer_ticks() + ticks`)
 void thread_sleep(int64_t wakeup_tick) {
+    struct thread* cur_thread = thread_current();
     enum intr_level old_level = intr_disable();
 
-    struct thread* cur_thread = thread_current();
-    cur_thread->wakeup_tick = wakeup_tick;
-    list_insert_ordered(&sleep_list, &cur_thread->elem, sleep_list_order, NULL);
-    thread_block();
+    spinlock_acquire(&sleep_lock);
+
+    /* Already due: the wheel may have expired that tick. */
+    if (wakeup_tick > timer_ticks()) {
+        cur_thread->wakeup_tick = wakeup_tick;
+        cur_thread->timed_wait = true;
+        sleep_wheel_insert(cur_thread);
+        while (!cur_thread->timed_out) thread_block_locked(&sleep_lock);
+        cur_thread->timed_out = false;
+    }
+
+    spinlock_release(&sleep_lock);
+    intr_set_level(old_level);
+}
+
+/* Blocks the running thread like thread_block_locked(), with
+   SPIN held, until it is woken or WAKEUP_TICK arrives, whichever
+   is first.  Returns false if it timed out.  Either way the
+   caller takes the thread out of whatever it was waiting in.
+   Must be called with interrupts turned off. */
+bool thread_block_timeout(int64_t wakeup_tick, struct spinlock* spin) {
+    struct thread* t = thread_current();
+    bool timed_out;
 
+    ASSERT(!intr_context());
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    /* Already due: the wheel may have expired that tick. */
+    if (wakeup_tick <= timer_ticks()) return false;
+
+    spinlock_acquire(&sleep_lock);
+    t->wakeup_tick = wakeup_tick;
+    t->timed_wait = true;
+    sleep_wheel_insert(t);
+    spinlock_release(&sleep_lock);
+
+    thread_block_locked(spin);
+
+    /* Woken before the deadline: leave the wheel. */
+    spinlock_acquire(&sleep_lock);
+    if (t->timed_wait) {
+        list_remove(&t->sleep_elem);
+        t->timed_wait = false;
+    }
+    timed_out = t->timed_out;
+    t->timed_out = false;
+    spinlock_release(&sleep_lock);
+    return !timed_out;
+}
+
+/* Interrupts T.  From now on, every interruptible wait T starts,
+   such as sema_down_interruptible(), gives up at once, and if T
+   is blocked in one now it is woken to give up.  Used to get the
+   threads of a dying process out of waits that may never end. */
+void thread_interrupt(struct thread* t) {
+    enum intr_level old_level;
+
+    ASSERT(is_thread(t));
+
+    old_level = intr_disable();
+    __atomic_store_n(&t->interrupted, true, __ATOMIC_SEQ_CST);
+    spinlock_acquire(&t->wait_lock);
+    if (t->interruptible) wake_thread(t);
+    spinlock_release(&t->wait_lock);
+    intr_set_level(old_level);
+}
+
+/* Makes the running thread's waits interruptible by
+   thread_interrupt(), or not, as INTERRUPTIBLE says. */
+void thread_set_interruptible(bool interruptible) {
+    struct thread* t = thread_current();
+    enum intr_level old_level = intr_disable();
+
+    spinlock_acquire(&t->wait_lock);
+    t->interruptible = interruptible;
+    spinlock_release(&t->wait_lock);
     intr_set_level(old_level);
 }
 
 /// @brief
 /// 현재 시각(ticks)에 도달한 스레드들을 깨워 READY 상태로 전환한다.
-/// (sleep_list의 맨 앞부터 검사하며, wakeup_tick이 아직 안 된 스레드는 남겨둔다.)
+/// (마지막으로 처리한 tick 이후의 각 tick마다 level 0의 해당 slot만 검사하며,
+///  slot이 한 바퀴 돌 때마다 상위 level의 slot을 하위 level로 내려보낸다.)
+/// 인터럽트와 sleep_lock은 tick 하나를 처리하는 동안만 끄고 잡는다.
 void wake_sleeping_threads(int64_t tick) {
-    enum intr_level old_level = intr_disable();
-    while (!list_empty(&sleep_list)) {
-        struct thread* cur_thread = list_entry(list_front(&sleep_list), struct thread, elem);
-        if (cur_thread->wakeup_tick > tick) break;
-        list_pop_front(&sleep_list);
-        thread_unblock(cur_thread);
+    for (;;) {
+        enum intr_level old_level = intr_disable();
+        spinlock_acquire(&sleep_lock);
+        if (sleep_wheel_base > tick) {
+            spinlock_release(&sleep_lock);
+            intr_set_level(old_level);
+            break;
+        }
+
+        /* Refill level 0 from the levels above when it wraps. */
+        if ((sleep_wheel_base & SLEEP_WHEEL_MASK) == 0) sleep_wheel_cascade(1);
+        sleep_wheel_expire();
+        spinlock_release(&sleep_lock);
+        intr_set_level(old_level);
     }
-    intr_set_level(old_level);
+}
+
+/* Wakes the sleepers due by TICK, the tick that just began, from
+   the timer interrupt.  Only level-0 slots are expired here, one
+   per tick the wheel is behind; the wheel stops short of a wrap,
+   whose cascade may move any number of sleepers, and returns true
+   to have wake_sleeping_threads() take it from there in a worker
+   thread.  Returns false if the wheel has caught up with TICK.
+   Must be called with interrupts turned off. */
+bool thread_wakeup_tick(int64_t tick) {
+    bool wrapped = false;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spinlock_acquire(&sleep_lock);
+    while (sleep_wheel_base <= tick) {
+        if ((sleep_wheel_base & SLEEP_WHEEL_MASK) == 0) {
+            wrapped = true;
+            break;
+        }
+        sleep_wheel_expire();
+    }
+    spinlock_release(&sleep_lock);
+    return wrapped;
+}
+
+/* Returns the earliest tick at which a sleeping thread may be
+   due.  Only level 0 of the timing wheel is searched, so when it
+   is empty up to its next wrap the wrap point is returned: that
+   is a safe lower bound for everything on the higher levels.
+   Must be called with interrupts turned off. */
+int64_t thread_next_wakeup(void) {
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spinlock_acquire(&sleep_lock);
+    int64_t tick = sleep_wheel_base;
+    do {
+        if (!list_empty(&sleep_wheel[0][tick & SLEEP_WHEEL_MASK])) break;
+        tick++;
+    } while ((tick & SLEEP_WHEEL_MASK) != 0);
+    spinlock_release(&sleep_lock);
+    return tick;
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void thread_set_priority(int new_priority) {
-    if (thread_mlfqs) return;
+    if (thread_mlfqs || thread_cfs) return;
 
     enum intr_level old_level = intr_disable();
     struct thread* t = thread_current();
+    if (is_dl_thread(t)) {
+        /* Takes effect on leaving the EDF class. */
+        t->dl_saved_priority = new_priority;
+        intr_set_level(old_level);
+        return;
+    }
     t->base_priority = new_priority;
-    if (list_empty(&thread_current()->donor_list)) t->priority = new_priority;
+    lock_donation_refresh(t);
 
-    if (!list_empty(&ready_list) &&
-        (new_priority <
-         list_entry(list_max(&ready_list, thread_priority_max, NULL), struct thread, elem)
-             ->priority))
-        thread_yield();
+    if (t->priority < ready_max_priority()) thread_preempt();
     intr_set_level(old_level);
 }
 
+/* Yields the CPU if a ready thread has higher priority than the
+   running thread, as one may after the running thread has lost a
+   priority donation without waking anyone. */
+void thread_yield_to_higher(void) {
+    enum intr_level old_level;
+
+    ASSERT(!intr_context());
+
+    if (thread_mlfqs || thread_cfs) return;
+    old_level = intr_disable();
+    if (!is_dl_thread(thread_current()) && thread_current()->priority < ready_max_priority())
+        thread_preempt();
+    intr_set_level(old_level);
+}
+
+/* Sets the effective priority of T to PRIORITY, moving T to the
+   matching run queue if it is ready.  Used by priority donation,
+   which may change the priority of a thread that is not running. */
+void thread_change_priority(struct thread* t, int priority) {
+    enum intr_level old_level;
+    struct run_queue* rq;
+
+    ASSERT(is_thread(t));
+    ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+    old_level = intr_disable();
+    lock_donation_set_priority(t, priority);
+    rq = thread_rq_lock(t);
+    if (t->status == THREAD_READY && t->queued_priority != t->priority) {
+        ready_queue_remove(t);
+        ready_queue_push(rq, t);
+    }
+    spinlock_release(&rq->lock);
+    intr_set_level(old_level);
+}
+
+/* Sets the priority of T, which is on RQ, to PRIORITY, as the
+   multi-level feedback queue scheduler recomputes it, re-filing T
+   if it is ready.  RQ must be locked. */
+static void set_priority_locked(struct run_queue* rq, struct thread* t, int priority) {
+    ASSERT(spinlock_held_by_current_cpu(&rq->lock));
+
+    t->priority = priority;
+    if (t->status == THREAD_READY && t->queued_priority != priority) {
+        ready_queue_remove(t);
+        ready_queue_push(rq, t);
+    }
+}
+
 /* Returns the current thread's priority. */
 int thread_get_priority(void) { return thread_current()->priority; }
 
 /* Sets the current thread's nice value to NICE. */
 void thread_set_nice(int nice) {
-    ASSERT(nice >= -20 && nice <= 20);
+    struct thread* t = thread_current();
+    struct run_queue* rq;
 
-    enum intr_level old_level = intr_disable();
-    thread_current()->nice = nice;
-    mlfqs_update_priority(thread_current());
+    ASSERT(nice >= NICE_MIN && nice <= NICE_MAX);
 
-    if (!list_empty(&ready_list)) {
-        struct thread* max_ready =
-            list_entry(list_max(&ready_list, thread_priority_max, NULL), struct thread, elem);
-        if (thread_current()->priority < max_ready->priority) thread_yield();
+    enum intr_level old_level = intr_disable();
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    if (thread_cfs) {
+        /* Charge the time run so far at the old weight.  The new
+           one takes effect for the rest of the slice, which the
+           next tick may cut short. */
+        update_curr(rq);
+        t->nice = nice;
+        spinlock_release(&rq->lock);
+        intr_set_level(old_level);
+        return;
     }
+    mlfqs_update_recent_cpu(t);
+    t->nice = nice;
+    set_priority_locked(rq, t, mlfqs_priority(t));
+    spinlock_release(&rq->lock);
+
+    if (t->priority < ready_max_priority()) thread_preempt();
     intr_set_level(old_level);
 }
 
@@ -415,61 +1121,240 @@ int thread_get_nice(void) {
 
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-    enum intr_level old_level = intr_disable();
-    int load = FP_TO_INT_ROUND(FP_MUL_MIXED(load_avg, 100));
-    intr_set_level(old_level);
-    return load;
+    fixed_t load = __atomic_load_n(&load_avg, __ATOMIC_RELAXED);
+    return FP_TO_INT_ROUND(FP_MUL_MIXED(load, 100));
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
     enum intr_level old_level = intr_disable();
+    mlfqs_update_recent_cpu(thread_current());
     int recent = FP_TO_INT_ROUND(FP_MUL_MIXED(thread_current()->recent_cpu, 100));
     intr_set_level(old_level);
     return recent;
 }
 
+/* Puts the current thread in the EDF class: from now on it may
+   run for RUNTIME out of every PERIOD, and must be given that
+   time within DEADLINE of the start of each period, the first of
+   which starts now.  All three are in nanoseconds, with 0 <
+   RUNTIME <= DEADLINE <= PERIOD <= 1 second.  A RUNTIME of 0
+   takes the thread back out of the class.
+
+   While in the class the thread's priority is PRI_MAX, so that
+   it donates as the most urgent of all threads when it waits on
+   a lock.  Its own priority is restored when it leaves.
+
+   Returns false, changing nothing, if the parameters are invalid
+   or admitting the thread would commit too much of its CPU. */
+bool thread_set_deadline(int64_t runtime, int64_t deadline, int64_t period) {
+    struct thread* t = thread_current();
+    struct run_queue* rq;
+    enum intr_level old_level;
+    bool refresh = false;
+    int64_t bw;
+
+    if (runtime != 0 && !(0 < runtime && runtime <= deadline && deadline <= period &&
+                          period <= DL_PERIOD_MAX))
+        return false;
+
+    old_level = intr_disable();
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    update_curr(rq);
+    bw = runtime != 0 ? dl_bw(runtime, period) : 0;
+    if (is_dl_thread(t)) bw -= dl_bw(t->dl_runtime, t->dl_period);
+    if (rq->dl_bw + bw > DL_BW_MAX) {
+        spinlock_release(&rq->lock);
+        intr_set_level(old_level);
+        return false;
+    }
+    rq->dl_bw += bw;
+
+    if (runtime == 0) {
+        bool was_dl = is_dl_thread(t);
+
+        if (was_dl) {
+            /* Back to the priority it would have without EDF. */
+            t->dl_runtime = 0;
+            t->base_priority = t->dl_saved_priority;
+            if (thread_mlfqs) set_priority_locked(rq, t, mlfqs_priority(t));
+        }
+        spinlock_release(&rq->lock);
+        if (was_dl) {
+            if (!thread_mlfqs) lock_donation_refresh(t);
+            if (t->priority < ready_max_priority()) thread_preempt();
+        }
+        intr_set_level(old_level);
+        return true;
+    }
+
+    if (!is_dl_thread(t)) {
+        t->dl_saved_priority = t->base_priority;
+        t->base_priority = PRI_MAX;
+        if (thread_mlfqs)
+            set_priority_locked(rq, t, PRI_MAX);
+        else
+            refresh = true;
+    }
+    t->dl_runtime = runtime;
+    t->dl_deadline = deadline;
+    t->dl_period = period;
+    t->dl_abs_deadline = timer_ns() + deadline;
+    t->dl_budget = runtime;
+    spinlock_release(&rq->lock);
+
+    /* Donation takes the run queue lock itself. */
+    if (refresh) lock_donation_refresh(t);
+    intr_set_level(old_level);
+    return true;
+}
+
+/* Ends the current EDF thread's job for this period: gives up the
+   rest of its budget and sleeps until its next period. */
+void thread_deadline_yield(void) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+    struct run_queue* rq;
+
+    ASSERT(is_dl_thread(t));
+
+    old_level = intr_disable();
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    update_curr(rq);
+    if (t->dl_budget > 0) t->dl_budget = 0;
+    spinlock_release(&rq->lock);
+    thread_yield();
+    intr_set_level(old_level);
+}
+
+/* Returns the absolute deadline, in timer_ns() time, of the
+   current EDF thread's job. */
+int64_t thread_get_deadline(void) {
+    struct thread* t = thread_current();
+    enum intr_level old_level;
+    int64_t deadline;
+
+    ASSERT(is_dl_thread(t));
+
+    old_level = intr_disable();
+    deadline = t->dl_abs_deadline;
+    intr_set_level(old_level);
+    return deadline;
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
+   point it initializes the BSP's idle_thread, "up"s the semaphore
+   passed to it to enable thread_start() to continue, and
+   immediately blocks.  After that, the idle thread never appears
+   in the ready list.  It is returned by next_thread_to_run() as a
    special case when the ready list is empty. */
 static void idle(void* idle_started_ UNUSED) {
     struct semaphore* idle_started = idle_started_;
 
-    idle_thread = thread_current();
+    this_cpu()->idle_thread = thread_current();
     sema_up(idle_started);
+    idle_loop();
+}
 
+/* Body of every CPU's idle thread. */
+static void idle_loop(void) {
     for (;;) {
         /* Let someone else run. */
         intr_disable();
         thread_block();
 
-        /* Re-enable interrupts and wait for the next one.
+        /* Nothing is ready to run.  Zero a free page for palloc()
+           while there are any to zero, looking again after each. */
+        if (palloc_zero_idle()) continue;
+
+        /* Still nothing to run.  With -tickless, stop the
+           periodic tick until the earliest sleeper or delayed work
+           is due; the next external interrupt catches `ticks' up
+           again.  Only the BSP runs the PIT. */
+        if (timer_tickless && this_cpu()->id == 0) {
+            int64_t deadline = thread_next_wakeup(), due = workqueue_next_due();
+            timer_tickless_enter(due < deadline ? due : deadline);
+        }
 
-           The `sti' instruction disables interrupts until the
-           completion of the next instruction, so these two
-           instructions are executed atomically.  This atomicity is
-           important; otherwise, an interrupt could be handled
-           between re-enabling interrupts and waiting for the next
-           one to occur, wasting as much as one clock tick worth of
+        /* Re-enable interrupts and wait for the next one, without
+           a window in which an interrupt could be handled between
+           the two, wasting as much as one clock tick worth of
            time.
 
            See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
            7.11.1 "HLT Instruction". */
-        asm volatile("sti; hlt" : : : "memory");
+        intr_idle();
     }
 }
 
+/* Returns true if T is one of the CPUs' idle threads.  Idle
+   threads never migrate, so T->cpu is its own CPU. */
+static bool is_idle_thread(const struct thread* t) {
+    return t == cpus[t->cpu].idle_thread;
+}
+
+/* Sets up the idle thread of secondary CPU C.  The CPU starts
+   out running on this thread's stack, so unlike other threads it
+   is never scheduled onto the CPU.  Returns a null pointer if
+   memory cannot be allocated. */
+struct thread* thread_create_ap_idle(struct cpu* c) {
+    enum intr_level old_level;
+    struct thread* t;
+    char name[16];
+
+    t = palloc_get_page(PAL_ZERO);
+    if (t == NULL) return NULL;
+
+    snprintf(name, sizeof name, "idle%d", c->id);
+    init_thread(t, name, PRI_MIN);
+    if (!thread_alloc_stack(t)) {
+        palloc_free_page(t);
+        return NULL;
+    }
+    t->tid = allocate_tid();
+    t->cpu = c->id;
+    t->status = THREAD_RUNNING;
+    t->on_cpu = true;
+    c->idle_thread = t;
+    old_level = intr_disable();
+    spinlock_acquire(&all_lock);
+    list_push_back(&all_list, &t->allelem);
+    spinlock_release(&all_lock);
+    intr_set_level(old_level);
+    return t;
+}
+
+/* Starts scheduling on a secondary CPU, which is running its
+   idle thread.  From here on the CPU takes threads from its run
+   queue and steals from the others'. */
+void thread_ap_idle(void) {
+    struct run_queue* rq;
+
+    intr_disable();
+    rq = this_run_queue();
+    spinlock_acquire(&rq->lock);
+    rq->curr = thread_current();
+    thread_current()->state_tsc = rdtsc();
+    spinlock_release(&rq->lock);
+    idle_loop();
+}
+
+/* Where a new thread starts running when switch_threads() first
+   switches to it: loads the registers thread_create() set up for
+   kernel_thread(). */
+static void thread_first_launch(void) { do_iret(&running_thread()->tf); NOT_REACHED(); }
+
 /* Function used as the basis for a kernel thread. */
 static void kernel_thread(thread_func* function, void* aux) {
     ASSERT(function != NULL);
 
-    intr_enable(); /* The scheduler runs with interrupts off. */
+    schedule_tail(); /* Finish the switch to us. */
+    intr_enable();   /* The scheduler runs with interrupts off. */
     function(aux); /* Execute the thread function. */
     thread_exit(); /* If function() returns, kill the thread. */
 }
@@ -477,7 +1362,6 @@ static void kernel_thread(thread_func* function, void* aux) {
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void init_thread(struct thread* t, const char* name, int priority) {
-    enum intr_level old_level;
     ASSERT(t != NULL);
     ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
     ASSERT(name != NULL);
@@ -485,38 +1369,306 @@ static void init_thread(struct thread* t, const char* name, int priority) {
     memset(t, 0, sizeof *t);
     t->status = THREAD_BLOCKED;
     strlcpy(t->name, name, sizeof t->name);
-    t->tf.rsp = (uint64_t)t + PGSIZE - sizeof(void*);
     t->priority = priority;
     t->magic = THREAD_MAGIC;
 
     t->base_priority = priority;
-    t->waiting_lock = NULL;
-    list_init(&t->donor_list);
+    lock_donation_init(t);
 
     t->nice = 0;
     t->recent_cpu = FP_CONST(0);
-    old_level = intr_disable();
-    intr_set_level(old_level);
+    t->recent_cpu_epoch = __atomic_load_n(&mlfqs_epoch, __ATOMIC_ACQUIRE);
 
 #ifdef USERPROG
+    spinlock_init(&t->process_lock);
+    t->leader = t;
+    t->stack_top = USER_STACK;
     list_init(&t->child_list);
     list_init(&t->fdt_block_list);
+    t->thread_cnt = 1;
+    list_init(&t->uthreads);
+    sema_init(&t->uthread_exited, 0);
+    t->stack_slots = 1;
 #endif
 }
 
+/* Gives T, initialized by init_thread(), a kernel stack of its
+   own.  Returns false if out of memory. */
+static bool thread_alloc_stack(struct thread* t) {
+    t->kstack_top = kstack_alloc();
+    if (t->kstack_top == 0) return false;
+    t->tf.rsp = t->kstack_top - sizeof(void*);
+    return true;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread.  A more urgent thread on another CPU's
+   run queue, or any thread at all when ours is empty, is stolen
+   first. */
 static struct thread* next_thread_to_run(void) {
-    if (list_empty(&ready_list))
-        return idle_thread;
-    else {
-        struct list_elem* max_elem = list_max(&ready_list, thread_priority_max, NULL);
-        list_remove(max_elem);
-        return list_entry(max_elem, struct thread, elem);
+    struct run_queue* rq = this_run_queue();
+    struct thread* t;
+
+    if (!list_empty(&rq->workers))
+        return list_entry(list_pop_front(&rq->workers), struct thread, elem);
+    if (rq->dl_cnt > 0) return dl_pop(rq);
+
+    t = steal_thread(rq);
+    if (t != NULL) return t;
+    if (rq->cnt == 0) return this_cpu()->idle_thread;
+
+    return ready_queue_pop(rq);
+}
+
+/* Appends T to the tail of RQ's queue for its priority, or, under
+   the fair-share scheduler, files it in RQ's tree by vruntime.
+   EDF threads go in RQ's tree by deadline, and worker threads on
+   RQ's list of them.  The running thread, yielding to a worker
+   before its time slice is up, goes back to the head of its queue
+   instead. */
+static void ready_queue_push(struct run_queue* rq, struct thread* t) {
+    if (t->worker) {
+        list_push_back(&rq->workers, &t->elem);
+        t->cpu = rq - run_queues;
+        return;
     }
+    if (is_dl_thread(t)) {
+        rb_insert(&rq->dl_tree, &t->dl_node);
+        rq->dl_cnt++;
+        __atomic_fetch_add(&ready_cnt, 1, __ATOMIC_RELAXED);
+        t->cpu = rq - run_queues;
+        return;
+    }
+    if (thread_cfs) {
+        rb_insert(&rq->cfs_tree, &t->cfs_node);
+        rq->cfs_load += cfs_weight(t);
+    } else {
+        /* Donation may change T's priority without the lock, so
+           T is filed under a copy. */
+        int pri = t->queued_priority = t->priority;
+
+        if (t == rq->curr && !list_empty(&rq->workers) && rq->slice_ticks < TIME_SLICE)
+            list_push_front(&rq->queues[pri], &t->elem);
+        else
+            list_push_back(&rq->queues[pri], &t->elem);
+        rq->bitmap |= 1ULL << pri;
+        if (thread_mlfqs) list_push_back(&rq->mlfqs_ready, &t->mlfqs_elem);
+    }
+    rq->cnt++;
+    __atomic_fetch_add(&ready_cnt, 1, __ATOMIC_RELAXED);
+    t->cpu = rq - run_queues;
+}
+
+/* Removes T from the run queue it is on, which must be locked. */
+static void ready_queue_remove(struct thread* t) {
+    struct run_queue* rq = &run_queues[t->cpu];
+
+    if (t->worker) {
+        list_remove(&t->elem);
+        return;
+    }
+    if (is_dl_thread(t)) {
+        rb_remove(&rq->dl_tree, &t->dl_node);
+        rq->dl_cnt--;
+        __atomic_fetch_sub(&ready_cnt, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (thread_cfs) {
+        rb_remove(&rq->cfs_tree, &t->cfs_node);
+        rq->cfs_load -= cfs_weight(t);
+    } else {
+        list_remove(&t->elem);
+        if (list_empty(&rq->queues[t->queued_priority]))
+            rq->bitmap &= ~(1ULL << t->queued_priority);
+        if (thread_mlfqs) list_remove(&t->mlfqs_elem);
+    }
+    rq->cnt--;
+    __atomic_fetch_sub(&ready_cnt, 1, __ATOMIC_RELAXED);
+    if (thread_cfs) cfs_update_min_vruntime(rq);
+}
+
+/* Removes and returns the oldest thread of RQ's highest non-empty
+   priority level, or under the fair-share scheduler the one with
+   the least vruntime.  RQ must have such a thread; EDF threads
+   are left alone. */
+static struct thread* ready_queue_pop(struct run_queue* rq) {
+    int pri = ready_queue_max_priority(rq);
+    struct thread* t;
+    ASSERT(pri >= PRI_MIN);
+
+    if (thread_cfs)
+        t = rb_entry(rb_min(&rq->cfs_tree), struct thread, cfs_node);
+    else
+        t = list_entry(list_front(&rq->queues[pri]), struct thread, elem);
+    ready_queue_remove(t);
+    return t;
+}
+
+/* Returns the highest priority among RQ's ready threads, or
+   PRI_MIN - 1 if RQ is empty.  All threads the fair-share
+   scheduler queues have PRI_DEFAULT.  EDF threads do not count:
+   this is about what ready_queue_pop() would return. */
+static int ready_queue_max_priority(const struct run_queue* rq) {
+    if (thread_cfs) return rq->cnt > 0 ? PRI_DEFAULT : PRI_MIN - 1;
+    if (rq->bitmap == 0) return PRI_MIN - 1;
+    return 63 - __builtin_clzll(rq->bitmap); /* bsr */
+}
+
+/* Returns the highest priority among all ready threads, or
+   PRI_MIN - 1 if there are none.  The other CPUs' queues are read
+   without their locks, so this is only a hint. */
+static int ready_max_priority(void) {
+    int max = PRI_MIN - 1;
+
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        int pri = ready_queue_max_priority(&run_queues[cpu]);
+        if (pri > max) max = pri;
+    }
+    return max;
+}
+
+/* Returns true if RQ's CPU takes part in scheduling.  The BSP
+   always does; the other CPUs join once they are running their
+   idle threads. */
+static bool run_queue_online(const struct run_queue* rq) {
+    if (rq == &run_queues[0]) return true;
+    return rq->curr != NULL;
+}
+
+/* Returns the thread RQ's CPU is running, unless it is idle or
+   not running threads yet.  RQ need not be locked: the result is
+   a hint, and is only compared against or read from. */
+static struct thread* run_queue_busy(const struct run_queue* rq) {
+    struct thread* curr = __atomic_load_n(&rq->curr, __ATOMIC_RELAXED);
+
+    return curr != cpus[rq - run_queues].idle_thread ? curr : NULL;
+}
+
+/* Returns the number of threads RQ's CPU has to run, counting
+   the running one unless it is idle. */
+static int run_queue_load(const struct run_queue* rq) {
+    return rq->dl_cnt + rq->cnt + (run_queue_busy(rq) != NULL);
+}
+
+/* Returns the priority of the most urgent thread RQ's CPU has to
+   run, running or ready, or PRI_MIN - 1 if it is idle.  EDF
+   threads rank as PRI_MAX. */
+static int run_queue_urgency(const struct run_queue* rq) {
+    int pri = rq->dl_cnt > 0 ? PRI_MAX : ready_queue_max_priority(rq);
+    struct thread* curr = run_queue_busy(rq);
+
+    if (curr != NULL && curr->priority > pri) pri = curr->priority;
+    return pri;
+}
+
+/* Chooses the run queue that T, which is becoming ready, should
+   join.  T goes back to the CPU it last ran on, whose cache may
+   still hold its working set, or to the waking CPU if that one
+   has less to do (wake affinity).  If T would have to wait there
+   behind work of equal or higher priority, it goes instead to
+   the CPU whose most urgent work is least urgent, idle CPUs
+   first, and among equals the least loaded.  The queues are
+   compared without their locks, so the choice may be stale by the
+   time T joins the queue, which only costs a steal later. */
+static struct run_queue* select_run_queue(struct thread* t) {
+    struct run_queue* self = this_run_queue();
+    struct run_queue* best = &run_queues[t->cpu];
+
+    /* EDF threads stay on the CPU that admitted them, and workers
+       go to the CPU whose interrupt queued their work. */
+    if (is_dl_thread(t)) return best;
+    if (t->worker) return run_queue_online(self) ? self : &run_queues[0];
+    if (!run_queue_online(best)) best = &run_queues[0];
+    if (self != best && run_queue_online(self) && run_queue_load(self) < run_queue_load(best))
+        best = self;
+
+    if (run_queue_urgency(best) >= t->priority)
+        for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+            struct run_queue* rq = &run_queues[cpu];
+            int urgency = run_queue_urgency(rq), best_urgency = run_queue_urgency(best);
+
+            if (!run_queue_online(rq)) continue;
+            if (urgency < best_urgency ||
+                (urgency == best_urgency && run_queue_load(rq) < run_queue_load(best)))
+                best = rq;
+        }
+    return best;
+}
+
+/* Returns true if T, just made ready on RQ, should preempt the
+   thread RQ's CPU is running: always if that CPU is idle or T is
+   a worker thread, never if it is running a worker, else if
+   T is an EDF thread and the running one is not or has a later
+   deadline, or if neither is and T has higher priority or, under
+   the fair-share scheduler, is more than the wakeup granularity
+   behind in vruntime. */
+static bool should_preempt(struct run_queue* rq, struct thread* t) {
+    struct thread* curr = rq->curr;
+
+    if (is_idle_thread(curr) || t->worker) return true;
+    if (curr->worker) return false;
+    if (is_dl_thread(t) || is_dl_thread(curr))
+        return is_dl_thread(t) &&
+               (!is_dl_thread(curr) || t->dl_abs_deadline < curr->dl_abs_deadline);
+    if (!thread_cfs) return t->priority > curr->priority;
+
+    update_curr(rq);
+    return curr->vruntime - t->vruntime > cfs_vdelta(thread_cfs_granularity, t);
+}
+
+/* Work stealing.  Looks on the other CPUs' run queues for a
+   thread that RQ's CPU should run before anything in RQ: the
+   highest-priority ready thread anywhere, if it beats RQ's own,
+   or, if RQ is empty, the most urgent thread of the busiest
+   queue.  Either way that thread is waiting behind something
+   else on its own CPU.  Removes the thread from its queue and
+   returns it, or returns a null pointer if there is none.
+
+   RQ must be locked.  The victim is chosen without the other
+   queues' locks, and then only tried for, since another CPU may
+   be stealing from RQ the same way. */
+static struct thread* steal_thread(struct run_queue* rq) {
+    struct run_queue* victim = NULL;
+    int victim_pri = ready_queue_max_priority(rq);
+    struct thread* t;
+
+    if (__atomic_load_n(&ready_cnt, __ATOMIC_RELAXED) == rq->cnt || !run_queue_online(rq))
+        return NULL;
+
+    /* A higher-priority thread anywhere else? */
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        struct run_queue* other = &run_queues[cpu];
+        int pri = ready_queue_max_priority(other);
+
+        if (other == rq) continue;
+        if (pri > victim_pri || (victim != NULL && pri == victim_pri && other->cnt > victim->cnt)) {
+            victim = other;
+            victim_pri = pri;
+        }
+    }
+
+    /* Otherwise, if we have nothing to do, the busiest queue. */
+    if (victim == NULL && rq->cnt == 0)
+        for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+            struct run_queue* other = &run_queues[cpu];
+
+            if (other != rq && other->cnt > 0 && (victim == NULL || other->cnt > victim->cnt))
+                victim = other;
+        }
+
+    if (victim == NULL || !spinlock_try_acquire(&victim->lock)) return NULL;
+    t = NULL;
+    if (victim->cnt > 0) {
+        t = ready_queue_pop(victim);
+        if (thread_cfs) cfs_migrate(t, victim, rq);
+        t->cpu = rq - run_queues;
+        rq->steals++;
+    }
+    spinlock_release(&victim->lock);
+    return t;
 }
 
 /* Use iretq to launch the thread */
@@ -542,24 +1694,36 @@ void do_iret(struct intr_frame* tf) {
         "movw 8(%%rsp),%%ds\n"
         "movw (%%rsp),%%es\n"
         "addq $32, %%rsp\n"
-        "iretq"
+        "testb $3, 8(%%rsp)\n" /* Returning to user mode? */
+        "jz 1f\n"
+        "swapgs\n" /* Restore the user %gs base. */
+        "1: iretq"
         :
         : "g"((uint64_t)tf)
         : "memory");
 }
 
-/* Switching the thread by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+/* Switches from the running thread to TH, saving only what
+   switch_threads() needs to resume the running thread later.
+   Returns when some other thread switches back to us.
+
+   Interrupts must be off, and it's not safe to call printf()
+   until the thread switch is complete. */
+static void thread_launch(struct thread* curr, struct thread* th) {
+    ASSERT(intr_get_level() == INTR_OFF);
 
-   At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.
+    if (thread_iret_switch)
+        thread_launch_iret(curr, th);
+    else
+        switch_threads(&curr->ksp, th->ksp);
+}
 
-   It's not safe to call printf() until the thread switch is
-   complete.  In practice that means that printf()s should be
-   added at the end of the function. */
-static void thread_launch(struct thread* th) {
-    uint64_t tf_cur = (uint64_t)&running_thread()->tf;
+/* Switches to TH the slow way, for "-iret-switch": saves every
+   register of the running thread in its intr_frame and resumes
+   TH from its own through do_iret().  Every switch must go this
+   way once one does, since the saved contexts differ. */
+static void thread_launch_iret(struct thread* curr, struct thread* th) {
+    uint64_t tf_cur = (uint64_t)&curr->tf;
     uint64_t tf = (uint64_t)&th->tf;
     ASSERT(intr_get_level() == INTR_OFF);
 
@@ -617,33 +1781,39 @@ static void thread_launch(struct thread* th) {
         : "memory");
 }
 
-/* Schedules a new process. At entry, interrupts must be off.
- * This function modify current thread's status to status and then
- * finds another thread to run and switches to it.
+/* Schedules a new process.  At entry, interrupts must be off,
+ * the running CPU's run queue must be locked, and the current
+ * thread's status must have been changed from THREAD_RUNNING.
+ * This function finds another thread to run and switches to it,
+ * and returns, with the run queue unlocked, once the current
+ * thread runs again.
  * It's not safe to call printf() in the schedule(). */
-static void do_schedule(int status) {
-    ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(thread_current()->status == THREAD_RUNNING);
-    while (!list_empty(&destruction_req)) {
-        struct thread* victim = list_entry(list_pop_front(&destruction_req), struct thread, elem);
-        palloc_free_page(victim);
-    }
-    thread_current()->status = status;
-    schedule();
-}
-
 static void schedule(void) {
+    struct run_queue* rq = this_run_queue();
     struct thread* curr = running_thread();
-    struct thread* next = next_thread_to_run();
+    struct thread* next;
 
     ASSERT(intr_get_level() == INTR_OFF);
+    ASSERT(spinlock_held_by_current_cpu(&rq->lock));
     ASSERT(curr->status != THREAD_RUNNING);
+
+    update_curr(rq);
+    next = next_thread_to_run();
     ASSERT(is_thread(next));
+
     /* Mark us as running. */
     next->status = THREAD_RUNNING;
-
-    /* Start new time slice. */
-    thread_ticks = 0;
+    next->cpu = rq - run_queues;
+    next->on_cpu = true;
+    rq->curr = next;
+    this_cpu()->preempt_pending = false;
+
+    /* Start new time slice, unless a worker thread is handing
+       the CPU back in the middle of one. */
+    if (!curr->worker) rq->slice_ticks = 0;
+    next->exec_start = timer_ns();
+    next->slice_start = next->sum_exec;
+    account_switch(curr, next);
 
 #ifdef USERPROG
     /* Activate the new address space. */
@@ -651,22 +1821,79 @@ static void schedule(void) {
 #endif
 
     if (curr != next) {
-        /* If the thread we switched from is dying, destroy its struct
-           thread. This must happen late so that thread_exit() doesn't
-           pull out the rug under itself.
-           We just queuing the page free reqeust here because the page is
-           currently used by the stack.
-           The real destruction logic will be called at the beginning of the
-           schedule(). */
-        if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
-            ASSERT(curr != next);
-            list_push_back(&destruction_req, &curr->elem);
-        }
+        TRACE(TRACE_SWITCH, next->tid, curr->status);
 
         /* Before switching the thread, we first save the information
          * of current running. */
-        thread_launch(next);
+        fpu_switch(curr, next);
+        this_cpu()->thread = next;
+        rq->prev = curr;
+        thread_launch(curr, next);
+    }
+    schedule_tail();
+}
+
+/* Finishes a switch, on the thread switched to: lets the thread
+   switched away from be woken or run on another CPU, which it
+   cannot be while still on its stack, and unlocks the run queue.
+   If that thread is dying, destroys its struct thread.  This must
+   happen late so that thread_exit() doesn't pull out the rug under
+   itself.  Called at the end of schedule(), and by a new thread
+   when it first runs, in kernel_thread(). */
+static void schedule_tail(void) {
+    struct run_queue* rq = this_run_queue();
+    struct thread* prev = rq->prev;
+    bool dying;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    rq->prev = NULL;
+    dying = prev != NULL && prev->status == THREAD_DYING && prev != initial_thread;
+    if (prev != NULL) __atomic_store_n(&prev->on_cpu, false, __ATOMIC_RELEASE);
+    spinlock_release(&rq->lock);
+
+    if (dying) {
+        kstack_free(prev->kstack_top);
+        palloc_free_page(prev);
+    }
+}
+
+/* Charges the time since the last switch to CURR, which is
+   giving up the CPU, and the time spent READY to NEXT, which is
+   getting it.  Called by schedule() with the run queue locked. */
+static void account_switch(struct thread* curr, struct thread* next) {
+    uint64_t now = rdtsc();
+
+    curr->stats.run_cycles += now - curr->state_tsc;
+    curr->state_tsc = now;
+    if (curr == next) {
+        curr->preempted = false;
+        return;
+    }
+
+    if (curr->status == THREAD_READY && curr->preempted)
+        curr->stats.involuntary_switches++;
+    else
+        curr->stats.voluntary_switches++;
+    curr->preempted = false;
+
+    /* The idle thread is never READY; it just waits to be picked. */
+    if (!is_idle_thread(next)) {
+        next->stats.ready_cycles += now - next->state_tsc;
+        if (next->wakeup_tsc != 0) {
+            int bucket = latency_bucket(now - next->wakeup_tsc);
+            next->stats.wakeup_latency[bucket]++;
+            __atomic_fetch_add(&wakeup_latency[bucket], 1, __ATOMIC_RELAXED);
+            next->wakeup_tsc = 0;
+        }
     }
+    next->state_tsc = now;
+}
+
+/* Returns the wakeup latency histogram bucket for CYCLES. */
+static int latency_bucket(uint64_t cycles) {
+    int bucket = cycles != 0 ? 63 - __builtin_clzll(cycles) : 0;
+    return bucket < SCHED_HIST_BUCKETS ? bucket : SCHED_HIST_BUCKETS - 1;
 }
 
 /* Returns a tid to use for a new thread. */
@@ -681,29 +1908,72 @@ static tid_t allocate_tid(void) {
     return tid;
 }
 
-/// @brief
-/// 두 스레드의 wakeup_tick 값을 비교하여 정렬 순서를 결정한다.
-/// (timer_sleep에서 list_insert_ordered()에 사용됨)
-///
-/// @param e1 첫 번째 리스트 요소의 포인터
-/// @param e2 두 번째 리스트 요소의 포인터
-/// @param aux 추가 인자(사용하지 않음)
-/// @return
-/// e1의 wakeup_tick이 e2보다 작으면 true, 아니면 false
-static bool sleep_list_order(const struct list_elem* e1, const struct list_elem* e2, void* aux) {
-    struct thread* thread1 = list_entry(e1, struct thread, elem);
-    struct thread* thread2 = list_entry(e2, struct thread, elem);
-    return thread1->wakeup_tick < thread2->wakeup_tick;
+/* Files sleeping thread T into the timing wheel slot that
+   covers its wakeup_tick.  A tick that has already passed is
+   treated as due on the next tick the wheel expires. */
+static void sleep_wheel_insert(struct thread* t) {
+    int64_t expires = t->wakeup_tick < sleep_wheel_base ? sleep_wheel_base : t->wakeup_tick;
+    uint64_t delta = expires - sleep_wheel_base;
+    int level;
+
+    for (level = 0; level < SLEEP_WHEEL_LEVELS - 1; level++)
+        if (delta < 1ULL << (SLEEP_WHEEL_BITS * (level + 1))) break;
+
+    /* Beyond the top level's reach: park in its farthest slot. */
+    if (delta >= 1ULL << (SLEEP_WHEEL_BITS * SLEEP_WHEEL_LEVELS))
+        expires = sleep_wheel_base + (1ULL << (SLEEP_WHEEL_BITS * SLEEP_WHEEL_LEVELS)) - 1;
+
+    int slot = (expires >> (SLEEP_WHEEL_BITS * level)) & SLEEP_WHEEL_MASK;
+    list_push_back(&sleep_wheel[level][slot], &t->sleep_elem);
 }
 
-bool thread_priority_max(const struct list_elem* e1, const struct list_elem* e2, void* aux) {
-    struct thread* thread1 = list_entry(e1, struct thread, elem);
-    struct thread* thread2 = list_entry(e2, struct thread, elem);
-    return thread1->priority <= thread2->priority;
+/* Wakes the sleepers in level 0's slot for the wheel's current
+   tick and moves the wheel on to the next one.  Any cascade into
+   that slot must have been done.  sleep_lock must be held.
+
+   A sleeper may be about to block, or blocked in a timed wait
+   whose waker has come first; either way timed_out tells it why
+   it is awake, and a timed wait takes itself out of the waiters
+   it is in. */
+static void sleep_wheel_expire(void) {
+    struct list* expired = &sleep_wheel[0][sleep_wheel_base & SLEEP_WHEEL_MASK];
+
+    ASSERT(spinlock_held_by_current_cpu(&sleep_lock));
+
+    while (!list_empty(expired)) {
+        struct thread* t = list_entry(list_pop_front(expired), struct thread, sleep_elem);
+
+        t->timed_wait = false;
+        __atomic_store_n(&t->timed_out, true, __ATOMIC_SEQ_CST);
+        wake_thread(t);
+    }
+    sleep_wheel_base++;
+}
+
+/* Moves the sleepers in LEVEL's current slot down to the lower
+   levels, first cascading LEVEL + 1 if LEVEL has wrapped too.
+   Called when the level below LEVEL wraps around to slot 0. */
+static void sleep_wheel_cascade(int level) {
+    if (level >= SLEEP_WHEEL_LEVELS) return;
+
+    int slot = (sleep_wheel_base >> (SLEEP_WHEEL_BITS * level)) & SLEEP_WHEEL_MASK;
+    struct list* bucket = &sleep_wheel[level][slot];
+    struct list pending;
+
+    /* Detach the bucket first: re-filing may land in it again. */
+    list_init(&pending);
+    while (!list_empty(bucket)) list_push_back(&pending, list_pop_front(bucket));
+    while (!list_empty(&pending))
+        sleep_wheel_insert(list_entry(list_pop_front(&pending), struct thread, sleep_elem));
+
+    if (slot == 0) sleep_wheel_cascade(level + 1);
 }
 
-static void mlfqs_update_priority(struct thread* t) {
-    if (t == idle_thread) return;
+/* Returns the priority the multi-level feedback queue scheduler
+   gives T for its recent_cpu and nice.  Idle and EDF threads keep
+   the priority they have. */
+static int mlfqs_priority(const struct thread* t) {
+    if (is_idle_thread(t) || is_dl_thread(t)) return t->priority;
 
     /* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2) */
     int new_priority = FP_TO_INT_ZERO(
@@ -714,39 +1984,283 @@ static void mlfqs_update_priority(struct thread* t) {
     else if (new_priority < PRI_MIN)
         new_priority = PRI_MIN;
 
-    t->priority = new_priority;
+    return new_priority;
 }
 
+/* Brings T's recent_cpu up to date by applying the once-per-
+   second decays it has missed since its recent_cpu_epoch. */
 static void mlfqs_update_recent_cpu(struct thread* t) {
-    if (t == idle_thread) return;
+    /* Pairs with the release in mlfqs_update_load_avg(), so that
+       the decays up to EPOCH are there to read. */
+    int64_t epoch = __atomic_load_n(&mlfqs_epoch, __ATOMIC_ACQUIRE);
 
-    /* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice */
-    fixed_t coeff = FP_DIV(FP_MUL_MIXED(load_avg, 2), FP_ADD_MIXED(FP_MUL_MIXED(load_avg, 2), 1));
+    if (is_idle_thread(t) || t->recent_cpu_epoch == epoch) {
+        t->recent_cpu_epoch = epoch;
+        return;
+    }
 
-    t->recent_cpu = FP_ADD_MIXED(FP_MUL(coeff, t->recent_cpu), t->nice);
+    if (epoch - t->recent_cpu_epoch > MLFQS_DECAY_HISTORY)
+        t->recent_cpu_epoch = epoch - MLFQS_DECAY_HISTORY;
+
+    /* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice */
+    while (t->recent_cpu_epoch < epoch) {
+        fixed_t coeff = mlfqs_decay[++t->recent_cpu_epoch % MLFQS_DECAY_HISTORY];
+        t->recent_cpu = FP_ADD_MIXED(FP_MUL(coeff, t->recent_cpu), t->nice);
+    }
 }
 
+/* Updates load_avg at the end of a second and records the
+   recent_cpu decay factor for it.  Only the BSP calls this. */
 static void mlfqs_update_load_avg(void) {
-    /* load_avg = (59/60)*load_avg + (1/60)*ready_threads */
-    int ready_threads = list_size(&ready_list);
-    if (thread_current() != idle_thread) ready_threads++;
+    /* load_avg = (59/60)*load_avg + (1/60)*ready_threads.  The
+       other CPUs are counted without their locks. */
+    int ready_threads = __atomic_load_n(&ready_cnt, __ATOMIC_RELAXED);
+    for (int cpu = 0; cpu < cpu_cnt; cpu++)
+        if (run_queue_busy(&run_queues[cpu]) != NULL) ready_threads++;
 
     fixed_t term1 = FP_MUL(FP_DIV_MIXED(FP_CONST(59), 60), load_avg);
     fixed_t term2 = FP_MUL_MIXED(FP_DIV_MIXED(FP_CONST(1), 60), ready_threads);
-    load_avg = FP_ADD(term1, term2);
+    fixed_t avg = FP_ADD(term1, term2);
+    __atomic_store_n(&load_avg, avg, __ATOMIC_RELAXED);
+
+    fixed_t coeff = FP_DIV(FP_MUL_MIXED(avg, 2), FP_ADD_MIXED(FP_MUL_MIXED(avg, 2), 1));
+    mlfqs_decay[(mlfqs_epoch + 1) % MLFQS_DECAY_HISTORY] = coeff;
+    __atomic_store_n(&mlfqs_epoch, mlfqs_epoch + 1, __ATOMIC_RELEASE);
 }
-static void mlfqs_update_recent_cpu_all(void) {
-    struct list_elem* e;
-    for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, allelem);
-        mlfqs_update_recent_cpu(t);
+
+/* Brings the next MLFQS_REFRESH_MAX ready threads on RQ's
+   mlfqs_ready up to date with the decays they have missed and
+   moves them to its back.  One whose priority changes is
+   re-filed in RQ, which moves it to the back too.  RQ must be
+   locked. */
+static void mlfqs_refresh_ready(struct run_queue* rq) {
+    int64_t epoch = __atomic_load_n(&mlfqs_epoch, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < MLFQS_REFRESH_MAX && !list_empty(&rq->mlfqs_ready); i++) {
+        struct thread* t = list_entry(list_front(&rq->mlfqs_ready), struct thread, mlfqs_elem);
+
+        if (t->recent_cpu_epoch != epoch) {
+            mlfqs_update_recent_cpu(t);
+            set_priority_locked(rq, t, mlfqs_priority(t));
+        }
+        if (list_front(&rq->mlfqs_ready) == &t->mlfqs_elem) {
+            list_remove(&t->mlfqs_elem);
+            list_push_back(&rq->mlfqs_ready, &t->mlfqs_elem);
+        }
     }
 }
 
-static void mlfqs_update_priority_all(void) {
-    struct list_elem* e;
-    for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
-        struct thread* t = list_entry(e, struct thread, allelem);
-        mlfqs_update_priority(t);
+/* Returns T's fair-share weight, as set by its nice value. */
+static int cfs_weight(const struct thread* t) { return cfs_nice_weights[t->nice - NICE_MIN]; }
+
+/* Converts DELTA ns of T's run time into vruntime: the heavier
+   T, the slower its vruntime grows. */
+static int64_t cfs_vdelta(int64_t delta, const struct thread* t) {
+    return delta * CFS_NICE_0_WEIGHT / cfs_weight(t);
+}
+
+/* Returns the time slice T should get on RQ in each scheduling
+   period: its share, by weight, of everything RQ has to run. */
+static int64_t cfs_slice(const struct run_queue* rq, const struct thread* t) {
+    int nr = run_queue_load(rq);
+    int64_t period = CFS_LATENCY;
+    int64_t load = rq->cfs_load;
+    int64_t slice;
+
+    if (nr * thread_cfs_granularity > period) period = nr * thread_cfs_granularity;
+    if (t->status != THREAD_READY) load += cfs_weight(t);
+    slice = period * cfs_weight(t) / load;
+    return slice > thread_cfs_granularity ? slice : thread_cfs_granularity;
+}
+
+/* Charges the thread running on RQ's CPU for the time since it
+   was last charged: against its budget if it is an EDF thread,
+   else, under the fair-share scheduler, in vruntime.  RQ must be
+   locked. */
+static void update_curr(struct run_queue* rq) {
+    struct thread* curr = rq->curr;
+    int64_t now, delta;
+
+    /* A queued thread was charged when it was queued; its
+       vruntime must not change while it is in the tree. */
+    if (curr == NULL || is_idle_thread(curr) || curr->status == THREAD_READY) return;
+
+    now = timer_ns();
+    delta = now - curr->exec_start;
+    curr->exec_start = now;
+    if (delta <= 0) return;
+
+    curr->sum_exec += delta;
+    if (is_dl_thread(curr))
+        curr->dl_budget -= delta;
+    else if (thread_cfs && !curr->worker) {
+        curr->vruntime += cfs_vdelta(delta, curr);
+        cfs_update_min_vruntime(rq);
+    }
+}
+
+/* Advances RQ's min_vruntime to the least vruntime among the
+   threads it has to run, but never moves it backward. */
+static void cfs_update_min_vruntime(struct run_queue* rq) {
+    struct thread* curr = rq->curr;
+    struct rb_node* first = rb_min(&rq->cfs_tree);
+    int64_t vruntime;
+
+    if (curr != NULL && curr->status == THREAD_RUNNING && !is_idle_thread(curr)) {
+        vruntime = curr->vruntime;
+        if (first != NULL) {
+            int64_t v = rb_entry(first, struct thread, cfs_node)->vruntime;
+            if (v < vruntime) vruntime = v;
+        }
+    } else if (first != NULL)
+        vruntime = rb_entry(first, struct thread, cfs_node)->vruntime;
+    else
+        return;
+
+    if (vruntime > rq->min_vruntime) rq->min_vruntime = vruntime;
+}
+
+/* Each run queue's vruntimes advance at their own pace, so T,
+   moving from FROM to TO, keeps its lead or lag relative to the
+   queue it is on rather than its absolute vruntime. */
+static void cfs_migrate(struct thread* t, struct run_queue* from, struct run_queue* to) {
+    if (from != to) t->vruntime += to->min_vruntime - from->min_vruntime;
+}
+
+/* Places T, waking up onto RQ, in vruntime.  A thread that slept
+   keeps the credit it had, up to half a scheduling period, so
+   that it runs soon without being able to bank sleep time and
+   starve the others when it wakes. */
+static void cfs_place_wakeup(struct run_queue* rq, struct thread* t) {
+    int64_t floor;
+
+    cfs_migrate(t, &run_queues[t->cpu], rq);
+    floor = rq->min_vruntime - CFS_LATENCY / 2;
+    if (t->vruntime < floor) t->vruntime = floor;
+}
+
+/* Called on each timer tick while RQ's CPU runs a thread other
+   than its idle thread.  Returns true if that thread has used up
+   its slice, or has run for at least the minimum granularity and
+   is a slice ahead of the leftmost ready thread. */
+static bool cfs_tick_preempt(struct run_queue* rq) {
+    struct thread* curr = rq->curr;
+    struct rb_node* first;
+    int64_t ran, slice;
+
+    update_curr(rq);
+    first = rb_min(&rq->cfs_tree);
+    if (first == NULL) return false;
+
+    ran = curr->sum_exec - curr->slice_start;
+    slice = cfs_slice(rq, curr);
+    if (ran >= slice) return true;
+    if (ran < thread_cfs_granularity) return false;
+
+    return curr->vruntime - rb_entry(first, struct thread, cfs_node)->vruntime > slice;
+}
+
+/* Orders threads by vruntime, least first. */
+static bool cfs_vruntime_less(const struct rb_node* a, const struct rb_node* b,
+                              void* aux UNUSED) {
+    return rb_entry(a, struct thread, cfs_node)->vruntime <
+           rb_entry(b, struct thread, cfs_node)->vruntime;
+}
+
+/* Returns the bandwidth of RUNTIME out of every PERIOD, as a
+   fraction of DL_BW_ONE. */
+static int64_t dl_bw(int64_t runtime, int64_t period) {
+    return (runtime << DL_BW_SHIFT) / period;
+}
+
+/* Removes and returns the EDF thread in RQ with the earliest
+   deadline.  RQ must have one. */
+static struct thread* dl_pop(struct run_queue* rq) {
+    struct thread* t = rb_entry(rb_min(&rq->dl_tree), struct thread, dl_node);
+
+    ready_queue_remove(t);
+    return t;
+}
+
+/* Holds T, an EDF thread on RQ that has used up its budget, until
+   the start of the period in which the budget is back in credit.
+   Each period skipped moves the deadline along one period and
+   adds one runtime to the budget, so an overrun is paid back out
+   of the periods that follow.  T must not be READY; the caller
+   blocks it if it is running.  RQ must be locked. */
+static void dl_throttle(struct run_queue* rq, struct thread* t) {
+    ASSERT(spinlock_held_by_current_cpu(&rq->lock));
+    ASSERT(t->dl_budget <= 0);
+
+    while (t->dl_budget <= 0) {
+        t->dl_abs_deadline += t->dl_period;
+        t->dl_budget += t->dl_runtime;
+    }
+    t->dl_throttled = true;
+    list_insert_ordered(&rq->dl_throttled, &t->elem, dl_release_less, NULL);
+}
+
+/* Readies the throttled EDF threads on RQ whose next period has
+   started.  Called on every timer tick, with RQ locked. */
+static void dl_replenish_due(struct run_queue* rq) {
+    int64_t now;
+
+    if (list_empty(&rq->dl_throttled)) return;
+
+    now = timer_ns();
+    while (!list_empty(&rq->dl_throttled)) {
+        struct thread* t = list_entry(list_front(&rq->dl_throttled), struct thread, elem);
+        int blocked = THREAD_BLOCKED;
+
+        if (t->dl_abs_deadline - t->dl_deadline > now) break;
+        list_pop_front(&rq->dl_throttled);
+
+        /* A stray wakeup may be looking at T; it puts T back. */
+        while (!__atomic_compare_exchange_n(&t->status, &blocked, THREAD_WAKING, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            blocked = THREAD_BLOCKED;
+            asm volatile("pause");
+        }
+        t->dl_throttled = false;
+        t->state_tsc = t->wakeup_tsc = rdtsc();
+        TRACE(TRACE_UNBLOCK, t->tid, 0);
+        ready_queue_push(rq, t);
+        __atomic_store_n(&t->status, THREAD_READY, __ATOMIC_RELEASE);
+        if (should_preempt(rq, t)) intr_yield_on_return();
+    }
+}
+
+/* Prepares EDF thread T, waking up, to be queued: T keeps its
+   current deadline and budget if it can finish the budget by the
+   deadline without using more than its bandwidth, and otherwise
+   starts a new period now.  Returns false if T has no budget
+   left for its deadline. */
+static bool dl_place_wakeup(struct thread* t) {
+    int64_t now, left;
+
+    now = timer_ns();
+    left = t->dl_abs_deadline - now;
+    if (left <= 0 ||
+        (__int128)t->dl_budget * t->dl_period > (__int128)left * t->dl_runtime) {
+        t->dl_abs_deadline = now + t->dl_deadline;
+        t->dl_budget = t->dl_runtime;
     }
+    return t->dl_budget > 0;
+}
+
+/* Orders EDF threads by absolute deadline, earliest first. */
+static bool dl_deadline_less(const struct rb_node* a, const struct rb_node* b,
+                             void* aux UNUSED) {
+    return rb_entry(a, struct thread, dl_node)->dl_abs_deadline <
+           rb_entry(b, struct thread, dl_node)->dl_abs_deadline;
+}
+
+/* Orders throttled EDF threads by the start of their next period,
+   earliest first. */
+static bool dl_release_less(const struct list_elem* a, const struct list_elem* b,
+                            void* aux UNUSED) {
+    const struct thread* ta = list_entry(a, struct thread, elem);
+    const struct thread* tb = list_entry(b, struct thread, elem);
+
+    return ta->dl_abs_deadline - ta->dl_deadline < tb->dl_abs_deadline - tb->dl_deadline;
 }
@@ -0,0 +1,198 @@
+#include "threads/trace.h"
+
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "devices/timer.h"
+#include "intrinsic.h"
+#include "threads/mp.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#endif
+
+/* Size of each CPU's ring.  When a ring is full, each new event
+   overwrites the oldest. */
+#define TRACE_RING_PAGES 32
+#define TRACE_RING_EVENTS (TRACE_RING_PAGES * PGSIZE / sizeof(struct trace_event))
+
+/* A CPU's ring of events.  Recording claims a slot by atomically
+   incrementing HEAD, so an interrupt handler, or a thread that
+   migrated while recording, never gets the same slot. */
+struct trace_ring {
+    struct trace_event* events; /* TRACE_RING_EVENTS slots, or null. */
+    uint64_t head;              /* # of events ever recorded. */
+};
+static struct trace_ring rings[CPU_MAX];
+
+/* A dump starts with this header.  Then, for each CPU, comes a
+   struct trace_dump_cpu followed by that many events, oldest
+   first.  Everything is little-endian. */
+#define TRACE_MAGIC "PTRC"
+#define TRACE_VERSION 1
+struct trace_dump_header {
+    char magic[4];       /* TRACE_MAGIC. */
+    uint32_t version;    /* TRACE_VERSION. */
+    uint64_t tsc_freq;   /* TSC cycles per second. */
+    uint32_t cpu_cnt;    /* # of CPUs that follow. */
+    uint32_t event_size; /* sizeof (struct trace_event). */
+};
+struct trace_dump_cpu {
+    uint32_t cpu;       /* CPU id. */
+    uint32_t event_cnt; /* # of events that follow. */
+};
+
+bool trace_enabled;
+
+static void record(enum trace_type, int32_t tid, uint64_t arg0, uint64_t arg1);
+
+typedef void trace_out_func(const void* data, size_t size, void* aux);
+static void trace_write(trace_out_func*, void* aux);
+static void console_out(const void* data, size_t size, void* aux);
+
+/* Allocates the rings, if tracing was requested.  Must be called
+   after mp_init() and palloc_init(). */
+void trace_init(void) {
+    struct thread* t = thread_current();
+
+    if (!trace_enabled) return;
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        rings[cpu].events = palloc_get_multiple(0, TRACE_RING_PAGES);
+        if (rings[cpu].events == NULL) PANIC("no memory for trace rings");
+    }
+    trace_thread_name(t->tid, t->name);
+}
+
+/* Records an event of TYPE with arguments ARG0 and ARG1.  Safe
+   to call from anywhere, including interrupt handlers, with no
+   locks held; use the TRACE macro rather than calling it. */
+void trace_record(enum trace_type type, uint64_t arg0, uint64_t arg1) {
+    /* Not thread_current(): we may be inside schedule(), where
+       the running thread is not marked as such. */
+    record(type, this_cpu_thread()->tid, arg0, arg1);
+}
+
+/* Records that thread TID is called NAME. */
+void trace_thread_name(int32_t tid, const char* name) {
+    uint64_t words[2] = {0, 0};
+
+    if (!trace_enabled) return;
+    strlcpy((char*)words, name, sizeof words);
+    record(TRACE_THREAD_NAME, tid, words[0], words[1]);
+}
+
+/* Records an event of TYPE for thread TID. */
+static void record(enum trace_type type, int32_t tid, uint64_t arg0, uint64_t arg1) {
+    struct cpu* c = this_cpu();
+    struct trace_ring* r = &rings[c->id];
+    struct trace_event* e;
+
+    if (r->events == NULL) return;
+    e = &r->events[__atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED) % TRACE_RING_EVENTS];
+    e->tsc = rdtsc();
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    e->tid = tid;
+    e->type = type;
+    e->cpu = c->id;
+}
+
+/* Prints the recorded events to the console in hex, between
+   "TRACE BEGIN" and "TRACE END" lines, one event per line.
+   Tracing is paused meanwhile. */
+void trace_dump(void) {
+    bool enabled = trace_enabled;
+
+    trace_enabled = false;
+    printf("TRACE BEGIN\n");
+    trace_write(console_out, NULL);
+    printf("TRACE END\n");
+    trace_enabled = enabled;
+}
+
+#ifdef FILESYS
+static size_t trace_size(void);
+static void file_out(const void* data, size_t size, void* file_);
+
+/* Writes the recorded events to a new file named FILE_NAME, in
+   the dump format, ready to be copied out with the "get" action.
+   Tracing is paused meanwhile. */
+void trace_save(const char* file_name) {
+    bool enabled = trace_enabled;
+    struct file* file;
+
+    trace_enabled = false;
+    if (!filesys_create(file_name, trace_size())) PANIC("%s: create failed", file_name);
+    file = filesys_open(file_name);
+    if (file == NULL) PANIC("%s: open failed", file_name);
+    trace_write(file_out, file);
+    file_close(file);
+    trace_enabled = enabled;
+}
+
+/* trace_out_func that appends to FILE_. */
+static void file_out(const void* data, size_t size, void* file_) {
+    if (file_write(file_, data, size) != (off_t)size) PANIC("trace file write failed");
+}
+
+/* Returns the size of the dump trace_write() would make. */
+static size_t trace_size(void) {
+    size_t size = sizeof(struct trace_dump_header);
+
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        struct trace_ring* r = &rings[cpu];
+
+        if (r->events == NULL) continue;
+        size += sizeof(struct trace_dump_cpu);
+        size += (r->head < TRACE_RING_EVENTS ? r->head : TRACE_RING_EVENTS) *
+                sizeof(struct trace_event);
+    }
+    return size;
+}
+#endif
+
+/* Passes the dump to OUT, piece by piece, each event in a piece
+   of its own. */
+static void trace_write(trace_out_func* out, void* aux) {
+    struct trace_dump_header h;
+    int cpus = 0;
+
+    for (int cpu = 0; cpu < cpu_cnt; cpu++)
+        if (rings[cpu].events != NULL) cpus++;
+
+    memcpy(h.magic, TRACE_MAGIC, sizeof h.magic);
+    h.version = TRACE_VERSION;
+    h.tsc_freq = timer_tsc_freq();
+    h.cpu_cnt = cpus;
+    h.event_size = sizeof(struct trace_event);
+    out(&h, sizeof h, aux);
+
+    for (int cpu = 0; cpu < cpu_cnt; cpu++) {
+        struct trace_ring* r = &rings[cpu];
+        struct trace_dump_cpu c;
+        uint64_t first;
+
+        if (r->events == NULL) continue;
+        first = r->head > TRACE_RING_EVENTS ? r->head - TRACE_RING_EVENTS : 0;
+        c.cpu = cpu;
+        c.event_cnt = r->head - first;
+        out(&c, sizeof c, aux);
+        for (uint64_t i = first; i < r->head; i++)
+            out(&r->events[i % TRACE_RING_EVENTS], sizeof(struct trace_event), aux);
+    }
+}
+
+/* trace_out_func that prints a line of hex. */
+static void console_out(const void* data, size_t size, void* aux UNUSED) {
+    const uint8_t* p = data;
+    char line[2 * sizeof(struct trace_event) + 1];
+
+    ASSERT(size <= sizeof(struct trace_event));
+    for (size_t i = 0; i < size; i++) snprintf(line + 2 * i, 3, "%02x", p[i]);
+    line[2 * size] = '\0';
+    printf("%s\n", line);
+}
@@ -0,0 +1,274 @@
+#include "threads/workqueue.h"
+
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "devices/timer.h"
+#include "intrinsic.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads.  One would do for work that never
+   blocks; a second keeps the queue moving while the first waits
+   on a lock. */
+#define WORKER_CNT 2
+
+/* Number of works queue_work() and queue_delayed_work() can have
+   outstanding.  They are taken from a fixed pool, since malloc()
+   cannot be called from an interrupt handler. */
+#define WORK_POOL_SIZE 64
+
+/* The queues, the pool, the statistics and each work's `queued'
+   member are protected by wq_lock. */
+static struct spinlock wq_lock;
+static struct list pending;         /* Works ready to run, oldest first. */
+static struct list delayed;         /* Delayed works, by due tick. */
+static struct semaphore work_ready; /* Upped once per work made pending. */
+
+static struct work work_pool[WORK_POOL_SIZE];
+static struct list pool_free; /* Unused work_pool[] entries. */
+
+/* Statistics. */
+static long long run_cnt;     /* # of works run. */
+static long long drop_cnt;    /* # of queue_work()s refused for want of pool entries. */
+static uint64_t delay_total;  /* Total TSC cycles from pending to running. */
+static uint64_t delay_max;    /* Longest of those delays. */
+
+static void worker(void* aux);
+static void make_pending(struct work* w);
+static struct work* pool_get(work_func* func, void* aux);
+static bool due_less(const struct list_elem*, const struct list_elem*, void* aux);
+
+/* Initializes the work queues.  Must be called before any work
+   is queued, and so before timer_init(). */
+void workqueue_init(void) {
+    spinlock_init(&wq_lock);
+    list_init(&pending);
+    list_init(&delayed);
+    sema_init(&work_ready, 0);
+    list_init(&pool_free);
+    for (int i = 0; i < WORK_POOL_SIZE; i++) list_push_back(&pool_free, &work_pool[i].elem);
+}
+
+/* Starts the worker threads.  Work queued before then waits for
+   them.  Must be called after thread_start(). */
+void workqueue_start(void) {
+    for (int i = 0; i < WORKER_CNT; i++) {
+        char name[16];
+
+        snprintf(name, sizeof name, "kworker%d", i);
+        if (thread_create(name, PRI_MAX, worker, NULL) == TID_ERROR)
+            PANIC("cannot start worker thread");
+    }
+}
+
+/* Initializes W to run FUNC(AUX) when it is scheduled. */
+void work_init(struct work* w, work_func* func, void* aux) {
+    ASSERT(w != NULL);
+    ASSERT(func != NULL);
+
+    w->func = func;
+    w->aux = aux;
+    w->due = 0;
+    w->queued_tsc = 0;
+    w->queued = false;
+}
+
+/* Queues W to run in a worker thread.  Returns false, doing
+   nothing, if W was already queued.  May be called from an
+   interrupt handler. */
+bool schedule_work(struct work* w) {
+    enum intr_level old_level = intr_disable();
+    bool queued;
+
+    spinlock_acquire(&wq_lock);
+    queued = !w->queued;
+    if (queued) {
+        w->queued = true;
+        make_pending(w);
+    }
+    spinlock_release(&wq_lock);
+    intr_set_level(old_level);
+    return queued;
+}
+
+/* Queues W to run in a worker thread once TICKS timer ticks have
+   passed, or right away if TICKS is not positive.  Returns false,
+   doing nothing, if W was already queued.  May be called from an
+   interrupt handler. */
+bool schedule_delayed_work(struct work* w, int64_t ticks) {
+    enum intr_level old_level;
+    bool queued;
+
+    if (ticks <= 0) return schedule_work(w);
+
+    old_level = intr_disable();
+    spinlock_acquire(&wq_lock);
+    queued = !w->queued;
+    if (queued) {
+        w->queued = true;
+        w->due = timer_ticks() + ticks;
+        list_insert_ordered(&delayed, &w->elem, due_less, NULL);
+    }
+    spinlock_release(&wq_lock);
+    intr_set_level(old_level);
+    return queued;
+}
+
+/* Takes W off the queue if it has not started to run yet.
+   Returns true if it was queued. */
+bool cancel_work(struct work* w) {
+    enum intr_level old_level = intr_disable();
+    bool queued;
+
+    /* A worker woken for W finds nothing to do and goes back to
+       sleep. */
+    spinlock_acquire(&wq_lock);
+    queued = w->queued;
+    if (queued) {
+        list_remove(&w->elem);
+        w->queued = false;
+    }
+    spinlock_release(&wq_lock);
+    intr_set_level(old_level);
+    return queued;
+}
+
+/* Runs FUNC(AUX) in a worker thread.  Returns false if too many
+   such calls are outstanding.  May be called from an interrupt
+   handler. */
+bool queue_work(work_func* func, void* aux) {
+    struct work* w = pool_get(func, aux);
+
+    if (w == NULL) return false;
+    schedule_work(w);
+    return true;
+}
+
+/* Runs FUNC(AUX) in a worker thread once TICKS timer ticks have
+   passed.  Returns false if too many such calls are outstanding.
+   May be called from an interrupt handler. */
+bool queue_delayed_work(work_func* func, void* aux, int64_t ticks) {
+    struct work* w = pool_get(func, aux);
+
+    if (w == NULL) return false;
+    schedule_delayed_work(w, ticks);
+    return true;
+}
+
+/* Makes the delayed works due by NOW pending.  Called by the
+   timer interrupt handler on each tick. */
+void workqueue_tick(int64_t now) {
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spinlock_acquire(&wq_lock);
+    while (!list_empty(&delayed)) {
+        struct work* w = list_entry(list_front(&delayed), struct work, elem);
+
+        if (w->due > now) break;
+        list_pop_front(&delayed);
+        make_pending(w);
+    }
+    spinlock_release(&wq_lock);
+}
+
+/* Returns the tick at which the earliest delayed work is due, or
+   INT64_MAX if there is none.  Must be called with interrupts
+   turned off. */
+int64_t workqueue_next_due(void) {
+    int64_t due = INT64_MAX;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    spinlock_acquire(&wq_lock);
+    if (!list_empty(&delayed)) due = list_entry(list_front(&delayed), struct work, elem)->due;
+    spinlock_release(&wq_lock);
+    return due;
+}
+
+/* Prints work queue statistics. */
+void workqueue_print_stats(void) {
+    printf("Workqueue: %lld works run, %lld dropped\n", run_cnt, drop_cnt);
+    if (run_cnt > 0)
+        printf("Workqueue: %" PRIu64 " cycles mean, %" PRIu64 " cycles max until run\n",
+               delay_total / run_cnt, delay_max);
+}
+
+/* A worker thread.  Runs pending works one at a time, in the
+   order they became pending. */
+static void worker(void* aux UNUSED) {
+    enum intr_level old_level = intr_disable();
+    thread_current()->worker = true;
+    intr_set_level(old_level);
+
+    for (;;) {
+        struct work* w;
+        work_func* func;
+        void* func_aux;
+        uint64_t delay;
+
+        sema_down(&work_ready);
+        old_level = intr_disable();
+        spinlock_acquire(&wq_lock);
+        if (list_empty(&pending)) {
+            /* Cancelled, or taken by another worker. */
+            spinlock_release(&wq_lock);
+            intr_set_level(old_level);
+            continue;
+        }
+        w = list_entry(list_pop_front(&pending), struct work, elem);
+        w->queued = false;
+        func = w->func;
+        func_aux = w->aux;
+
+        delay = rdtsc() - w->queued_tsc;
+        delay_total += delay;
+        if (delay > delay_max) delay_max = delay;
+        run_cnt++;
+
+        /* W may be reused from here on. */
+        if (w >= work_pool && w < work_pool + WORK_POOL_SIZE) list_push_back(&pool_free, &w->elem);
+        spinlock_release(&wq_lock);
+        intr_set_level(old_level);
+
+        func(func_aux);
+    }
+}
+
+/* Appends W to the pending works and wakes a worker for it.
+   wq_lock must be held. */
+static void make_pending(struct work* w) {
+    ASSERT(spinlock_held_by_current_cpu(&wq_lock));
+
+    w->queued_tsc = rdtsc();
+    list_push_back(&pending, &w->elem);
+    sema_up(&work_ready);
+}
+
+/* Takes a work_pool[] entry and initializes it to run
+   FUNC(AUX), or returns a null pointer if the pool is empty. */
+static struct work* pool_get(work_func* func, void* aux) {
+    enum intr_level old_level = intr_disable();
+    struct work* w = NULL;
+
+    spinlock_acquire(&wq_lock);
+    if (!list_empty(&pool_free)) {
+        w = list_entry(list_pop_front(&pool_free), struct work, elem);
+        work_init(w, func, aux);
+    } else
+        drop_cnt++;
+    spinlock_release(&wq_lock);
+    intr_set_level(old_level);
+    return w;
+}
+
+/* Orders works by due tick.  Works due together keep the order
+   they were queued in. */
+static bool due_less(const struct list_elem* a_, const struct list_elem* b_, void* aux UNUSED) {
+    const struct work* a = list_entry(a_, struct work, elem);
+    const struct work* b = list_entry(b_, struct work, elem);
+
+    return a->due < b->due;
+}
@@ -3,7 +3,9 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "intrinsic.h"
 
 /* Number of page faults processed. */
@@ -41,12 +43,10 @@ exception_init (void) {
 	/* These exceptions have DPL==0, preventing user processes from
 	   invoking them via the INT instruction.  They can still be
 	   caused indirectly, e.g. #DE can be caused by dividing by
-	   0.  */
+	   0.  #NM belongs to threads/fpu.c. */
 	intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
 	intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
 	intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-	intr_register_int (7, 0, INTR_ON, kill,
-			"#NM Device Not Available Exception");
 	intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
 	intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
 	intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -129,6 +129,7 @@ page_fault (struct intr_frame *f) {
 	   that caused the fault (that's f->rip). */
 
 	fault_addr = (void *) rcr2();
+	TRACE (TRACE_PAGE_FAULT, fault_addr, f->error_code);
 
 	/* Turn interrupts back on (they were only off so that we could
 	   be assured of reading CR2 before it changed). */
@@ -140,13 +141,23 @@ page_fault (struct intr_frame *f) {
 	write = (f->error_code & PF_W) != 0;
 	user = (f->error_code & PF_U) != 0;
 
+	/* Running off the end of a kernel stack is fatal. */
+	if (!user)
+		kstack_check_fault (f, (uint64_t) fault_addr);
+
 #ifdef VM
 	/* For project 3 and later. */
-	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
+	if (vm_try_handle_fault (f, fault_addr, user, write, not_present)) {
+		TRACE (TRACE_PAGE_FAULT_DONE, fault_addr, 1);
 		return;
+	}
 #endif
+	TRACE (TRACE_PAGE_FAULT_DONE, fault_addr, 0);
 	if(user){
-		thread_current()->my_entry->exit_status = -1;
+		struct thread *leader = thread_current ()->leader;
+
+		if (!leader->exiting)
+			leader->my_entry->exit_status = -1;
 		thread_exit();
 	}
 
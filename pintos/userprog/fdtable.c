@@ -3,8 +3,12 @@
 struct file* stdin_entry = NULL;
 struct file* stdout_entry = NULL;
 
-/* init stdin, stdout entry (fake) */
+/* Cache of struct fdt_block. */
+static struct kmem_cache* fdt_block_cache;
+
+/* init stdin, stdout entry (fake) and the fdt_block cache */
 void init_std_fds() {
+    fdt_block_cache = kmem_cache_create("fdt_block", sizeof(struct fdt_block), 0, NULL);
     stdin_entry = (struct file*)malloc(sizeof(struct file*));
     if (!stdin_entry) PANIC("malloc failed\n");
     stdout_entry = (struct file*)malloc(sizeof(struct file*));
@@ -14,7 +18,7 @@ void init_std_fds() {
 void fdt_list_init(struct thread* t) {
     struct fdt_block* first_fdt_block;
 
-    first_fdt_block = (struct fdt_block*)calloc(1, sizeof(struct fdt_block));
+    first_fdt_block = kmem_cache_zalloc(fdt_block_cache);
     if (!first_fdt_block) PANIC("malloc failed\n");
 
     first_fdt_block->entry[0] = stdin_entry;
@@ -114,14 +118,14 @@ void fdt_list_cleanup(struct thread* t) {
             entry = block->entry[i];
             if (entry && entry != stdout_entry && entry != stdin_entry) file_close(entry);
         }
-        free(block);
+        kmem_cache_free(fdt_block_cache, block);
     }
 }
 
 bool fdt_block_append(struct thread* t) {
     struct fdt_block* block;
 
-    block = (struct fdt_block*)calloc(1, sizeof(struct fdt_block));
+    block = kmem_cache_zalloc(fdt_block_cache);
     if (!block) return false;
     list_push_back(&(t->fdt_block_list), &(block->elem));
     return true;
@@ -0,0 +1,209 @@
+#include "userprog/futex.h"
+
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/validate.h"
+
+/* Fast user-space mutexes.
+
+   A user-space lock or condition keeps its state in an int in
+   user memory and updates it with atomic instructions, so that as
+   long as there is no contention it never enters the kernel.  A
+   thread that finds it has to wait calls futex_wait() on the int,
+   and the thread that releases it calls futex_wake() if anyone
+   might be waiting.
+
+   Waiters are keyed by the physical address of the int, not its
+   virtual address, so that processes sharing the frame through
+   different mappings meet on the same key.  This relies on a
+   frame's contents staying where they are while a thread waits on
+   them; frames are never evicted yet.  The waiters are kept in a
+   fixed table of lists hashed by key.  Each bucket has a spin lock
+   of its own, under which a waiter checks the int and joins the
+   list, so that a wake on the same int, which takes the same lock,
+   cannot come in between. */
+
+#define FUTEX_BUCKET_CNT 64 /* Number of hash table buckets. */
+
+/* A thread waiting in futex_wait(). */
+struct futex_waiter {
+    struct list_elem elem;      /* Element of a bucket's list. */
+    uintptr_t key;              /* Physical address waited on. */
+    struct thread* thread;      /* Waiting thread. */
+    struct semaphore semaphore; /* Upped to wake the thread. */
+};
+
+/* A bucket of the wait table. */
+struct futex_bucket {
+    struct spinlock lock; /* Protects WAITERS. */
+    struct list waiters;  /* struct futex_waiter, by arrival. */
+};
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+static void* futex_kva(int* uaddr, enum intr_level* old_level);
+static struct futex_bucket* futex_bucket(uintptr_t key);
+static bool futex_waiter_less(const struct list_elem*, const struct list_elem*, void* aux);
+
+/* Initializes the futex wait table. */
+void futex_init(void) {
+    for (int i = 0; i < FUTEX_BUCKET_CNT; i++) {
+        spinlock_init(&buckets[i].lock);
+        list_init(&buckets[i].waiters);
+    }
+}
+
+/* If the int at UADDR still equals EXPECTED, sleeps until another
+   thread calls futex_wake() on the same int, and returns 0.
+   Otherwise returns -1 at once: whatever the caller saw that made
+   it decide to wait has already changed.  The comparison and
+   going to sleep are atomic with respect to futex_wake().  Also
+   returns -1 if the caller's process is exiting.
+
+   UADDR must be a valid, aligned user address. */
+int futex_wait(int* uaddr, int expected) {
+    struct futex_waiter w;
+    struct futex_bucket* b;
+    enum intr_level old_level;
+    void* kva;
+
+    ASSERT((uintptr_t)uaddr % sizeof *uaddr == 0);
+
+    kva = futex_kva(uaddr, &old_level);
+    if (kva == NULL) return -1;
+    w.key = vtop(kva);
+    b = futex_bucket(w.key);
+    spinlock_acquire(&b->lock);
+    if (*(int*)kva != expected || thread_current()->leader->exiting) {
+        spinlock_release(&b->lock);
+        intr_set_level(old_level);
+        return -1;
+    }
+
+    /* A wake from here on finds us, and the semaphore keeps it
+       until we get to sleep. */
+    w.thread = thread_current();
+    sema_init(&w.semaphore, 0);
+    list_push_back(&b->waiters, &w.elem);
+    spinlock_release(&b->lock);
+    sema_down(&w.semaphore);
+    intr_set_level(old_level);
+    return 0;
+}
+
+/* Wakes up to COUNT threads waiting on the int at UADDR, highest
+   priority first, and returns the number woken.
+
+   UADDR must be a valid, aligned user address. */
+int futex_wake(int* uaddr, int count) {
+    enum intr_level old_level;
+    struct futex_bucket* b;
+    struct list* bucket;
+    struct list waiters;
+    uintptr_t key;
+    void* kva;
+    int woken = 0;
+
+    ASSERT((uintptr_t)uaddr % sizeof *uaddr == 0);
+
+    kva = futex_kva(uaddr, &old_level);
+    if (kva == NULL) return 0;
+
+    /* Gather this key's waiters apart from others in the bucket. */
+    key = vtop(kva);
+    b = futex_bucket(key);
+    bucket = &b->waiters;
+    spinlock_acquire(&b->lock);
+    list_init(&waiters);
+    for (struct list_elem* e = list_begin(bucket); e != list_end(bucket);) {
+        struct futex_waiter* w = list_entry(e, struct futex_waiter, elem);
+
+        e = list_next(e);
+        if (w->key == key) {
+            list_remove(&w->elem);
+            list_push_back(&waiters, &w->elem);
+        }
+    }
+
+    while (woken < count && !list_empty(&waiters)) {
+        struct list_elem* e = list_max(&waiters, futex_waiter_less, NULL);
+
+        list_remove(e);
+        sema_up(&list_entry(e, struct futex_waiter, elem)->semaphore);
+        woken++;
+    }
+
+    /* The rest keep waiting, in their original order. */
+    while (!list_empty(&waiters)) list_push_back(bucket, list_pop_front(&waiters));
+    spinlock_release(&b->lock);
+    intr_set_level(old_level);
+    return woken;
+}
+
+/* Wakes every thread of LEADER's process waiting on any futex,
+   for the process to exit.  The caller should already have set
+   LEADER->exiting, so that no thread goes back to sleep. */
+void futex_wake_process(struct thread* leader) {
+    enum intr_level old_level = intr_disable();
+    struct list waiters;
+
+    /* Gather them all before waking any, since a woken thread may
+       run at once. */
+    list_init(&waiters);
+    for (int i = 0; i < FUTEX_BUCKET_CNT; i++) {
+        struct list* bucket = &buckets[i].waiters;
+
+        spinlock_acquire(&buckets[i].lock);
+        for (struct list_elem* e = list_begin(bucket); e != list_end(bucket);) {
+            struct futex_waiter* w = list_entry(e, struct futex_waiter, elem);
+
+            e = list_next(e);
+            if (w->thread->leader == leader) {
+                list_remove(&w->elem);
+                list_push_back(&waiters, &w->elem);
+            }
+        }
+        spinlock_release(&buckets[i].lock);
+    }
+
+    while (!list_empty(&waiters))
+        sema_up(&list_entry(list_pop_front(&waiters), struct futex_waiter, elem)->semaphore);
+    intr_set_level(old_level);
+}
+
+/* Turns interrupts off, saving the previous level in *OLD_LEVEL,
+   and returns the kernel virtual address of the int at UADDR,
+   faulting its page in first if needed.  If UADDR is not mapped,
+   restores the interrupt level and returns a null pointer. */
+static void* futex_kva(int* uaddr, enum intr_level* old_level) {
+    for (;;) {
+        void* kva;
+
+        *old_level = intr_disable();
+        kva = pml4_get_page(thread_current()->pml4, uaddr);
+        if (kva != NULL) return kva;
+        intr_set_level(*old_level);
+
+        if (!valid_address(uaddr, false)) return NULL;
+    }
+}
+
+/* Returns the bucket for KEY. */
+static struct futex_bucket* futex_bucket(uintptr_t key) {
+    return &buckets[hash_bytes(&key, sizeof key) % FUTEX_BUCKET_CNT];
+}
+
+/* Orders futex waiters by the priority of the waiting thread. */
+static bool futex_waiter_less(const struct list_elem* a, const struct list_elem* b,
+                              void* aux UNUSED) {
+    return list_entry(a, struct futex_waiter, elem)->thread->priority <
+           list_entry(b, struct futex_waiter, elem)->thread->priority;
+}
@@ -1,6 +1,6 @@
 #include "userprog/gdt.h"
 #include <debug.h>
-#include "userprog/tss.h"
+#include "threads/kstack.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -37,31 +37,12 @@ struct segment_desc {
 	unsigned base_31_24 : 8;
 };
 
-struct segment_descriptor64 {
-	unsigned lim_15_0 : 16;
-	unsigned base_15_0 : 16;
-	unsigned base_23_16 : 8;
-	unsigned type : 4;
-	unsigned s : 1;
-	unsigned dpl : 2;
-	unsigned p : 1;
-	unsigned lim_19_16 : 4;
-	unsigned avl : 1;
-	unsigned rsv1 : 2;
-	unsigned g : 1;
-	unsigned base_31_24 : 8;
-	uint32_t base_63_32;
-	unsigned res1 : 8;
-	unsigned clear : 8;
-	unsigned res2 : 16;
-};
-
 #define SEG64(type, base, lim, dpl) (struct segment_desc) \
 { ((lim) >> 12) & 0xffff, (base) & 0xffff, ((base) >> 16) & 0xff, \
 	type, 1, dpl, 1, (unsigned) (lim) >> 28, 0, 1, 0, 1, \
 	(unsigned) (base) >> 24 }
 
-static struct segment_desc gdt[SEL_CNT] = {
+static struct segment_desc gdt[GDT_ENTRY_CNT] = {
 	[SEL_NULL >> 3] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 	[SEL_KCSEG >> 3] = SEG64 (0xa, 0x0, 0xffffffff, 0),
 	[SEL_KDSEG >> 3] = SEG64 (0x2, 0x0, 0xffffffff, 0),
@@ -81,33 +62,11 @@ struct desc_ptr gdt_ds = {
    include user-mode selectors or a TSS, but we need both now. */
 void
 gdt_init (void) {
-	/* Initialize GDT. */
-	struct segment_descriptor64 *tss_desc =
-		(struct segment_descriptor64 *) &gdt[SEL_TSS >> 3];
-	struct task_state *tss = tss_get ();
-
-	*tss_desc = (struct segment_descriptor64) {
-		.lim_15_0 = (uint64_t) (sizeof (struct task_state)) & 0xffff,
-		.base_15_0 = (uint64_t) (tss) & 0xffff,
-		.base_23_16 = ((uint64_t) (tss) >> 16) & 0xff,
-		.type = 0x9,
-		.s = 0,
-		.dpl = 0,
-		.p = 1,
-		.lim_19_16 = ((uint64_t)(sizeof (struct task_state)) >> 16) & 0xf,
-		.avl = 0,
-		.rsv1 = 0,
-		.g = 0,
-		.base_31_24 = ((uint64_t)(tss) >> 24) & 0xff,
-		.base_63_32 = ((uint64_t)(tss) >> 32) & 0xffffffff,
-		.res1 = 0,
-		.clear = 0,
-		.res2 = 0
-	};
-
+	/* The TSS descriptors are filled in by kstack_cpu_init(). */
 	lgdt (&gdt_ds);
-	/* reload segment registers */
-	asm volatile("movw %%ax, %%gs" :: "a" (SEL_UDSEG));
+	/* reload segment registers.  %gs is left alone: loading it
+	   would clear the %gs base, which holds the per-CPU pointer
+	   (see threads/mp.h). */
 	asm volatile("movw %%ax, %%fs" :: "a" (0));
 	asm volatile("movw %%ax, %%es" :: "a" (SEL_KDSEG));
 	asm volatile("movw %%ax, %%ds" :: "a" (SEL_KDSEG));
@@ -12,6 +12,7 @@
 #include "filesys/filesys.h"
 #include "intrinsic.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/mmu.h"
@@ -20,6 +21,7 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/fdtable.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -35,7 +37,33 @@ struct fork_struct {
     bool success;
 };
 
+/* A user thread other than its process's leader, as the rest of
+   the process sees it.  Freed by whoever joins it, or by the
+   leader when the process ends. */
+struct uthread {
+    tid_t tid;               /* Thread identifier. */
+    struct thread* thread;   /* The thread, until it exits. */
+    int slot;                /* User stack slot. */
+    bool joined;             /* Claimed by process_thread_join()? */
+    struct semaphore exited; /* Upped when the thread exits. */
+    struct list_elem elem;   /* Element of the leader's uthreads. */
+};
+
+/* Handed from process_thread_create() to the new thread. */
+struct uthread_args {
+    struct thread* leader;
+    struct uthread* uthread;
+    struct intr_frame if_;
+    struct semaphore started;
+    bool success;
+};
+
 static void process_cleanup(void);
+static void process_set_exiting(struct thread* leader);
+static void uthread_start(void*);
+static bool uthread_setup_stack(uintptr_t stack_top);
+static void uthread_release(void);
+static struct child_info* uthread_forget_child(struct thread* leader, tid_t tid);
 static bool load(const char* file_name, int argc, char** argv, struct intr_frame* if_);
 static void initd(void* f_name);
 static void __do_fork(void*);
@@ -161,19 +189,29 @@ static void __do_fork(void* aux) {
     if (current->pml4 == NULL) goto error;
 
     process_activate(current);
-    if (parent->current_file)
+    if (parent->leader->current_file)
     {
-        thread_current()->current_file = file_duplicate(parent->current_file);
+        thread_current()->current_file = file_duplicate(parent->leader->current_file);
         ASSERT (thread_current()->current_file);
     }
+
+    /* Only the forking thread comes along, on its own stack. */
+    current->stack_top = parent->stack_top;
+    current->stack_slots |= 1u << (USER_STACK - parent->stack_top) / USER_STACK_SLOT_SIZE;
 #ifdef VM
     supplemental_page_table_init(&current->spt);
-    if (!supplemental_page_table_copy(&current->spt, &parent->spt)) goto error;
+    lock_acquire(&parent->leader->spt.lock);
+    succ = supplemental_page_table_copy(&current->spt, &parent->leader->spt);
+    lock_release(&parent->leader->spt.lock);
+    if (!succ) goto error;
 #else
     if (!pml4_for_each(parent->pml4, duplicate_pte, parent)) goto error;
 #endif
     process_init();
-    succ = fd_table_copy(current, parent);
+    succ = fpu_copy(current, parent);
+    lock_acquire(&file_lock);
+    succ = succ && fd_table_copy(current, parent->leader);
+    lock_release(&file_lock);
 
     /* Finally, switch to the newly created process. */
     if (succ) {
@@ -212,6 +250,8 @@ int process_exec(void* f_name) {
 
     /* We first kill the current context */
     process_cleanup();
+    thread_current()->stack_top = USER_STACK;
+    thread_current()->stack_slots = 1;
 #ifdef VM
     supplemental_page_table_init(&(thread_current()->spt));
 #endif
@@ -238,32 +278,82 @@ int process_exec(void* f_name) {
  * This function will be implemented in problem 2-2.  For now, it
  * does nothing. */
 int process_wait(tid_t child_tid) {
-    struct thread* cur = thread_current();
+    struct thread* leader = thread_current()->leader;
     struct child_info* child_info = NULL;
+    enum intr_level old_level;
 
-    struct list_elem* e = list_begin(&cur->child_list);
-    for (; e != list_end(&cur->child_list); e = list_next(e)) {
+    /* Any thread of the process may wait, so keep the others out. */
+    old_level = intr_disable();
+    spinlock_acquire(&leader->process_lock);
+    struct list_elem* e = list_begin(&leader->child_list);
+    for (; e != list_end(&leader->child_list); e = list_next(e)) {
         child_info = list_entry(e, struct child_info, child_elem);
         if (child_info->tid == child_tid) break;
     }
 
-    if (e == list_end(&cur->child_list) || child_info->wait) return -1;
+    if (e == list_end(&leader->child_list) || child_info->wait) {
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        return -1;
+    }
     child_info->wait = true;
-    sema_down(&child_info->wait_sema);
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+
+    /* The process may be told to exit while the child runs on. */
+    if (!sema_down_interruptible(&child_info->wait_sema)) {
+        old_level = intr_disable();
+        spinlock_acquire(&leader->process_lock);
+        child_info->wait = false;
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        return -1;
+    }
 
     int result = child_info->exit_status;
+    old_level = intr_disable();
+    spinlock_acquire(&leader->process_lock);
     list_remove(&child_info->child_elem);
-    free(child_info);
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+    kmem_cache_free(child_info_cache, child_info);
     return result;
 }
 
-/* Exit the process. This function is called by thread_exit (). */
+/* Exit the process. This function is called by thread_exit ().
+ * Unless the thread is leaving through SYS_THREAD_EXIT, the whole
+ * process exits with it.  Only the last of the process's threads
+ * tears it down. */
 void process_exit(void) {
     struct thread* cur = thread_current();
+    enum intr_level old_level;
 
     if (cur->pml4 == NULL) return;
+    if (!cur->exit_thread_only) process_set_exiting(cur->leader);
+    if (cur != cur->leader) {
+        uthread_release();
+        return;
+    }
+
+    /* The process's resources live in this thread, so it must stay
+     * until the other threads are gone. */
+    old_level = intr_disable();
+    spinlock_acquire(&cur->process_lock);
+    cur->thread_cnt--;
+    while (cur->thread_cnt > 0) {
+        spinlock_release(&cur->process_lock);
+        sema_down(&cur->uthread_exited);
+        spinlock_acquire(&cur->process_lock);
+    }
+    spinlock_release(&cur->process_lock);
+    intr_set_level(old_level);
+
+    /* Every thread left through SYS_THREAD_EXIT. */
+    if (!cur->exiting) cur->my_entry->exit_status = 0;
     printf("%s: exit(%d)\n", cur->name, cur->my_entry->exit_status);
 
+    while (!list_empty(&cur->uthreads))
+        free(list_entry(list_pop_front(&cur->uthreads), struct uthread, elem));
     fdt_list_cleanup(cur);
     process_cleanup();
     sema_up(&cur->my_entry->wait_sema);
@@ -277,6 +367,8 @@ static void process_cleanup(void) {
 #endif
 
     uint64_t* pml4;
+    fpu_release(curr);
+
     /* Destroy the current process's page directory and switch back
      * to the kernel-only page directory. */
     pml4 = curr->pml4;
@@ -311,6 +403,238 @@ void process_activate(struct thread* next) {
     tss_update(next);
 }
 
+/* Starts a new thread in the current process, running user code
+ * at ENTRY with ARG1 and ARG2 as its first two arguments, on a
+ * stack of its own.  Returns the new thread's id, or TID_ERROR if
+ * it cannot be started. */
+tid_t process_thread_create(void* entry, void* arg1, void* arg2) {
+    struct thread* leader = thread_current()->leader;
+    struct uthread_args args;
+    struct uthread* ut;
+    struct child_info* child_info;
+    enum intr_level old_level;
+    tid_t tid;
+    int slot;
+
+    ut = malloc(sizeof *ut);
+    if (ut == NULL) return TID_ERROR;
+
+    old_level = intr_disable();
+    spinlock_acquire(&leader->process_lock);
+    for (slot = 1; slot < USER_THREAD_MAX; slot++)
+        if (!(leader->stack_slots & (1u << slot))) break;
+    if (leader->exiting || slot == USER_THREAD_MAX) {
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        free(ut);
+        return TID_ERROR;
+    }
+    leader->stack_slots |= 1u << slot;
+    leader->thread_cnt++;
+    ut->tid = TID_ERROR;
+    ut->slot = slot;
+    ut->joined = false;
+    sema_init(&ut->exited, 0);
+    list_push_back(&leader->uthreads, &ut->elem);
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+
+    /* Enter ENTRY as if called, with the stack 16-byte aligned
+     * before the call pushed its return address. */
+    memset(&args.if_, 0, sizeof args.if_);
+    args.if_.ds = args.if_.es = args.if_.ss = SEL_UDSEG;
+    args.if_.cs = SEL_UCSEG;
+    args.if_.eflags = FLAG_IF | FLAG_MBS;
+    args.if_.rip = (uintptr_t)entry;
+    args.if_.R.rdi = (uint64_t)arg1;
+    args.if_.R.rsi = (uint64_t)arg2;
+    args.if_.rsp = USER_STACK - slot * USER_STACK_SLOT_SIZE - sizeof(void*);
+    args.leader = leader;
+    args.uthread = ut;
+    sema_init(&args.started, 0);
+    args.success = false;
+
+    tid = thread_create(leader->name, PRI_DEFAULT, uthread_start, &args);
+    if (tid == TID_ERROR) {
+        old_level = intr_disable();
+        spinlock_acquire(&leader->process_lock);
+        list_remove(&ut->elem);
+        leader->stack_slots &= ~(1u << slot);
+        leader->thread_cnt--;
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        free(ut);
+        return TID_ERROR;
+    }
+    child_info = uthread_forget_child(leader, tid);
+
+    /* The new thread has let go of CHILD_INFO by the time it
+     * starts. */
+    sema_down(&args.started);
+    kmem_cache_free(child_info_cache, child_info);
+    if (!args.success) {
+        sema_down(&ut->exited);
+        old_level = intr_disable();
+        spinlock_acquire(&leader->process_lock);
+        list_remove(&ut->elem);
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        free(ut);
+        return TID_ERROR;
+    }
+    return tid;
+}
+
+/* Waits for thread TID of the current process to exit.  Returns
+ * 0 once it has, or -1 at once if TID is not a thread of the
+ * process other than its leader or has already been joined. */
+int process_thread_join(tid_t tid) {
+    struct thread* leader = thread_current()->leader;
+    struct uthread* ut = NULL;
+    enum intr_level old_level;
+    struct list_elem* e;
+
+    old_level = intr_disable();
+    spinlock_acquire(&leader->process_lock);
+    for (e = list_begin(&leader->uthreads); e != list_end(&leader->uthreads); e = list_next(e)) {
+        ut = list_entry(e, struct uthread, elem);
+        if (ut->tid == tid) break;
+    }
+    if (e == list_end(&leader->uthreads) || ut->joined || tid == thread_tid()) {
+        spinlock_release(&leader->process_lock);
+        intr_set_level(old_level);
+        return -1;
+    }
+    ut->joined = true;
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+
+    sema_down(&ut->exited);
+
+    old_level = intr_disable();
+    spinlock_acquire(&leader->process_lock);
+    list_remove(&ut->elem);
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+    free(ut);
+    return 0;
+}
+
+/* Kills the current thread if its process is exiting.  Called on
+ * the way back to user mode, from system calls and from external
+ * interrupts that arrived in user mode. */
+void process_check_exiting(void) {
+    struct thread* cur = thread_current();
+
+    if (cur->pml4 == NULL || !cur->leader->exiting) return;
+    intr_enable();
+    thread_exit();
+}
+
+/* Marks LEADER's process as exiting, so that each of its threads
+ * dies the next time it would return to user mode.  Wakes the
+ * ones asleep in futex_wait() to let them, and interrupts the
+ * others, so that none is left in a wait that may never end,
+ * such as for a key or for a child, while the leader waits for
+ * it in process_exit(). */
+static void process_set_exiting(struct thread* leader) {
+    struct thread* cur = thread_current();
+    enum intr_level old_level = intr_disable();
+
+    spinlock_acquire(&leader->process_lock);
+    if (!leader->exiting) {
+        leader->exiting = true;
+        futex_wake_process(leader);
+        if (leader != cur) thread_interrupt(leader);
+        for (struct list_elem* e = list_begin(&leader->uthreads); e != list_end(&leader->uthreads);
+             e = list_next(e)) {
+            struct uthread* ut = list_entry(e, struct uthread, elem);
+            if (ut->thread != NULL && ut->thread != cur) thread_interrupt(ut->thread);
+        }
+    }
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+}
+
+/* A thread function that enters user code in an existing process,
+ * for process_thread_create(). */
+static void uthread_start(void* aux) {
+    struct uthread_args* args = aux;
+    struct thread* cur = thread_current();
+    struct intr_frame if_;
+    bool success;
+
+    cur->leader = args->leader;
+    cur->uthread = args->uthread;
+    cur->my_entry = NULL;
+    cur->uthread->tid = cur->tid;
+    cur->uthread->thread = cur;
+    cur->stack_top = USER_STACK - cur->uthread->slot * USER_STACK_SLOT_SIZE;
+    cur->pml4 = cur->leader->pml4;
+    process_activate(cur);
+
+    /* ARGS is gone once the creator wakes up. */
+    memcpy(&if_, &args->if_, sizeof if_);
+    success = uthread_setup_stack(cur->stack_top);
+    args->success = success;
+    sema_up(&args->started);
+    if (!success) {
+        cur->exit_thread_only = true;
+        thread_exit();
+    }
+
+    process_check_exiting();
+    do_iret(&if_);
+}
+
+/* Lets go of the process for a thread other than its leader.  The
+ * leader frees everything once the last such thread is gone. */
+static void uthread_release(void) {
+    struct thread* cur = thread_current();
+    struct thread* leader = cur->leader;
+    enum intr_level old_level;
+
+    fpu_release(cur);
+
+    /* The leader may destroy the page tables as soon as it hears
+     * that we are gone, so stop using them first. */
+    old_level = intr_disable();
+    cur->pml4 = NULL;
+    pml4_activate(NULL);
+    spinlock_acquire(&leader->process_lock);
+    leader->stack_slots &= ~(1u << cur->uthread->slot);
+    leader->thread_cnt--;
+    cur->uthread->thread = NULL;
+    sema_up(&cur->uthread->exited);
+    sema_up(&leader->uthread_exited);
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+}
+
+/* thread_create() registered thread TID as a child process of
+ * LEADER's process, which a user thread is not.  Takes the record
+ * off LEADER's child list and returns it, for the caller to free
+ * once the thread no longer points to it. */
+static struct child_info* uthread_forget_child(struct thread* leader, tid_t tid) {
+    enum intr_level old_level = intr_disable();
+    struct child_info* child_info = NULL;
+
+    spinlock_acquire(&leader->process_lock);
+    for (struct list_elem* e = list_begin(&leader->child_list); e != list_end(&leader->child_list);
+         e = list_next(e)) {
+        struct child_info* c = list_entry(e, struct child_info, child_elem);
+
+        if (c->tid == tid) {
+            list_remove(e);
+            child_info = c;
+            break;
+        }
+    }
+    spinlock_release(&leader->process_lock);
+    intr_set_level(old_level);
+    return child_info;
+}
+
 /* We load ELF binaries.  The following definitions are taken
  * from the ELF specification, [ELF1], more-or-less verbatim.  */
 
@@ -609,7 +933,21 @@ static bool setup_stack(struct intr_frame* if_) {
     return success;
 }
 
+/* Makes sure the top page of a user thread's stack slot, below
+ * STACK_TOP, is mapped.  A slot used before keeps its pages. */
+static bool uthread_setup_stack(uintptr_t stack_top) {
+    void* upage = (void*)(stack_top - PGSIZE);
+    uint8_t* kpage;
 
+    if (pml4_get_page(thread_current()->pml4, upage) != NULL) return true;
+    kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (kpage == NULL) return false;
+    if (!install_page(upage, kpage, true)) {
+        palloc_free_page(kpage);
+        return false;
+    }
+    return true;
+}
 
 /* Adds a mapping from user virtual address UPAGE to kernel
  * virtual address KPAGE to the page table.
@@ -644,7 +982,7 @@ static bool lazy_load_segment(struct page* page, void* aux) {
     off_t                   bytes_read;
     
     /* 선제적으로 free 처리(aux는 VM_ANON -> 로드 이후 더 이상 쓸 일이 없음) */
-    free(aux);
+    kmem_cache_free(uninit_aux_cache, aux);
 
     kpage = page->frame->kva;
 
@@ -693,7 +1031,7 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
          * and zero the final PAGE_ZERO_BYTES bytes. */
         page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         page_zero_bytes = PGSIZE - page_read_bytes;
-        aux_file = (struct uninit_aux *)malloc(sizeof(struct uninit_aux));
+        aux_file = kmem_cache_alloc(uninit_aux_cache);
         /* TODO : malloc 실패 시 >> 이전 페이지까지의 malloc을 어떻게 처리할까? */
         if (!aux_file) return false;
 
@@ -709,7 +1047,7 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
         
         aux = aux_file;
         if (!vm_alloc_page_with_initializer(VM_ANON, upage, writable, lazy_load_segment, aux)){
-            free(aux_file);
+            kmem_cache_free(uninit_aux_cache, aux_file);
             return false;
         }
 
@@ -740,4 +1078,19 @@ static bool setup_stack(struct intr_frame* if_) {
 
     return success;
 }
+
+/* Makes sure the top page of a user thread's stack slot, below
+ * STACK_TOP, is mapped.  A slot used before keeps its pages. */
+static bool uthread_setup_stack(uintptr_t stack_top) {
+    void* stack_bottom = (void*)(stack_top - PGSIZE);
+    struct supplemental_page_table* spt = &thread_current()->leader->spt;
+    bool success;
+
+    lock_acquire(&spt->lock);
+    success = spt_find_page(spt, stack_bottom) != NULL ||
+              (vm_alloc_page(VM_ANON | VM_MARKER_STACK, stack_bottom, true) &&
+               vm_claim_page(stack_bottom));
+    lock_release(&spt->lock);
+    return success;
+}
 #endif /* VM */
@@ -1,8 +1,11 @@
 #include "userprog/syscall.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 
+#include "devices/input.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "intrinsic.h"
@@ -14,6 +17,7 @@
 #include "threads/thread.h"
 #include "user/syscall.h"
 #include "userprog/fdtable.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
 #include "userprog/validate.h"
@@ -37,10 +41,15 @@ void syscall_handler(struct intr_frame*);
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target */
 #define MSR_SYSCALL_MASK 0xc0000084 /* Mask for the eflags */
 
+/* Serializes the file system and the FD tables.  A page fault
+ * holds the process's SPT lock while it loads a file-backed page
+ * under file_lock, so the SPT lock always comes first: file_lock
+ * is never held while touching user memory, which may fault.
+ * File names and file data are copied through kernel memory. */
 struct lock file_lock;
 
 static void syscall_halt(void);
-static void syscall_exit(int status);
+static void syscall_exit(int status) NO_RETURN;
 static pid_t syscall_fork(const char* thread_name, struct intr_frame* if_);
 static int syscall_exec(const char* cmd_line);
 static int syscall_wait(int pid);
@@ -56,8 +65,23 @@ static void syscall_close(int fd);
 static int syscall_dup2(int oldfd, int newfd);
 static void *syscall_mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 static void syscall_munmap (void *addr);
+static void syscall_schedstat(struct sched_stats* stats);
+static int syscall_futex_wait(int* uaddr, int expected);
+static int syscall_futex_wake(int* uaddr, int count);
+static tid_t syscall_thread_create(void* entry, void* arg1, void* arg2);
+static int syscall_thread_join(tid_t tid);
+static void syscall_thread_exit(void);
+static bool copy_in_name(char kname[NAME_MAX + 1], const char* name);
 
 void syscall_init(void) {
+    syscall_cpu_init();
+    lock_init(&file_lock);
+    futex_init();
+}
+
+/* Points the running CPU's SYSCALL instruction at syscall_entry.
+   Every CPU has its own copy of these MSRs. */
+void syscall_cpu_init(void) {
     write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48 | ((uint64_t)SEL_KCSEG) << 32);
     write_msr(MSR_LSTAR, (uint64_t)syscall_entry);
 
@@ -65,7 +89,6 @@ void syscall_init(void) {
      * until the syscall_entry swaps the userland stack to the kernel
      * mode stack. Therefore, we masked the FLAG_FL. */
     write_msr(MSR_SYSCALL_MASK, FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-    lock_init(&file_lock);
 }
 
 /* The main system call interface */
@@ -125,13 +148,37 @@ void syscall_handler(struct intr_frame* f) {
     	case SYS_MUNMAP:
             syscall_munmap(arg1);
             break;
+        case SYS_SCHEDSTAT:
+            syscall_schedstat((struct sched_stats*)arg1);
+            break;
+        case SYS_FUTEX_WAIT:
+            f->R.rax = syscall_futex_wait((int*)arg1, (int)arg2);
+            break;
+        case SYS_FUTEX_WAKE:
+            f->R.rax = syscall_futex_wake((int*)arg1, (int)arg2);
+            break;
+        case SYS_THREAD_CREATE:
+            f->R.rax = syscall_thread_create((void*)arg1, (void*)arg2, (void*)arg3);
+            break;
+        case SYS_THREAD_JOIN:
+            f->R.rax = syscall_thread_join((tid_t)arg1);
+            break;
+        case SYS_THREAD_EXIT:
+            syscall_thread_exit();
+            break;
     }
+
+    /* Another thread may have exited the process meanwhile. */
+    process_check_exiting();
 }
 
 static void syscall_halt(void) { power_off(); }
 
 static void syscall_exit(int status) {
-    thread_current()->my_entry->exit_status = status;
+    struct thread* leader = thread_current()->leader;
+
+    /* The first thread to exit decides the process's status. */
+    if (!leader->exiting) leader->my_entry->exit_status = status;
     thread_exit();
 }
 
@@ -143,6 +190,10 @@ static pid_t syscall_fork(const char* thread_name, struct intr_frame* if_) {
 static int syscall_exec(const char* cmd_line) {
     if (cmd_line == NULL || !valid_address(cmd_line, false)) syscall_exit(-1);
 
+    /* Replacing the address space would pull it out from under the
+       process's other threads. */
+    if (thread_current()->leader->thread_cnt > 1) return -1;
+
     char* cmd_line_copy = palloc_get_page(0);
     if (cmd_line_copy == NULL) syscall_exit(-1);
     strlcpy(cmd_line_copy, cmd_line, PGSIZE);
@@ -154,94 +205,144 @@ static int syscall_exec(const char* cmd_line) {
 static int syscall_wait(int pid) { return process_wait(pid); }
 
 static bool syscall_create(const char* file, unsigned initial_size) {
+    char name[NAME_MAX + 1];
     bool success;
 
     if (!valid_address(file, false)) syscall_exit(-1);
+    if (!copy_in_name(name, file)) return false;
     lock_acquire(&file_lock);
-    success = filesys_create(file, initial_size);
+    success = filesys_create(name, initial_size);
     lock_release(&file_lock);
     return success;
 }
 
 static bool syscall_remove(const char* file) {
+    char name[NAME_MAX + 1];
     bool success;
 
     if (!valid_address(file, false)) syscall_exit(-1);
+    if (!copy_in_name(name, file)) return false;
     lock_acquire(&file_lock);
-    success = filesys_remove(file);
+    success = filesys_remove(name);
     lock_release(&file_lock);
     return success;
 }
 
 static int syscall_open(const char* file) {
+    char name[NAME_MAX + 1];
     struct file* new_entry;
+    int fd;
     if (!valid_address(file, false)) syscall_exit(-1);
+    if (!copy_in_name(name, file)) return -1;
     lock_acquire(&file_lock);
-    new_entry = filesys_open(file);
+    new_entry = filesys_open(name);
     lock_release(&file_lock);
     if (!new_entry) return -1;
-    return fd_allocate(thread_current(), new_entry);
+
+    lock_acquire(&file_lock);
+    fd = fd_allocate(thread_current()->leader, new_entry);
+    lock_release(&file_lock);
+    return fd;
 }
 
 static int syscall_filesize(int fd) {
     struct file* entry;
     int result;
 
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry || entry == stdin_entry || entry == stdout_entry) return -1;
-
     lock_acquire(&file_lock);
-    result = file_length(entry);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    if (!entry || entry == stdin_entry || entry == stdout_entry)
+        result = -1;
+    else
+        result = file_length(entry);
     lock_release(&file_lock);
     return result;
 }
 
 static int syscall_read(int fd, void* buffer, unsigned size) {
     struct file* entry;
-    int result;
+    uint8_t* bounce;
+    int result = 0;
     if (size == 0) return 0;
 
     if (!check_buffer((void *)buffer, size, true)) syscall_exit(-1);
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry || entry == stdout_entry) return -1;
 
     lock_acquire(&file_lock);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    lock_release(&file_lock);
+    if (!entry || entry == stdout_entry) return -1;
     if (entry == stdin_entry) {
-        for (int i = 0; i < size; i++) ((char*)buffer)[i] = input_getc();
-        result = size;
-    } else {
-        result = file_read(entry, buffer, size);
+        /* Cut short if the process is told to exit meanwhile. */
+        uint8_t key;
+        while (result < (int)size && input_getc_interruptible(&key)) ((char*)buffer)[result++] = key;
+        return result;
     }
-    lock_release(&file_lock);
+
+    /* A page at a time, looking FD up again each time, since
+     * another thread may close it while file_lock is released. */
+    bounce = palloc_get_page(0);
+    if (bounce == NULL) return -1;
+    while (result < (int)size) {
+        int chunk = size - result < PGSIZE ? size - result : PGSIZE;
+        int n = -1;
+
+        lock_acquire(&file_lock);
+        entry = get_fd_entry(thread_current()->leader, fd);
+        if (entry && entry != stdin_entry && entry != stdout_entry) n = file_read(entry, bounce, chunk);
+        lock_release(&file_lock);
+        if (n < 0 && result == 0) result = -1;
+        if (n <= 0) break;
+        memcpy((uint8_t*)buffer + result, bounce, n);
+        result += n;
+        if (n < chunk) break;
+    }
+    palloc_free_page(bounce);
     return result;
 }
 
 static int syscall_write(int fd, const void* buffer, unsigned size) {
     struct file* entry;
-    int result;
+    uint8_t* bounce;
+    int result = 0;
 
     if (!check_buffer((void *)buffer, size, false)) syscall_exit(-1);
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry || entry == stdin_entry) return -1;
 
     lock_acquire(&file_lock);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    lock_release(&file_lock);
+    if (!entry || entry == stdin_entry) return -1;
     if (entry == stdout_entry) {
         putbuf(buffer, size);
-        result = size;
-    } else {
-        result = file_write(entry, buffer, size);
+        return size;
     }
-    lock_release(&file_lock);
+
+    /* As in syscall_read(). */
+    bounce = palloc_get_page(0);
+    if (bounce == NULL) return -1;
+    while (result < (int)size) {
+        int chunk = size - result < PGSIZE ? size - result : PGSIZE;
+        int n = -1;
+
+        memcpy(bounce, (const uint8_t*)buffer + result, chunk);
+        lock_acquire(&file_lock);
+        entry = get_fd_entry(thread_current()->leader, fd);
+        if (entry && entry != stdin_entry && entry != stdout_entry) n = file_write(entry, bounce, chunk);
+        lock_release(&file_lock);
+        if (n < 0 && result == 0) result = -1;
+        if (n <= 0) break;
+        result += n;
+        if (n < chunk) break;
+    }
+    palloc_free_page(bounce);
     return result;
 }
 
 static void syscall_seek(int fd, unsigned position) {
     struct file* entry;
 
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry) return;
     lock_acquire(&file_lock);
-    file_seek(entry, position);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    if (entry) file_seek(entry, position);
     lock_release(&file_lock);
 }
 
@@ -249,18 +350,16 @@ static unsigned syscall_tell(int fd) {
     struct file* entry;
     unsigned result;
 
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry) return 0;
-
     lock_acquire(&file_lock);
-    result = file_tell(entry);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    result = entry ? file_tell(entry) : 0;
     lock_release(&file_lock);
     return result;
 }
 
 static void syscall_close(int fd) {
     lock_acquire(&file_lock);
-    fd_close(thread_current(), fd);
+    fd_close(thread_current()->leader, fd);
     lock_release(&file_lock);
 }
 
@@ -269,22 +368,72 @@ static int syscall_dup2(int oldfd, int newfd) {
     if (oldfd == newfd) return newfd;
 
     lock_acquire(&file_lock);
-    int result = fd_dup2(thread_current(), oldfd, newfd);
+    int result = fd_dup2(thread_current()->leader, oldfd, newfd);
     lock_release(&file_lock);
     return result;
 }
 
 static void *syscall_mmap(void *addr, size_t length, int writable, int fd, off_t offset){
     struct file* entry;
+    struct file* file = NULL;
+    void *result;
     void *end = addr + length;
     if(addr == NULL || !is_user_vaddr(addr) || !is_user_vaddr(end) || end == NULL) return NULL;
     if(pg_ofs(addr) != 0 || length == 0 || pg_ofs(offset) != 0 ) return NULL;
-    entry = get_fd_entry(thread_current(), fd);
-    if (!entry || entry == stdin_entry || entry == stdout_entry) return NULL;
-    return do_mmap(addr, length, writable, entry, offset);
+
+    /* Map through a private handle, in case another thread closes FD. */
+    lock_acquire(&file_lock);
+    entry = get_fd_entry(thread_current()->leader, fd);
+    if (entry && entry != stdin_entry && entry != stdout_entry) file = file_reopen(entry);
+    lock_release(&file_lock);
+    if (!file) return NULL;
+
+    result = do_mmap(addr, length, writable, file, offset);
+    lock_acquire(&file_lock);
+    file_close(file);
+    lock_release(&file_lock);
+    return result;
 }
 
 static void syscall_munmap (void *addr){
     do_munmap(addr);
     return;
-}
\ No newline at end of file
+}
+
+static void syscall_schedstat(struct sched_stats* stats) {
+    struct sched_stats snapshot;
+
+    if (!check_buffer(stats, sizeof *stats, true)) syscall_exit(-1);
+    thread_get_sched_stats(thread_current(), &snapshot);
+    memcpy(stats, &snapshot, sizeof snapshot);
+}
+
+static int syscall_futex_wait(int* uaddr, int expected) {
+    if ((uintptr_t)uaddr % sizeof *uaddr != 0) return -1;
+    if (!valid_address(uaddr, false)) syscall_exit(-1);
+    return futex_wait(uaddr, expected);
+}
+
+static int syscall_futex_wake(int* uaddr, int count) {
+    if ((uintptr_t)uaddr % sizeof *uaddr != 0) return -1;
+    if (!valid_address(uaddr, false)) syscall_exit(-1);
+    return count > 0 ? futex_wake(uaddr, count) : 0;
+}
+
+static tid_t syscall_thread_create(void* entry, void* arg1, void* arg2) {
+    if (entry == NULL || !is_user_vaddr(entry)) return TID_ERROR;
+    return process_thread_create(entry, arg1, arg2);
+}
+
+static int syscall_thread_join(tid_t tid) { return process_thread_join(tid); }
+
+static void syscall_thread_exit(void) {
+    thread_current()->exit_thread_only = true;
+    thread_exit();
+}
+
+/* Copies the file name NAME from user memory into KNAME.  Returns
+ * false if it is too long to name any file. */
+static bool copy_in_name(char kname[NAME_MAX + 1], const char* name) {
+    return strlcpy(kname, name, NAME_MAX + 1) <= NAME_MAX;
+}
@@ -6,3 +6,4 @@ userprog_SRC += userprog/gdt.c		# GDT initialization.
 userprog_SRC += userprog/tss.c		# TSS management.
 userprog_SRC += userprog/fdtable.c	# File descriptor table.
 userprog_SRC += userprog/validate.c
+userprog_SRC += userprog/futex.c	# User-space synchronization.
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/mp.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -45,30 +46,34 @@
  *      stack pointer to point to the new thread's kernel stack.
  *      (The call is in schedule in thread.c.) */
 
-/* Kernel TSS. */
-struct task_state *tss;
+/* Boot CPU's TSS.  The other CPUs get theirs from kstack_init(),
+ * which records each CPU's TSS in its `struct cpu'. */
+static struct task_state *tss;
 
-/* Initializes the kernel TSS. */
+/* Initializes the boot CPU's TSS. */
 void
 tss_init (void) {
 	/* Our TSS is never used in a call gate or task gate, so only a
 	 * few fields of it are ever referenced, and those are the only
 	 * ones we initialize. */
 	tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	this_cpu ()->tss = tss;
 	tss_update (thread_current ());
 }
 
-/* Returns the kernel TSS. */
+/* Returns the boot CPU's TSS. */
 struct task_state *
 tss_get (void) {
 	ASSERT (tss != NULL);
 	return tss;
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
- * of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to point
+ * to the end of the thread stack. */
 void
 tss_update (struct thread *next) {
-	ASSERT (tss != NULL);
-	tss->rsp0 = (uint64_t) next + PGSIZE;
+	struct task_state *cpu_tss = this_cpu ()->tss;
+
+	ASSERT (cpu_tss != NULL);
+	cpu_tss->rsp0 = next->kstack_top;
 }
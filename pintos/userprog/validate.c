@@ -10,9 +10,12 @@ static int64_t put_user(uint8_t* udst, uint8_t byte);
 bool valid_address(const void* uaddr, bool write) {
     if (uaddr == NULL || !is_user_vaddr(uaddr)) return false;
     if (write){
-        struct supplemental_page_table *spt = &thread_current()->spt;
+        struct supplemental_page_table *spt = &thread_current()->leader->spt;
+        lock_acquire(&spt->lock);
         struct page *page = spt_find_page(spt, uaddr);
-        if(page && !page->writable){
+        bool writable = page == NULL || page->writable;
+        lock_release(&spt->lock);
+        if(!writable){
             return false;
         }
     }
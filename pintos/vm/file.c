@@ -15,6 +15,8 @@ static void file_backed_destroy (struct page *page);
 /* Helper Function */
 static bool valid_vma_range(uintptr_t vaild_addr_ptr, size_t valid_length);
 static bool file_load(struct page* page, void* aux);
+static void *mmap_pages(void *addr, size_t length, int writable,
+		struct file *file, off_t offset);
 static void write_back(struct page *page);
 
 
@@ -88,7 +90,7 @@ static void *get_group_number(struct page *page){
 static bool valid_vma_range(uintptr_t vaild_addr_ptr, size_t valid_length){
 	struct thread *cur = thread_current();
 	while(valid_length > 0){
-		if(spt_find_page(&cur->spt, vaild_addr_ptr)) return NULL;
+		if(spt_find_page(&cur->leader->spt, vaild_addr_ptr)) return NULL;
 		size_t move_bytes = (PGSIZE < valid_length) ? PGSIZE : valid_length; 
 		vaild_addr_ptr += move_bytes;
 		valid_length -= move_bytes;
@@ -104,7 +106,7 @@ static bool file_load(struct page* page, void* aux){
 	size_t read_bytes = aux_file->page_read_bytes;
 	size_t zero_bytes = aux_file->page_zero_bytes;
 	void *mmap_base = aux_file->mmap_base;
-	free(aux);
+	kmem_cache_free(uninit_aux_cache, aux);
 
 	struct file_page *file_page = &page->file;
 	*file_page = (struct file_page){
@@ -127,6 +129,19 @@ static bool file_load(struct page* page, void* aux){
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current()->leader->spt;
+	void *result;
+
+	lock_acquire(&spt->lock);
+	result = mmap_pages(addr, length, writable, file, offset);
+	lock_release(&spt->lock);
+	return result;
+}
+
+/* Maps the pages for do_mmap(), with the SPT locked. */
+static void *
+mmap_pages (void *addr, size_t length, int writable,
+		struct file *file, off_t offset) {
 	uint8_t* upage = (uint8_t *)addr;
 	off_t ofs = offset;
 	struct uninit_aux *aux_file = NULL;
@@ -146,7 +161,7 @@ do_mmap (void *addr, size_t length, int writable,
 
 
 		/* aux 생성 */
-		aux_file = (struct uninit_aux *)malloc(sizeof(struct uninit_aux));
+		aux_file = kmem_cache_alloc(uninit_aux_cache);
 		*aux_file = (struct uninit_aux) {
 			.type = UNINIT_AUX_FILE,
 			.aux_file = (struct uninit_aux_file) {
@@ -160,7 +175,7 @@ do_mmap (void *addr, size_t length, int writable,
 
 		aux = aux_file;
 		if(!vm_alloc_page_with_initializer(VM_FILE, upage, writable, file_load, aux)){
-			free(aux_file);
+			kmem_cache_free(uninit_aux_cache, aux_file);
 			/* TODO : 중간에 실패시 지금까지 해온거 FREE 해야 함  */
 			return NULL;
 		}
@@ -179,11 +194,15 @@ do_mmap (void *addr, size_t length, int writable,
 /* Do the munmap */
 void
 do_munmap (void *addr) {
-	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct supplemental_page_table *spt = &thread_current()->leader->spt;
+	lock_acquire(&spt->lock);
 	struct page *pivot_page = spt_find_page(spt, addr);
 	struct page *page = NULL;
 	void *cur_addr = addr;
-	if(pivot_page == NULL || page_get_type(pivot_page) != VM_FILE) return;
+	if(pivot_page == NULL || page_get_type(pivot_page) != VM_FILE){
+		lock_release(&spt->lock);
+		return;
+	}
 	void *group_number = get_group_number(pivot_page);
 
 	/* spt 찾고 file_backed인지 확인 */
@@ -195,5 +214,6 @@ do_munmap (void *addr) {
 		spt_remove_page(spt, page);
 		addr += PGSIZE;
 	}
+	lock_release(&spt->lock);
 	return;
 }
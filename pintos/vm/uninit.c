@@ -15,6 +15,8 @@
 #include "filesys/filesys.h"
 #include "userprog/syscall.h"
 
+struct kmem_cache *uninit_aux_cache;
+
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
 
@@ -71,7 +73,7 @@ uninit_destroy (struct page *page) {
 		if(aux_uninit->type == UNINIT_AUX_FILE){
 			file_close(aux_uninit->aux_file.file);
 		} 
-		free (page->uninit.aux);
+		kmem_cache_free (uninit_aux_cache, page->uninit.aux);
 		page->uninit.aux = NULL;
 	}
 }
@@ -82,9 +84,9 @@ uninit_aux_load_copy(struct supplemental_page_table *dst, struct page *src_page)
 	struct uninit_aux		*aux = NULL;
 
 
-	current_file_copy = thread_current()->current_file;
+	current_file_copy = thread_current()->leader->current_file;
 
-	aux = (struct uninit_aux *)calloc(1, sizeof(struct uninit_aux));
+	aux = kmem_cache_alloc (uninit_aux_cache);
 	if (!aux) return false;
 
 	memcpy(aux, src_page->uninit.aux, sizeof(struct uninit_aux));
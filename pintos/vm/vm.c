@@ -8,6 +8,11 @@
 #include <stdbool.h>
 #include <string.h>
 #include "threads/mmu.h"
+#include "threads/slab.h"
+
+/* Caches of struct page and struct frame. */
+static struct kmem_cache *page_cache;
+static struct kmem_cache *frame_cache;
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -20,7 +25,9 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	page_cache = kmem_cache_create ("page", sizeof (struct page), 0, NULL);
+	frame_cache = kmem_cache_create ("frame", sizeof (struct frame), 0, NULL);
+	uninit_aux_cache = kmem_cache_create ("uninit_aux", sizeof (struct uninit_aux), 0, NULL);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -56,14 +63,14 @@ static bool is_valid_stack_access(uintptr_t user_rsp, void *addr);
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
-	struct supplemental_page_table	*spt = &thread_current ()->spt;
+	struct supplemental_page_table	*spt = &thread_current ()->leader->spt;
 	struct page 					*page = NULL;
 	bool 							(*type_initializer)(struct page *, enum vm_type, void *);
 
 	ASSERT (VM_TYPE(type) != VM_UNINIT);
 
 	if (spt_find_page (spt, upage) == NULL) {
-		page = (struct page *)malloc(sizeof(struct page));
+		page = kmem_cache_alloc(page_cache);
 		if(page == NULL) goto err;
 
 		switch (VM_TYPE(type)){
@@ -85,7 +92,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		return true;
 	}
 err:
-	if(page) free(page);
+	if(page) kmem_cache_free(page_cache, page);
 	return false;
 }
 
@@ -156,7 +163,7 @@ vm_get_frame (void) {
 
 	if(!user_new_page) PANIC("TODO Implement Frame Table");
 	
-	frame = (struct frame *)malloc(sizeof(struct frame));
+	frame = kmem_cache_alloc(frame_cache);
 	if(!frame){
 		palloc_free_page(user_new_page);
 		return NULL;
@@ -175,7 +182,7 @@ vm_get_frame (void) {
 static void
 vm_stack_growth (void *addr) {
 	uintptr_t pg_align_addr = (uintptr_t)pg_round_down(addr);
-	while(pg_align_addr < (uintptr_t) USER_STACK){
+	while(pg_align_addr < thread_current()->stack_top){
 		if(!vm_alloc_page(VM_ANON | VM_MARKER_STACK, pg_align_addr, true))
 			break;
 		pg_align_addr += PGSIZE;
@@ -191,32 +198,47 @@ vm_handle_wp (struct page *page UNUSED) {
 bool
 vm_try_handle_fault (struct intr_frame *f, void *addr, bool user, 
 	bool write, bool not_present) {
-	struct supplemental_page_table	*spt = &thread_current()->spt;
+	struct supplemental_page_table	*spt = &thread_current()->leader->spt;
 	struct page						*page = NULL;
+	bool							locked;
+	bool							success = false;
 
 	if(is_kernel_vaddr(addr) || !addr) return false;
 	uintptr_t user_rsp = user ? (f->rsp):(thread_current()->rsp);
 
+	/* The process's other threads may be faulting too.  Kernel code
+	   that already holds the lock faults only on pages it is about
+	   to look up anyway. */
+	locked = !lock_held_by_current_thread(&spt->lock);
+	if(locked) lock_acquire(&spt->lock);
+
 	page = spt_find_page(spt, addr);
 	if(page){
 		if(write && (!page->writable)) 
-			return false;
+			goto done;
 	} else {
 		if(is_valid_stack_access(user_rsp, addr)){
 			vm_stack_growth(addr);
 			page = spt_find_page(spt, addr); /* vm_stack_growth에서 SPT에 다시 등록했기 때문에, 다시 찾아야 함 */
 		} else {
-			return false;
+			goto done;
 		}
 	}
-	return vm_do_claim_page(page);
+	success = vm_do_claim_page(page);
+done:
+	if(locked) lock_release(&spt->lock);
+	return success;
 }
 
+/* Each thread's stack grows within its own slot below its
+   stack_top. */
 static bool is_valid_stack_access(uintptr_t user_rsp, void *addr){
-	if(addr > USER_STACK)
+	uintptr_t stack_top = thread_current()->stack_top;
+
+	if((uintptr_t)addr > stack_top)
 		return false;
 	
-	if((uintptr_t)addr < (uintptr_t)USER_STACK - (uintptr_t)USER_STACK_MAX_SIZE)
+	if((uintptr_t)addr < stack_top - (uintptr_t)USER_STACK_MAX_SIZE)
 	 	return false;
 
 	if((uintptr_t)addr < user_rsp - 8)
@@ -226,18 +248,20 @@ static bool is_valid_stack_access(uintptr_t user_rsp, void *addr){
 }
 
 /* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
+ * DO NOT MODIFY THIS FUNCTION.
+ * The one exception: struct page comes from page_cache, not malloc(),
+ * so it goes back there, the same as in vm_alloc_page_with_initializer(). */
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	kmem_cache_free (page_cache, page);
 }
 
 static void
 vm_dealloc_frame(struct frame *frame){
 	palloc_free_page(frame -> kva);
 	//list_remove(&frame->elem); // TODO: 프레임 리스트 구현 시 주석 해제(아직 구현 안됨)
-	free(frame);
+	kmem_cache_free(frame_cache, frame);
 }
 
 
@@ -247,7 +271,7 @@ vm_claim_page (void *va) {
 	struct page		*page = NULL;
 	struct thread	*cur = thread_current();
 
-	page = spt_find_page(&cur->spt, va);
+	page = spt_find_page(&cur->leader->spt, va);
 	return vm_do_claim_page (page);
 }
 
@@ -284,6 +308,7 @@ supplemental_page_table_init (struct supplemental_page_table *spt) {
 	/* 해시 함수로 다시 구현 */
 	if(!hash_init(&spt->hs_table, page_hash, page_less, NULL))
 		PANIC("spt initialize failed");
+	lock_init(&spt->lock);
 }
 
 /* Copy supplemental page table from src to dst */